@@ -4,8 +4,13 @@ JRT_MEM_PHYS:=0x51000000
 JRT_MEM_SIZE:=0x01000000
 JRT_CODE_PHYS:=0x50000000
 JRT_CODE_SIZE:=0x01000000
+# top of the code window, the module's image cache (img_cache_size)
+JRT_IMG_CACHE_SIZE:=0x00400000
 # code (0x50000000-0x50FFFFFF)
 # data (0x51000000-0x51FFFFFF)
+# LLC shared with Linux, gives the page colors (shared/color.h)
+JRT_LLC_SIZE:=0x200000
+JRT_LLC_WAYS:=16
 
 LINUX_CROSS := aarch64-linux-gnu-
 NONE_CROSS  := aarch64-none-elf-
@@ -27,6 +32,14 @@ DOCKER_DIR  := $(abspath docker)
 # Artifacts
 RT_BIN      := $(abspath $(ROOTFS_DIR)/rt.bin)
 LOADER_BIN  := $(abspath $(ROOTFS_DIR)/loader)
+JRTD_BIN    := $(abspath $(ROOTFS_DIR)/jrtd)
+JRTC_BIN    := $(abspath $(ROOTFS_DIR)/jrtc)
+JRTEVT_BIN  := $(abspath $(ROOTFS_DIR)/jrtevt)
+JRTCHAN_BIN := $(abspath $(ROOTFS_DIR)/jrtchan)
+JRTTOP_BIN  := $(abspath $(ROOTFS_DIR)/jrttop)
+JRTHIST_BIN := $(abspath $(ROOTFS_DIR)/jrthist)
+JRTPROF_BIN := $(abspath $(ROOTFS_DIR)/jrtprof)
+JRTWCET_BIN := $(abspath $(ROOTFS_DIR)/jrtwcet)
 MODULE_KO   := $(abspath $(ROOTFS_DIR)/rtcore.ko)
 KERNEL_IMG  := $(abspath $(KERNEL_DIR)/kernel/arch/$(ARCH)/boot/Image)
 BUSYBOX_BIN := $(abspath $(ROOTFS_DIR)/bin/busybox)
@@ -37,7 +50,10 @@ COMMON_CFLAGS:= \
 	-DJRT_MEM_PHYS=$(JRT_MEM_PHYS) \
 	-DJRT_MEM_SIZE=$(JRT_MEM_SIZE) \
 	-DJRT_CODE_PHYS=$(JRT_CODE_PHYS) \
-	-DJRT_CODE_SIZE=$(JRT_CODE_SIZE)
+	-DJRT_CODE_SIZE=$(JRT_CODE_SIZE) \
+	-DJRT_IMG_CACHE_SIZE=$(JRT_IMG_CACHE_SIZE) \
+	-DJRT_LLC_SIZE=$(JRT_LLC_SIZE) \
+	-DJRT_LLC_WAYS=$(JRT_LLC_WAYS)
 
 PACKAGE_LIST    := $(DOCKER_DIR)/packages.txt
 DOCKER_IMG      := jrt-builder
@@ -48,11 +64,11 @@ IN_CONTAINER    := $(shell test -f /.dockerenv && echo 1 || echo 0)
 export JRT_MEM_PHYS JRT_MEM_SIZE LINUX_CROSS \
 	NONE_CROSS ARCH KERNEL_DIR BUSYBOX_DIR \
 	INITRAMFS ROOTFS_DIR SHARED_DIR USPACE_DIR \
-	KMOD_DIR RT_BIN LOADER_BIN CHECKER_BIN MODULE_KO \
+	KMOD_DIR RT_BIN LOADER_BIN JRTD_BIN JRTC_BIN JRTEVT_BIN JRTCHAN_BIN JRTTOP_BIN JRTHIST_BIN JRTPROF_BIN JRTWCET_BIN CHECKER_BIN MODULE_KO \
 	KERNEL_IMG BUSYBOX_BIN COMMON_CFLAGS PROJECT_ROOT \
 	DOCKER_DIR DOCKERFILE DOCKER_IMG DEVTREE_BLOB \
 	TOOLCHAIN_CACHE IN_CONTAINER TARGET PACKAGE_LIST \
-	JRT_CODE_SIZE JRT_CODE_PHYS
+	JRT_CODE_SIZE JRT_CODE_PHYS JRT_IMG_CACHE_SIZE
 
 
 
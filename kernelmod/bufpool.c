@@ -0,0 +1,341 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/genalloc.h>
+#include <linux/idr.h>
+#include <linux/of.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "bufpool.h"
+
+typedef struct rtcore_buf {
+	void *owner;			/* NULL once the fd is closed */
+	phys_addr_t phys;
+	size_t size;
+	bool lent;			/* submitted with a job still running */
+	atomic_t maps;			/* user mappings of the buffer */
+} rtcore_buf_t;
+
+static DEFINE_MUTEX(buf_lock);
+static struct gen_pool *buf_pool;
+static DEFINE_IDR(buf_idr);
+static void *buf_virt;
+
+static void rtcore_buf_destroy(u32 handle, rtcore_buf_t *b)
+{
+	idr_remove(&buf_idr, handle);
+	gen_pool_free(buf_pool, b->phys, b->size);
+	kfree(b);
+}
+
+static rtcore_buf_t *rtcore_buf_find(void *owner, u32 handle)
+{
+	rtcore_buf_t *b;
+
+	b = idr_find(&buf_idr, handle);
+	return b && b->owner == owner ? b : NULL;
+}
+
+/*
+ * Job buffers are the part of the reserved window Linux works in, keep
+ * them off the LLC colors of RT process memory (color.h). Buffers no
+ * run of Linux colors can hold go wherever first fit puts them.
+ */
+static bool rtcore_buf_off_rt(unsigned long phys, unsigned long size)
+{
+	unsigned long end;
+
+	for (end = phys + size; phys < end; phys += JRT_COLOR_PAGE) {
+		if (jrt_color_rt(phys))
+			return false;
+	}
+	return true;
+}
+
+static unsigned long rtcore_buf_fit(unsigned long *map, unsigned long size,
+	unsigned long start, unsigned int nr, void *data,
+	struct gen_pool *pool, unsigned long start_addr)
+{
+	unsigned long idx;
+	int order;
+
+	order = pool->min_alloc_order;
+	idx = bitmap_find_next_zero_area(map, size, start, nr, 0);
+	while (idx < size) {
+		if (rtcore_buf_off_rt(start_addr + (idx << order),
+			(unsigned long)nr << order))
+			return idx;
+		idx = bitmap_find_next_zero_area(map, size, idx + 1, nr, 0);
+	}
+	return size;
+}
+
+/* JRT has no devicetree, tell when its build-time LLC is not this one */
+static void rtcore_buf_check_llc(void)
+{
+	struct device_node *np, *llc;
+	u32 level, best, size, sets, line, ncolors;
+
+	llc = NULL;
+	best = 0;
+	for_each_node_with_property(np, "cache-level") {
+		if (of_property_read_u32(np, "cache-level", &level) ||
+			level <= best)
+			continue;
+		of_node_put(llc);
+		llc = of_node_get(np);
+		best = level;
+	}
+	if (!llc) {
+		pr_info("rtcore: no LLC in the devicetree, %u page colors as built\n",
+			(u32)JRT_NCOLORS);
+		return;
+	}
+	if (of_property_read_u32(llc, "cache-size", &size) ||
+		of_property_read_u32(llc, "cache-sets", &sets) ||
+		of_property_read_u32(llc, "cache-line-size", &line) ||
+		!sets || !line) {
+		pr_info("rtcore: %pOF has no usable geometry, %u page colors as built\n",
+			llc, (u32)JRT_NCOLORS);
+		of_node_put(llc);
+		return;
+	}
+	ncolors = sets * line / JRT_COLOR_PAGE;
+	if (ncolors != JRT_NCOLORS)
+		pr_warn("rtcore: %pOF (%u bytes, %u ways) has %u page colors, "
+			"JRT was built for %u, the LLC is not partitioned\n",
+			llc, size, size / (sets * line), ncolors,
+			(u32)JRT_NCOLORS);
+	else
+		pr_info("rtcore: %u page colors, RT mask 0x%llx\n",
+			ncolors, (unsigned long long)JRT_RT_COLORS);
+	of_node_put(llc);
+}
+
+int rtcore_buf_init(void)
+{
+	buf_virt = memremap(BUF_POOL_ADDR, BUF_POOL_SIZE, MEMREMAP_WB);
+	if (!buf_virt) {
+		pr_err("rtcore: failed to map BUF_POOL memory\n");
+		return -ENOMEM;
+	}
+
+	buf_pool = gen_pool_create(PAGE_SHIFT, -1);
+	if (!buf_pool) {
+		memunmap(buf_virt);
+		return -ENOMEM;
+	}
+	if (gen_pool_add(buf_pool, BUF_POOL_ADDR, BUF_POOL_SIZE, -1)) {
+		gen_pool_destroy(buf_pool);
+		memunmap(buf_virt);
+		return -ENOMEM;
+	}
+	pr_info("rtcore: buffer pool 0x%lx bytes at 0x%lx\n",
+		(unsigned long)BUF_POOL_SIZE, (unsigned long)BUF_POOL_ADDR);
+	rtcore_buf_check_llc();
+	return 0;
+}
+
+void rtcore_buf_exit(void)
+{
+	rtcore_buf_t *b;
+	int id;
+
+	idr_for_each_entry(&buf_idr, b, id)
+		rtcore_buf_destroy(id, b);
+	idr_destroy(&buf_idr);
+	gen_pool_destroy(buf_pool);
+	memunmap(buf_virt);
+}
+
+long rtcore_buf_alloc(void *owner, unsigned long arg)
+{
+	buf_alloc_args_t args;
+	rtcore_buf_t *b;
+	phys_addr_t phys;
+	int id;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+	if (!args.size || args.size > BUF_POOL_SIZE)
+		return -EINVAL;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+	b->owner = owner;
+	b->size = PAGE_ALIGN(args.size);
+
+	mutex_lock(&buf_lock);
+	phys = gen_pool_alloc_algo(buf_pool, b->size, rtcore_buf_fit, NULL);
+	if (!phys) {
+		phys = gen_pool_alloc(buf_pool, b->size);
+		if (phys)
+			pr_info_once("rtcore: %zu byte buffer placed on RT colors\n",
+				b->size);
+	}
+	if (!phys) {
+		mutex_unlock(&buf_lock);
+		kfree(b);
+		return -ENOSPC;
+	}
+	b->phys = phys;
+	id = idr_alloc(&buf_idr, b, 1, 0, GFP_KERNEL);
+	if (id < 0) {
+		gen_pool_free(buf_pool, phys, b->size);
+		mutex_unlock(&buf_lock);
+		kfree(b);
+		return id;
+	}
+	mutex_unlock(&buf_lock);
+
+	/* the pool is shared by every fd, never hand out stale data */
+	memset(buf_virt + (phys - BUF_POOL_ADDR), 0, b->size);
+
+	args.size = b->size;
+	args.handle = id;
+	args.offset = RTCORE_BUF_MMAP_OFF + (phys - BUF_POOL_ADDR);
+	if (copy_to_user((void __user *)arg, &args, sizeof(args)))
+		return -EFAULT;
+	return 0;
+}
+
+long rtcore_buf_free(void *owner, unsigned long arg)
+{
+	rtcore_buf_t *b;
+	u64 handle;
+	long res;
+
+	if (copy_from_user(&handle, (void __user *)arg, sizeof(handle)))
+		return -EFAULT;
+
+	mutex_lock(&buf_lock);
+	b = handle <= INT_MAX ? rtcore_buf_find(owner, handle) : NULL;
+	if (!b)
+		res = -ENOENT;
+	else if (b->lent || atomic_read(&b->maps))
+		res = -EBUSY;
+	else {
+		rtcore_buf_destroy(handle, b);
+		res = 0;
+	}
+	mutex_unlock(&buf_lock);
+	return res;
+}
+
+static void rtcore_buf_vm_open(struct vm_area_struct *vma)
+{
+	rtcore_buf_t *b;
+
+	b = vma->vm_private_data;
+	atomic_inc(&b->maps);
+}
+
+static void rtcore_buf_vm_close(struct vm_area_struct *vma)
+{
+	rtcore_buf_t *b;
+
+	b = vma->vm_private_data;
+	atomic_dec(&b->maps);
+}
+
+static const struct vm_operations_struct rtcore_buf_vm_ops = {
+	.open = rtcore_buf_vm_open,
+	.close = rtcore_buf_vm_close,
+};
+
+/* offset is the one returned by RTCORE_IOCTL_BUF_ALLOC */
+int rtcore_buf_mmap(void *owner, struct vm_area_struct *vma)
+{
+	rtcore_buf_t *b, *it;
+	phys_addr_t phys;
+	unsigned long size;
+	int id, res;
+
+	size = vma->vm_end - vma->vm_start;
+	phys = BUF_POOL_ADDR +
+		(((phys_addr_t)vma->vm_pgoff << PAGE_SHIFT) - RTCORE_BUF_MMAP_OFF);
+
+	mutex_lock(&buf_lock);
+	b = NULL;
+	idr_for_each_entry(&buf_idr, it, id) {
+		if (it->owner == owner && it->phys == phys) {
+			b = it;
+			break;
+		}
+	}
+	if (!b || size > b->size) {
+		mutex_unlock(&buf_lock);
+		return -EINVAL;
+	}
+
+	res = remap_pfn_range(vma, vma->vm_start, phys >> PAGE_SHIFT,
+		size, vma->vm_page_prot);
+	if (!res) {
+		vma->vm_private_data = b;
+		vma->vm_ops = &rtcore_buf_vm_ops;
+		atomic_inc(&b->maps);
+	}
+	mutex_unlock(&buf_lock);
+	return res;
+}
+
+/* buffers still lent to a job are freed when the job completes */
+void rtcore_buf_release(void *owner)
+{
+	rtcore_buf_t *b;
+	int id;
+
+	mutex_lock(&buf_lock);
+	idr_for_each_entry(&buf_idr, b, id) {
+		if (b->owner != owner)
+			continue;
+		b->owner = NULL;
+		if (!b->lent)
+			rtcore_buf_destroy(id, b);
+	}
+	mutex_unlock(&buf_lock);
+}
+
+int rtcore_buf_lend(void *owner, u64 handle, phys_addr_t *phys, u32 *size)
+{
+	rtcore_buf_t *b;
+	int res;
+
+	mutex_lock(&buf_lock);
+	b = handle <= INT_MAX ? rtcore_buf_find(owner, handle) : NULL;
+	if (!b)
+		res = -ENOENT;
+	else if (b->lent)
+		res = -EBUSY;
+	else {
+		b->lent = true;
+		*phys = b->phys;
+		*size = b->size;
+		res = 0;
+	}
+	mutex_unlock(&buf_lock);
+	return res;
+}
+
+void rtcore_buf_return(u32 handle)
+{
+	rtcore_buf_t *b;
+
+	mutex_lock(&buf_lock);
+	b = idr_find(&buf_idr, handle);
+	if (b) {
+		b->lent = false;
+		if (!b->owner)
+			rtcore_buf_destroy(handle, b);
+	}
+	mutex_unlock(&buf_lock);
+}
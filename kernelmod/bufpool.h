@@ -0,0 +1,30 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_BUFPOOL_H_
+#define _RTCORE_BUFPOOL_H_
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+/*
+ * Job buffers in the data window (BUF_POOL_ADDR). JRT sees the whole
+ * pool through the kernel tables every process map links, so lending a
+ * buffer to a job is only its address in the submission record.
+ */
+
+int rtcore_buf_init(void);
+void rtcore_buf_exit(void);
+
+/* owner: the allocating fd's context, buffers go away with it */
+long rtcore_buf_alloc(void *owner, unsigned long arg);
+long rtcore_buf_free(void *owner, unsigned long arg);
+int rtcore_buf_mmap(void *owner, struct vm_area_struct *vma);
+void rtcore_buf_release(void *owner);
+
+/* hand a buffer to a job until its completion record comes back */
+int rtcore_buf_lend(void *owner, u64 handle, phys_addr_t *phys, u32 *size);
+void rtcore_buf_return(u32 handle);
+
+#endif
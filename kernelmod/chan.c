@@ -0,0 +1,126 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "chan.h"
+
+static DEFINE_MUTEX(chan_lock);
+static struct chan_dir *chan_dir;
+static u64 chan_used;		/* bump allocator, channels are never freed */
+
+static chan_desc_t *rtcore_chan_find(const char *name)
+{
+	chan_desc_t *d;
+	u32 i;
+
+	for (i = 0; i < CHAN_MAX; ++i) {
+		d = &chan_dir->d[i];
+		if (d->type && !strcmp(d->name, name))
+			return d;
+	}
+	return NULL;
+}
+
+/* set up the header, then publish the entry with its type */
+static void rtcore_chan_setup(chan_desc_t *d, const chan_create_args_t *args)
+{
+	struct chan_triple *t;
+	void *hdr;
+
+	hdr = (u8 *)chan_dir + chan_used;
+	memset(hdr, 0, CHAN_BYTES(args->type, args->size));
+	if (args->type == CHAN_TRIPLE) {
+		t = hdr;
+		t->back = 0;
+		t->mid = 1;
+		t->front = 2;
+	}
+
+	memcpy(d->name, args->name, CHAN_NAME_MAX);
+	d->size = args->size;
+	d->off = chan_used;
+	smp_store_release(&d->type, args->type);
+
+	chan_used += CHAN_BYTES(args->type, args->size);
+}
+
+long rtcore_chan_create(unsigned long arg)
+{
+	chan_create_args_t args;
+	chan_desc_t *d;
+	u32 i;
+	long res;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+	if (!args.name[0] || !memchr(args.name, '\0', CHAN_NAME_MAX) ||
+		(args.type != CHAN_SEQLOCK && args.type != CHAN_TRIPLE) ||
+		!args.size || args.size > CHAN_SIZE_MAX)
+		return -EINVAL;
+
+	mutex_lock(&chan_lock);
+	d = rtcore_chan_find(args.name);
+	if (d) {
+		res = d->type == args.type && d->size == args.size ? 0 : -EEXIST;
+		goto out;
+	}
+
+	for (i = 0; i < CHAN_MAX && chan_dir->d[i].type; ++i)
+		;
+	if (i == CHAN_MAX ||
+		chan_used + CHAN_BYTES(args.type, args.size) > CHAN_AREA_SIZE) {
+		res = -ENOSPC;
+		goto out;
+	}
+	d = &chan_dir->d[i];
+	rtcore_chan_setup(d, &args);
+	res = 0;
+out:
+	if (!res)
+		args.off = d->off;
+	mutex_unlock(&chan_lock);
+
+	if (!res && copy_to_user((void __user *)arg, &args, sizeof(args)))
+		return -EFAULT;
+	return res;
+}
+
+/* the whole area, readers and writers find their channels by name */
+int rtcore_chan_mmap(struct vm_area_struct *vma)
+{
+	unsigned long size;
+
+	size = vma->vm_end - vma->vm_start;
+	if ((vma->vm_pgoff << PAGE_SHIFT) != RTCORE_CHAN_MMAP_OFF ||
+		size > CHAN_AREA_SIZE)
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start, CHAN_AREA_ADDR >> PAGE_SHIFT,
+		size, vma->vm_page_prot);
+}
+
+int rtcore_chan_init(void)
+{
+	chan_dir = memremap(CHAN_AREA_ADDR, CHAN_AREA_SIZE, MEMREMAP_WB);
+	if (!chan_dir) {
+		pr_err("rtcore: failed to map CHAN_AREA memory\n");
+		return -ENOMEM;
+	}
+	memset(chan_dir, 0, sizeof(*chan_dir));
+	chan_used = CHAN_DATA_OFF;
+	return 0;
+}
+
+void rtcore_chan_exit(void)
+{
+	memunmap(chan_dir);
+}
@@ -0,0 +1,23 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_CHAN_H_
+#define _RTCORE_CHAN_H_
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+/*
+ * Shared-state channels (shared/chan.h). The module owns the directory
+ * and hands out channel memory, the data moves between the RT tasks and
+ * Linux mappings of the area without the module.
+ */
+
+int rtcore_chan_init(void);
+void rtcore_chan_exit(void);
+
+long rtcore_chan_create(unsigned long arg);
+int rtcore_chan_mmap(struct vm_area_struct *vma);
+
+#endif
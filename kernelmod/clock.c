@@ -0,0 +1,133 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/irqflags.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+#include <asm/arch_timer.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "clock.h"
+
+/* samples per update, the one with the narrowest counter window wins */
+#define CLOCK_SAMPLES	4
+
+static struct jrt_clock_page *clock_page;
+static struct delayed_work clock_work;
+
+/*
+ * Bracket one CLOCK_MONOTONIC read with two counter reads and take the
+ * midpoint, with interrupts off so the window is the cost of the reads.
+ */
+static s64 clock_offset(u64 *t_mid)
+{
+	unsigned long flags;
+	u64 t0, t1, mono, best_w;
+	s64 best;
+	int i;
+
+	best = 0;
+	best_w = U64_MAX;
+	for (i = 0; i < CLOCK_SAMPLES; ++i) {
+		local_irq_save(flags);
+		t0 = __arch_counter_get_cntvct();
+		mono = ktime_get_ns();
+		t1 = __arch_counter_get_cntvct();
+		local_irq_restore(flags);
+
+		if (t1 - t0 >= best_w)
+			continue;
+		best_w = t1 - t0;
+		*t_mid = t0 + best_w / 2;
+		best = (s64)(mono - jrt_mul_shift(*t_mid, clock_page->ns_mult,
+			clock_page->ns_shift));
+	}
+	return best;
+}
+
+static void clock_update(void)
+{
+	u64 t_mid;
+	s64 off;
+	u32 seq;
+
+	off = clock_offset(&t_mid);
+
+	seq = clock_page->seq;
+	WRITE_ONCE(clock_page->seq, seq + 1);
+	smp_wmb();
+	WRITE_ONCE(clock_page->mono_off, off);
+	WRITE_ONCE(clock_page->t_update, t_mid);
+	smp_wmb();
+	WRITE_ONCE(clock_page->seq, seq + 2);
+}
+
+/* NTP slews CLOCK_MONOTONIC, the counter runs free: follow the drift */
+static void clock_work_fn(struct work_struct *work)
+{
+	clock_update();
+	schedule_delayed_work(&clock_work,
+		msecs_to_jiffies(JRT_CLOCK_UPDATE_MS));
+}
+
+int rtcore_clock_init(void)
+{
+	u64 freq;
+
+	clock_page = memremap(CLOCK_PAGE_ADDR, CLOCK_PAGE_SIZE, MEMREMAP_WB);
+	if (!clock_page) {
+		pr_err("rtcore: failed to map CLOCK_PAGE memory\n");
+		return -ENOMEM;
+	}
+
+	freq = arch_timer_get_cntfrq();
+	memset(clock_page, 0, sizeof(*clock_page));
+	clock_page->version = JRT_CLOCK_VERSION;
+	clock_page->freq = freq;
+	jrt_clock_factors(freq, JRT_NSEC_PER_SEC, &clock_page->ns_mult,
+		&clock_page->ns_shift);
+	jrt_clock_factors(JRT_NSEC_PER_SEC, freq, &clock_page->tick_mult,
+		&clock_page->tick_shift);
+	clock_update();
+	/* readers check magic first, everything else is in place by now */
+	smp_store_release(&clock_page->magic, JRT_CLOCK_MAGIC);
+
+	INIT_DELAYED_WORK(&clock_work, clock_work_fn);
+	schedule_delayed_work(&clock_work,
+		msecs_to_jiffies(JRT_CLOCK_UPDATE_MS));
+	return 0;
+}
+
+void rtcore_clock_exit(void)
+{
+	cancel_delayed_work_sync(&clock_work);
+	WRITE_ONCE(clock_page->magic, 0);
+	memunmap(clock_page);
+}
+
+/* a tick count to ns, with the factors published on the page */
+u64 rtcore_clock_ns(u64 ticks)
+{
+	return jrt_mul_shift(ticks, clock_page->ns_mult, clock_page->ns_shift);
+}
+
+/* the module writes the clock page, nobody else does */
+int rtcore_clock_mmap(struct vm_area_struct *vma)
+{
+	unsigned long size;
+
+	size = vma->vm_end - vma->vm_start;
+	if ((vma->vm_pgoff << PAGE_SHIFT) != RTCORE_CLOCK_MMAP_OFF ||
+		size > PAGE_ALIGN(CLOCK_PAGE_SIZE) ||
+		(vma->vm_flags & VM_WRITE))
+		return -EINVAL;
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_pfn_range(vma, vma->vm_start, CLOCK_PAGE_ADDR >> PAGE_SHIFT,
+		size, vma->vm_page_prot);
+}
@@ -0,0 +1,22 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_CLOCK_H_
+#define _RTCORE_CLOCK_H_
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+/*
+ * The clock correlation page (shared/clock.h). The module is its only
+ * writer, JRT and user space map it read-only.
+ */
+
+int rtcore_clock_init(void);
+void rtcore_clock_exit(void);
+
+int rtcore_clock_mmap(struct vm_area_struct *vma);
+u64 rtcore_clock_ns(u64 ticks);
+
+#endif
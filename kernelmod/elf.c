@@ -0,0 +1,233 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/overflow.h>
+#include <linux/elf.h>
+
+#include "elf.h"
+
+#ifndef R_AARCH64_NONE
+#define R_AARCH64_NONE		0
+#endif
+#ifndef R_AARCH64_RELATIVE
+#define R_AARCH64_RELATIVE	1027
+#endif
+
+/* JRT maps 4 KiB pages, whatever PAGE_SIZE linux runs with */
+#define JRT_PAGE_SIZE		0x1000ULL
+
+static int read_exact(struct file *src, void *buf, size_t len, loff_t pos)
+{
+	ssize_t n;
+
+	n = kernel_read(src, buf, len, &pos);
+	if (n < 0)
+		return n;
+	return n == len ? 0 : -EIO;
+}
+
+/* page range [*start, *end) of PT_LOAD ph, false if it wraps */
+static bool rtcore_elf_pages(const Elf64_Phdr *ph, u64 *start, u64 *end)
+{
+	u64 va_end;
+
+	*start = ph->p_vaddr;
+	if (check_add_overflow(ph->p_vaddr, ph->p_memsz, &va_end) ||
+		check_add_overflow(va_end, JRT_PAGE_SIZE - 1, end))
+		return false;
+	*end &= ~(JRT_PAGE_SIZE - 1);
+	return true;
+}
+
+int rtcore_elf_probe(struct file *src, loff_t size, rtcore_elf_t *elf)
+{
+	Elf64_Phdr *ph;
+	u64 max_va, nload, end, start, other_start, other_end;
+	int i, j, res;
+
+	if (size < sizeof(elf->eh))
+		return 0;
+
+	res = read_exact(src, &elf->eh, sizeof(elf->eh), 0);
+	if (res)
+		return res;
+
+	if (memcmp(elf->eh.e_ident, ELFMAG, SELFMAG))
+		return 0;
+
+	if (elf->eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+		elf->eh.e_ident[EI_DATA] != ELFDATA2LSB ||
+		elf->eh.e_machine != EM_AARCH64 ||
+		(elf->eh.e_type != ET_EXEC && elf->eh.e_type != ET_DYN) ||
+		elf->eh.e_phentsize != sizeof(Elf64_Phdr) ||
+		!elf->eh.e_phnum || elf->eh.e_phnum > RTCORE_ELF_PHDR_MAX ||
+		check_add_overflow(elf->eh.e_phoff,
+			(u64)elf->eh.e_phnum * sizeof(Elf64_Phdr), &end) ||
+		end > size) {
+		pr_err("rtcore: unsupported ELF image\n");
+		return -ENOEXEC;
+	}
+
+	res = read_exact(src, elf->ph, elf->eh.e_phnum * sizeof(Elf64_Phdr),
+		elf->eh.e_phoff);
+	if (res)
+		return res;
+
+	elf->min_va = U64_MAX;
+	max_va = 0;
+	nload = 0;
+	for (i = 0; i < elf->eh.e_phnum; ++i) {
+		ph = &elf->ph[i];
+		if (ph->p_type != PT_LOAD)
+			continue;
+		/* every segment gets its own pages and permissions */
+		if ((ph->p_vaddr & (JRT_PAGE_SIZE - 1)) ||
+			ph->p_filesz > ph->p_memsz ||
+			check_add_overflow(ph->p_offset, ph->p_filesz, &end) ||
+			end > size ||
+			!rtcore_elf_pages(ph, &start, &end)) {
+			pr_err("rtcore: bad PT_LOAD %d\n", i);
+			return -ENOEXEC;
+		}
+		/* sharing a page would give it two sets of permissions */
+		for (j = 0; j < i; ++j) {
+			if (elf->ph[j].p_type != PT_LOAD)
+				continue;
+			rtcore_elf_pages(&elf->ph[j], &other_start, &other_end);
+			if (start < other_end && other_start < end) {
+				pr_err("rtcore: PT_LOAD %d overlaps %d\n", i, j);
+				return -ENOEXEC;
+			}
+		}
+		elf->min_va = min(elf->min_va, start);
+		max_va = max(max_va, end);
+		++nload;
+	}
+	if (!nload || nload > JRT_IMAGE_SEG_MAX) {
+		pr_err("rtcore: ELF has %llu PT_LOAD segments\n", nload);
+		return -ENOEXEC;
+	}
+	if (elf->eh.e_entry < elf->min_va || elf->eh.e_entry >= max_va)
+		return -ENOEXEC;
+
+	/* both ends are page aligned */
+	elf->span = max_va - elf->min_va;
+	elf->pie = elf->eh.e_type == ET_DYN;
+	return 1;
+}
+
+/* true if [va, va + len) lies in the image */
+static bool rtcore_elf_inside(const rtcore_elf_t *elf, u64 va, u64 len)
+{
+	u64 end;
+
+	return va >= elf->min_va &&
+		!check_add_overflow(va - elf->min_va, len, &end) &&
+		end <= elf->span;
+}
+
+static int rtcore_elf_relocate(const rtcore_elf_t *elf, void *base, u64 va)
+{
+	const Elf64_Phdr *ph;
+	const Elf64_Dyn *dyn;
+	const Elf64_Rela *r;
+	u64 rela, relasz, relaent, delta, ndyn, i;
+	int p;
+
+	dyn = NULL;
+	ndyn = 0;
+	for (p = 0; p < elf->eh.e_phnum; ++p) {
+		ph = &elf->ph[p];
+		if (ph->p_type != PT_DYNAMIC)
+			continue;
+		if (!rtcore_elf_inside(elf, ph->p_vaddr, ph->p_memsz) ||
+			(ph->p_vaddr & (__alignof__(Elf64_Dyn) - 1)))
+			return -ENOEXEC;
+		dyn = base + (ph->p_vaddr - elf->min_va);
+		ndyn = ph->p_memsz / sizeof(Elf64_Dyn);
+		break;
+	}
+	if (!dyn)
+		return 0;
+
+	rela = relasz = 0;
+	relaent = sizeof(Elf64_Rela);
+	for (i = 0; i < ndyn && dyn->d_tag != DT_NULL; ++i, ++dyn) {
+		if (dyn->d_tag == DT_RELA)
+			rela = dyn->d_un.d_ptr;
+		else if (dyn->d_tag == DT_RELASZ)
+			relasz = dyn->d_un.d_val;
+		else if (dyn->d_tag == DT_RELAENT)
+			relaent = dyn->d_un.d_val;
+	}
+	if (!relasz)
+		return 0;
+	if (relaent != sizeof(Elf64_Rela) ||
+		(rela & (__alignof__(Elf64_Rela) - 1)) ||
+		!rtcore_elf_inside(elf, rela, relasz))
+		return -ENOEXEC;
+
+	delta = va - elf->min_va;
+	r = base + (rela - elf->min_va);
+	for (i = 0; i < relasz / sizeof(*r); ++i, ++r) {
+		switch (ELF64_R_TYPE(r->r_info)) {
+		case R_AARCH64_NONE:
+			break;
+		case R_AARCH64_RELATIVE:
+			if (!rtcore_elf_inside(elf, r->r_offset, sizeof(u64)))
+				return -ENOEXEC;
+			*(u64 *)(base + (r->r_offset - elf->min_va)) = delta + r->r_addend;
+			break;
+		default:
+			/* no symbol lookup, apps only link against rtprog.elf */
+			pr_err("rtcore: unsupported relocation %llu\n",
+				(u64)ELF64_R_TYPE(r->r_info));
+			return -ENOEXEC;
+		}
+	}
+	return 0;
+}
+
+int rtcore_elf_load(struct file *src, const rtcore_elf_t *elf, void *dst, u64 va)
+{
+	jrt_image_hdr_t *hdr;
+	const Elf64_Phdr *ph;
+	jrt_image_seg_t *seg;
+	void *base;
+	int i, res;
+
+	hdr = dst;
+	base = dst + JRT_IMAGE_HDR_SIZE;
+
+	/* gaps and .bss read as zero, JRT copies writable segments from here */
+	memset(dst, 0, rtcore_elf_size(elf));
+
+	hdr->magic = JRT_IMAGE_MAGIC;
+	hdr->va = elf->pie ? va : elf->min_va;
+	hdr->entry = elf->eh.e_entry - elf->min_va;
+	hdr->size = elf->span;
+
+	for (i = 0; i < elf->eh.e_phnum; ++i) {
+		ph = &elf->ph[i];
+		if (ph->p_type != PT_LOAD)
+			continue;
+
+		res = read_exact(src, base + (ph->p_vaddr - elf->min_va),
+			ph->p_filesz, ph->p_offset);
+		if (res)
+			return res;
+
+		seg = &hdr->seg[hdr->nseg++];
+		seg->off = ph->p_vaddr - elf->min_va;
+		seg->filesz = ph->p_filesz;
+		seg->memsz = ph->p_memsz;
+		seg->flags = ph->p_flags & (JRT_SEG_R | JRT_SEG_W | JRT_SEG_X);
+	}
+
+	if (elf->pie)
+		return rtcore_elf_relocate(elf, base, hdr->va);
+	return 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_ELF_H_
+#define _RTCORE_ELF_H_
+
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/elf.h>
+
+#include "jrt_image.h"
+
+#define RTCORE_ELF_PHDR_MAX	16
+
+typedef struct rtcore_elf {
+	Elf64_Ehdr eh;
+	Elf64_Phdr ph[RTCORE_ELF_PHDR_MAX];
+	u64 min_va;	/* lowest PT_LOAD address */
+	u64 span;	/* bytes from min_va to the end of the last PT_LOAD */
+	bool pie;	/* ET_DYN, relocated at load */
+} rtcore_elf_t;
+
+/* 1: aarch64 ELF64 image, 0: not an ELF file (flat binary), < 0: bad ELF */
+int rtcore_elf_probe(struct file *src, loff_t size, rtcore_elf_t *elf);
+
+/* bytes rtcore_elf_load writes, including the jrt_image_hdr_t page */
+static inline size_t rtcore_elf_size(const rtcore_elf_t *elf)
+{
+	return JRT_IMAGE_HDR_SIZE + elf->span;
+}
+
+/*
+ * Write the header and segments to dst, zero the gaps and .bss and apply
+ * RELA relocations so a PIE image runs at va.
+ */
+int rtcore_elf_load(struct file *src, const rtcore_elf_t *elf, void *dst, u64 va);
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/uaccess.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/spinlock.h>
+#include <linux/interrupt.h>
+#include <linux/irqdomain.h>
+#include <linux/of.h>
+#include <linux/eventfd.h>
+#include <linux/version.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "event.h"
+
+static uint evt_spi = XEVT_LINUX_SPI;
+module_param(evt_spi, uint, 0444);
+MODULE_PARM_DESC(evt_spi, "SPI JRT raises to signal events to Linux");
+
+static struct xevt_page *xevt;
+static unsigned int evt_irq;
+
+/* bindings, also taken from the irq handler */
+static DEFINE_SPINLOCK(evt_lock);
+static struct eventfd_ctx *evt_efd[XEVT_MAX];
+static void *evt_owner[XEVT_MAX];
+
+static void rtcore_evt_notify(struct eventfd_ctx *efd)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	eventfd_signal(efd);
+#else
+	eventfd_signal(efd, 1);
+#endif
+}
+
+static irqreturn_t rtcore_evt_irq(int irq, void *dev)
+{
+	unsigned long bits;
+	unsigned int id;
+
+	bits = atomic64_xchg((atomic64_t *)&xevt->to_linux, 0);
+	if (!bits)
+		return IRQ_NONE;
+	if (bits & XEVT_LINUX_DONE)
+		rtcore_done_kick();
+
+	spin_lock(&evt_lock);
+	for_each_set_bit(id, &bits, XEVT_MAX) {
+		if (evt_efd[id])
+			rtcore_evt_notify(evt_efd[id]);
+	}
+	spin_unlock(&evt_lock);
+	return IRQ_HANDLED;
+}
+
+/* the SPI has no device tree node of its own, map it on the GIC's domain */
+static unsigned int rtcore_evt_map_irq(void)
+{
+	struct irq_fwspec fwspec;
+	struct device_node *gic;
+	unsigned int virq;
+
+	gic = of_find_compatible_node(NULL, NULL, "arm,gic-v3");
+	if (!gic)
+		return 0;
+
+	fwspec.fwnode = of_fwnode_handle(gic);
+	fwspec.param_count = 3;
+	fwspec.param[0] = 0;			/* GIC_SPI */
+	fwspec.param[1] = evt_spi - 32;
+	fwspec.param[2] = IRQ_TYPE_EDGE_RISING;
+	virq = irq_create_fwspec_mapping(&fwspec);
+	of_node_put(gic);
+	return virq;
+}
+
+int rtcore_evt_init(void)
+{
+	int res;
+
+	xevt = memremap(XEVT_PAGE_ADDR, XEVT_PAGE_SIZE, MEMREMAP_WB);
+	if (!xevt) {
+		pr_err("rtcore: failed to map XEVT_PAGE memory\n");
+		return -ENOMEM;
+	}
+
+	evt_irq = rtcore_evt_map_irq();
+	if (!evt_irq) {
+		pr_err("rtcore: no irq mapping for SPI %u\n", evt_spi);
+		memunmap(xevt);
+		return -ENODEV;
+	}
+
+	res = request_irq(evt_irq, rtcore_evt_irq, 0, "rtcore-evt", NULL);
+	if (res) {
+		pr_err("rtcore: request_irq %u failed: %d\n", evt_irq, res);
+		irq_dispose_mapping(evt_irq);
+		memunmap(xevt);
+		return res;
+	}
+	pr_info("rtcore: events on SPI %u (irq %u)\n", evt_spi, evt_irq);
+	return 0;
+}
+
+void rtcore_evt_exit(void)
+{
+	unsigned int id;
+
+	free_irq(evt_irq, NULL);
+	irq_dispose_mapping(evt_irq);
+	for (id = 0; id < XEVT_MAX; ++id) {
+		if (evt_efd[id])
+			eventfd_ctx_put(evt_efd[id]);
+		evt_efd[id] = NULL;
+		evt_owner[id] = NULL;
+	}
+	memunmap(xevt);
+}
+
+long rtcore_evt_signal(unsigned long arg)
+{
+	u64 bits;
+
+	if (copy_from_user(&bits, (void __user *)arg, sizeof(bits)))
+		return -EFAULT;
+	if (!bits || (bits >> XEVT_MAX))
+		return -EINVAL;
+
+	atomic64_or(bits, (atomic64_t *)&xevt->to_jrt);
+	rtcore_doorbell(XEVT_SPI);
+	return 0;
+}
+
+long rtcore_evt_bind(void *owner, unsigned long arg)
+{
+	evt_bind_args_t args;
+	struct eventfd_ctx *efd, *old;
+	unsigned long flags;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+	if (args.id >= XEVT_MAX)
+		return -EINVAL;
+
+	efd = NULL;
+	if (args.efd >= 0) {
+		efd = eventfd_ctx_fdget(args.efd);
+		if (IS_ERR(efd))
+			return PTR_ERR(efd);
+	}
+
+	spin_lock_irqsave(&evt_lock, flags);
+	if (evt_owner[args.id] && evt_owner[args.id] != owner) {
+		spin_unlock_irqrestore(&evt_lock, flags);
+		if (efd)
+			eventfd_ctx_put(efd);
+		return -EBUSY;
+	}
+	old = evt_efd[args.id];
+	evt_efd[args.id] = efd;
+	evt_owner[args.id] = efd ? owner : NULL;
+	spin_unlock_irqrestore(&evt_lock, flags);
+
+	if (old)
+		eventfd_ctx_put(old);
+	return 0;
+}
+
+void rtcore_evt_release(void *owner)
+{
+	struct eventfd_ctx *old[XEVT_MAX];
+	unsigned long flags;
+	unsigned int id, n;
+
+	n = 0;
+	spin_lock_irqsave(&evt_lock, flags);
+	for (id = 0; id < XEVT_MAX; ++id) {
+		if (evt_owner[id] != owner)
+			continue;
+		old[n++] = evt_efd[id];
+		evt_efd[id] = NULL;
+		evt_owner[id] = NULL;
+	}
+	spin_unlock_irqrestore(&evt_lock, flags);
+
+	while (n)
+		eventfd_ctx_put(old[--n]);
+}
@@ -0,0 +1,30 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_EVENT_H_
+#define _RTCORE_EVENT_H_
+
+#include <linux/types.h>
+
+/*
+ * Cross-domain events (shared/xevt.h). Linux->JRT events are set in the
+ * shared page and ring XEVT_SPI. JRT->Linux events arrive on evt_spi and
+ * are passed on to the eventfd bound to each event, so Linux waits on
+ * them with poll/epoll like on any other fd.
+ */
+
+int rtcore_evt_init(void);
+void rtcore_evt_exit(void);
+
+long rtcore_evt_signal(unsigned long arg);
+/* owner: the binding fd's context, bindings go away with it */
+long rtcore_evt_bind(void *owner, unsigned long arg);
+void rtcore_evt_release(void *owner);
+
+/* rtmain.c: set spi pending on the distributor */
+void rtcore_doorbell(u32 spi);
+/* rtmain.c: JRT pushed completion records, from the irq handler */
+void rtcore_done_kick(void);
+
+#endif
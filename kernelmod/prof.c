@@ -0,0 +1,77 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <asm/arch_timer.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "event.h"
+#include "prof.h"
+
+#define PROF_HZ_DEFAULT		1000
+#define PROF_HZ_MAX		100000
+#define PROF_CYCLES_MIN		10000	/* below that the RT core does nothing else */
+
+static DEFINE_MUTEX(prof_lock);
+static struct jrt_prof_area *prof_area;
+
+int rtcore_prof_init(void)
+{
+	prof_area = memremap(PROF_AREA_ADDR, PROF_AREA_SIZE, MEMREMAP_WB);
+	if (!prof_area) {
+		pr_err("rtcore: failed to map PROF_AREA memory\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void rtcore_prof_exit(void)
+{
+	memunmap(prof_area);
+}
+
+long rtcore_prof_ctl(unsigned long arg)
+{
+	prof_args_t args;
+	u32 hz;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+	if (args.source > JRT_PROF_PMU || args.hz > PROF_HZ_MAX)
+		return -EINVAL;
+	if (args.source == JRT_PROF_PMU && args.cycles < PROF_CYCLES_MIN)
+		return -EINVAL;
+	if (smp_load_acquire(&prof_area->magic) != JRT_PROF_MAGIC)
+		return -ENODEV;
+
+	hz = args.hz ? args.hz : PROF_HZ_DEFAULT;
+	mutex_lock(&prof_lock);
+	WRITE_ONCE(prof_area->source, args.source);
+	WRITE_ONCE(prof_area->cycles, args.cycles);
+	WRITE_ONCE(prof_area->ticks, arch_timer_get_cntfrq() / hz);
+	/* JRT reads the request after it sees the new count */
+	smp_store_release(&prof_area->ctl_seq, prof_area->ctl_seq + 1);
+	rtcore_doorbell(PROF_SPI);
+	mutex_unlock(&prof_lock);
+	return 0;
+}
+
+/* read-write: the reader owns tail */
+int rtcore_prof_mmap(struct vm_area_struct *vma)
+{
+	unsigned long size;
+
+	size = vma->vm_end - vma->vm_start;
+	if ((vma->vm_pgoff << PAGE_SHIFT) != RTCORE_PROF_MMAP_OFF ||
+		size > PAGE_ALIGN(PROF_AREA_SIZE))
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start, PROF_AREA_ADDR >> PAGE_SHIFT,
+		size, vma->vm_page_prot);
+}
@@ -0,0 +1,22 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_PROF_H_
+#define _RTCORE_PROF_H_
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+/*
+ * Control side of the RT core profiler (shared/prof.h). The module only
+ * passes requests on, user space drains the sample ring itself.
+ */
+
+int rtcore_prof_init(void);
+void rtcore_prof_exit(void);
+
+long rtcore_prof_ctl(unsigned long arg);
+int rtcore_prof_mmap(struct vm_area_struct *vma);
+
+#endif
@@ -8,6 +8,7 @@
 #include <linux/types.h>
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/file.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
 #include <linux/cdev.h>
@@ -18,14 +19,40 @@
 #include <linux/platform_device.h>
 #include <asm/cacheflush.h>
 #include <asm/sysreg.h>      /* for CTR_EL0 */
+#include <asm/arch_timer.h>  /* JRT timestamps are CNTPCT */
 #include <linux/types.h>
 #include <linux/atomic.h>
 #include <linux/mutex.h>
+#include <linux/genalloc.h>
+#include <linux/crc32.h>
+#include <linux/crc32c.h>
+#include <linux/hashtable.h>
+#include <linux/idr.h>
+#include <linux/xarray.h>
+#include <linux/kfifo.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/version.h>
+#include <crypto/sha2.h>
 
 #include "rtcore.h"
 #include "memory_layout.h"
 
 #include "psci.h"
+#include "elf.h"
+#include "event.h"
+#include "bufpool.h"
+#include "chan.h"
+#include "stats.h"
+#include "clock.h"
+#include "submit.h"
+#include "prof.h"
+
+#define RTCORE_IMG_MAX	256	/* cached images (handles are 1..max-1) */
+#define RTCORE_DONE_MAX	256	/* completions buffered per fd */
 
 typedef struct rtcore_ctx {
 	unsigned long user_base;	/* VMA start we mapped for this fd */
@@ -33,8 +60,37 @@ typedef struct rtcore_ctx {
 	phys_addr_t phys_base;		/* page-aligned physical base */
 	unsigned long first_off;	/* phys_start_unaligned & (PAGE_SIZE-1) */
 	bool mapped;
+	/* last RTCORE_IOCTL_LOAD_FD, already synced for instruction fetch */
+	phys_addr_t synced_phys;
+	size_t synced_len;
+	u16 img_refs[RTCORE_IMG_MAX];	/* image handles held by this fd */
+	DECLARE_KFIFO(done, jrt_done_rec_t, RTCORE_DONE_MAX);
 } rtcore_ctx_t;
 
+/* an image in the cache region at the top of the code window */
+typedef struct rtcore_img {
+	struct hlist_node node;		/* img_hash, keyed by crc */
+	struct list_head lru;		/* img_lru, most recently used last */
+	u32 id;
+	u32 gen;			/* img_gen when loaded, ids are reused */
+	u32 crc;
+	u32 crc2;			/* crc32c, second half of the key */
+	u32 flags;			/* JRT_REQ_ELF */
+	u8 sha[SHA256_DIGEST_SIZE];	/* of the file */
+	size_t file_size;
+	size_t size;			/* bytes used in the cache region */
+	phys_addr_t phys;
+	u32 refs;			/* handles held by open files */
+	u32 running;			/* submitted jobs not yet completed */
+} rtcore_img_t;
+
+/* a submitted job until its completion record comes back */
+typedef struct rtcore_job {
+	rtcore_ctx_t *owner;		/* NULL once the fd is closed */
+	rtcore_img_t *img;		/* NULL for uncached images */
+	u32 buf;			/* lent job buffer, 0: none */
+} rtcore_job_t;
+
 #define GICD_BASE_DEFAULT   0x08000000ULL   // QEMU virt
 #define GICD_ISPENDR(n)    (0x0200 + 4*(n))
 
@@ -43,13 +99,36 @@ static uint spi = SCHED_SPI;
 static void __iomem *gicd;
 static DEFINE_MUTEX(sched_lock);
 
+static ulong img_cache_size = JRT_IMG_CACHE_SIZE;
+module_param(img_cache_size, ulong, 0444);
+MODULE_PARM_DESC(img_cache_size, "bytes at the top of the code window kept for the image cache");
+
+/* protects the image cache, the job table and the completion ring */
+static DEFINE_MUTEX(img_lock);
+static struct gen_pool *img_pool;
+static DEFINE_HASHTABLE(img_hash, 6);
+static LIST_HEAD(img_lru);
+static DEFINE_IDR(img_idr);
+static DEFINE_XARRAY(job_xa);
+static u32 img_gen;
+static atomic64_t job_seq;
+
+/* completions reaped as JRT pushes them, readers wait here */
+static DECLARE_WAIT_QUEUE_HEAD(done_wq);
+static void rtcore_done_work_fn(struct work_struct *work);
+static DECLARE_WORK(done_work, rtcore_done_work_fn);
+
 static int rtcore_open(struct inode *ino, struct file *filp);
 static int rtcore_release(struct inode *ino, struct file *filp);
 static long rtcore_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 static int rtcore_mmap(struct file *filp, struct vm_area_struct *vma);
+static ssize_t rtcore_read(struct file *filp, char __user *buf, size_t len, loff_t *off);
+static __poll_t rtcore_poll(struct file *filp, poll_table *wait);
 
 static const struct file_operations rtcore_fops = {
 	.owner          = THIS_MODULE,
+	.read           = rtcore_read,
+	.poll           = rtcore_poll,
 	.unlocked_ioctl = rtcore_ioctl,
 	.mmap           = rtcore_mmap,
 	.open           = rtcore_open,
@@ -61,12 +140,20 @@ static struct class *rtcore_class;
 static struct cdev rtcore_cdev;
 
 static struct mpsc_ring __iomem *tojrt_ring;
+static struct spsc_ring __iomem *fromjrt_ring;
 
 
 static size_t G_MEM_OFF = 0;
 
 static void __iomem *jrt_mem_virt;
 
+static inline void *code_virt(phys_addr_t phys)
+{
+	return (void *)((uintptr_t)jrt_mem_virt + (phys - JRT_CODE_PHYS));
+}
+
+static void rtcore_img_put_locked(rtcore_ctx_t *ctx, rtcore_img_t *img);
+
 static int rtcore_open(struct inode *ino, struct file *filp)
 {
 	rtcore_ctx_t *ctx;
@@ -74,13 +161,40 @@ static int rtcore_open(struct inode *ino, struct file *filp)
 	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
 	if (!ctx)
 		return -ENOMEM;
+	INIT_KFIFO(ctx->done);
 	filp->private_data = ctx;
 
 	return 0;
 }
 
 static int rtcore_release(struct inode *ino, struct file *filp)
-{	kfree(filp->private_data);
+{
+	rtcore_ctx_t *ctx;
+	rtcore_img_t *img;
+	rtcore_job_t *job;
+	unsigned long idx;
+	u32 id;
+
+	ctx = filp->private_data;
+
+	mutex_lock(&img_lock);
+	/* jobs still running on JRT outlive the fd, drop their completions */
+	xa_for_each(&job_xa, idx, job) {
+		if (job->owner == ctx)
+			job->owner = NULL;
+	}
+	for (id = 0; id < RTCORE_IMG_MAX; ++id) {
+		if (!ctx->img_refs[id])
+			continue;
+		img = idr_find(&img_idr, id);
+		while (img && ctx->img_refs[id])
+			rtcore_img_put_locked(ctx, img);
+	}
+	mutex_unlock(&img_lock);
+
+	rtcore_buf_release(ctx);
+	rtcore_evt_release(ctx);
+	kfree(ctx);
 	return 0;
 }
 
@@ -239,6 +353,7 @@ static int mpsc_push(struct mpsc_ring *r,
 
 	/* write payload first */
 	memcpy(&r->data[idx], rec, sizeof(*rec));
+	r->data[idx].t_stage[JRT_STAGE_SLOT] = __arch_counter_get_cntpct();
 
 	/* publish: set flag with release so consumer sees data */
 	smp_store_release(&r->flags[idx], 1);
@@ -249,17 +364,98 @@ static int mpsc_push(struct mpsc_ring *r,
 static inline u32 reg_index32(u32 id) { return id / 32; }
 static inline u32 bit_index32(u32 id) { return id % 32; }
 
-static long rtcore_sched_prog(struct file *file, unsigned long arg)
+/* writel orders the ring/page stores before the SPI goes pending */
+void rtcore_doorbell(u32 spi)
 {
-	rtcore_ctx_t *ctx;
-	sched_prog_args_t args;
-	phys_addr_t entry_phys;
-	jrt_sched_req_t req;;
+	writel(1u << bit_index32(spi), gicd + GICD_ISPENDR(reg_index32(spi)));
+}
 
-	ctx = file->private_data;
+/*
+ * Consume completion records from JRT: release the image of each finished
+ * job and hand the record to the fd that submitted it.
+ */
+static void rtcore_reap_locked(void)
+{
+	jrt_done_rec_t rec;
+	rtcore_job_t *job;
+	u32 head, tail;
+	bool woke;
+
+	tail = fromjrt_ring->tail;
+	head = smp_load_acquire(&fromjrt_ring->head);
+
+	woke = false;
+	for (; tail != head; ++tail) {
+		memcpy(&rec, &fromjrt_ring->data[tail & FROMJRT_MASK], sizeof(rec));
+
+		job = xa_erase(&job_xa, rec.job_id);
+		if (!job)
+			continue;
+		if (job->img)
+			job->img->running--;
+		rec.buf = job->buf;
+		if (job->buf)
+			rtcore_buf_return(job->buf);
+		rtcore_submit_account(&rec);
+		if (rec.flags & JRT_DONE_KILLED)
+			pr_warn_ratelimited("rtcore: job %llu killed at its deadline\n", rec.job_id);
+		if (rec.flags & JRT_DONE_REJECTED)
+			pr_warn_ratelimited("rtcore: job %llu rejected by JRT (%d)\n",
+				rec.job_id, rec.status);
+		if (job->owner && !kfifo_put(&job->owner->done, rec))
+			pr_warn_ratelimited("rtcore: completion of job %llu dropped\n", rec.job_id);
+		woke |= job->owner != NULL;
+		kfree(job);
+	}
 
-	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
-		return -EFAULT;
+	smp_store_release(&fromjrt_ring->tail, tail);
+	if (woke)
+		wake_up_interruptible(&done_wq);
+}
+
+/* img_lock sleeps, the irq handler leaves the reaping to a work item */
+void rtcore_done_kick(void)
+{
+	schedule_work(&done_work);
+}
+
+static void rtcore_done_work_fn(struct work_struct *work)
+{
+	mutex_lock(&img_lock);
+	rtcore_reap_locked();
+	mutex_unlock(&img_lock);
+}
+
+static int rtcore_job_add(rtcore_ctx_t *ctx, u64 job_id, rtcore_img_t *img,
+	u32 buf)
+{
+	rtcore_job_t *job;
+	int res;
+
+	job = kmalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+	job->owner = ctx;
+	job->img = img;
+	job->buf = buf;
+
+	res = xa_err(xa_store(&job_xa, job_id, job, GFP_KERNEL));
+	if (res) {
+		kfree(job);
+		return res;
+	}
+	if (img) {
+		img->running++;
+		list_move_tail(&img->lru, &img_lru);
+	}
+	return 0;
+}
+
+/* translate a user address inside this fd's mapping to the code window */
+static int rtcore_user_entry(rtcore_ctx_t *ctx, sched_prog_args_t *args,
+	phys_addr_t *entry_phys)
+{
+	u64 max_size;
 
 	if (!ctx || !ctx->mapped) {
 		pr_err("rtcore: no mmap registered on this fd\n");
@@ -268,53 +464,561 @@ static long rtcore_sched_prog(struct file *file, unsigned long arg)
 
 	/* Bounds check: entry_user must lie inside the VMA we created */
 	if (
-		args.entry_user < ctx->user_base ||
-		args.entry_user >= ctx->user_base + ctx->user_len) {
+		args->entry_user < ctx->user_base ||
+		args->entry_user >= ctx->user_base + ctx->user_len) {
 		pr_err(
 			"rtcore: entry_user 0x%llx not "
 			"within mapping [0x%lx..0x%lx)\n",
-			args.entry_user,
+			args->entry_user,
 			ctx->user_base,
 			ctx->user_base + ctx->user_len);
 		return -EFAULT;
 	}
 
 	/* VA -> PA: phys_base + first_off + (delta from user_base) */
-	entry_phys = ctx->phys_base +
-		(phys_addr_t)(args.entry_user - ctx->user_base);
+	*entry_phys = ctx->phys_base +
+		(phys_addr_t)(args->entry_user - ctx->user_base);
 
 	/* Optional: enforce 4-byte alignment */
-	if (entry_phys & 0x3) {
-		pr_err("rtcore: entry phys 0x%pa not 4-byte aligned\n", &entry_phys);
+	if (*entry_phys & 0x3) {
+		pr_err("rtcore: entry phys 0x%pa not 4-byte aligned\n", entry_phys);
 		return -EINVAL;
 	}
 
 	/* Optional: clamp to reserved window */
-	if (	entry_phys < JRT_CODE_PHYS ||
-		entry_phys >= JRT_CODE_PHYS + JRT_CODE_SIZE) {
-		pr_err("rtcore: entry phys 0x%pa outside JRT region\n", &entry_phys);
+	if (	*entry_phys < JRT_CODE_PHYS ||
+		*entry_phys >= JRT_CODE_PHYS + JRT_CODE_SIZE) {
+		pr_err("rtcore: entry phys 0x%pa outside JRT region\n", entry_phys);
 		return -EINVAL;
 	}
 
-	//pr_info("rtcore: starting CPU %llu at phys 0x%pa (VA 0x%llx)\n",
-	//	args.core_id, &entry_phys, args.entry_user);
+	/* default (and upper bound) is the rest of the mapping */
+	max_size = ctx->user_len - (args->entry_user - ctx->user_base);
+	if (!args->prog_size || args->prog_size > max_size)
+		args->prog_size = max_size;
 
-	//char msg[16];
-	req.pc = entry_phys;
+	return 0;
+}
+
+static long rtcore_sched_prog(struct file *file, unsigned long arg)
+{
+	rtcore_ctx_t *ctx;
+	sched_prog_args_t args;
+	phys_addr_t entry_phys;
+	jrt_sched_req_t req;
+	rtcore_img_t *img;
+	phys_addr_t buf_phys;
+	u32 buf_size;
+	u64 t_ioctl;
+	int res;
+
+	ctx = file->private_data;
+
+	t_ioctl = __arch_counter_get_cntpct();
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+
+	memset(&req, 0, sizeof(req));
+	req.t_stage[JRT_STAGE_IOCTL] = t_ioctl;
 	req.mem_req = args.mem_req;
-	req.prog_size = ctx->user_len - (args.entry_user - ctx->user_base);
+	req.deadline_us = args.deadline_us;
+	req.job_id = atomic64_inc_return(&job_seq);
+
+	mutex_lock(&img_lock);
+	rtcore_reap_locked();
+	if (args.handle) {
+		/* cached image: already in sync, the lookup is the whole cost */
+		img = args.handle < RTCORE_IMG_MAX && ctx->img_refs[args.handle] ?
+			idr_find(&img_idr, args.handle) : NULL;
+		if (!img) {
+			mutex_unlock(&img_lock);
+			return -ENOENT;
+		}
+		req.pc = img->phys;
+		req.prog_size = img->size;
+		req.flags = JRT_REQ_CACHED | img->flags;
+		req.img_id = img->id;
+		req.img_gen = img->gen;
+	} else {
+		img = NULL;
+		res = rtcore_user_entry(ctx, &args, &entry_phys);
+		if (res) {
+			mutex_unlock(&img_lock);
+			return res;
+		}
+		req.pc = entry_phys;
+		req.prog_size = args.prog_size;
+	}
+	/* the pool is mapped in every JRT process, the address is all it takes */
+	if (args.buf) {
+		res = rtcore_buf_lend(ctx, args.buf, &buf_phys, &buf_size);
+		if (res) {
+			mutex_unlock(&img_lock);
+			return res;
+		}
+		req.buf = buf_phys;
+		req.buf_size = buf_size;
+	}
+	req.flags |= JRT_REQ_MISS(RTCORE_SCHED_MISS_POLICY(args.flags));
+	if (args.flags & RTCORE_SCHED_WCET)
+		req.flags |= JRT_REQ_WCET |
+			(args.flags & RTCORE_SCHED_COLD ? JRT_REQ_COLD : 0);
+	if (args.deadline_ticks) {
+		req.deadline_abs = args.deadline_ticks;
+		req.flags |= JRT_REQ_DL_ABS;
+	}
+	res = rtcore_job_add(ctx, req.job_id, img, args.buf);
+	mutex_unlock(&img_lock);
+	if (res) {
+		if (args.buf)
+			rtcore_buf_return(args.buf);
+		return res;
+	}
+	req.t_stage[JRT_STAGE_COPY] = __arch_counter_get_cntpct();
+
+	//char msg[16];
 	//snprintf(msg, sizeof(msg), "ep:%llx", entry_phys);
 	pr_info("rtcore: shed beg\n");
-	rtcore_icache_sync_phys_range(
-		entry_phys,
-		ctx->user_len - (args.entry_user - ctx->user_base));
+	if (!img && !(req.prog_size && req.pc >= ctx->synced_phys &&
+			req.pc + req.prog_size <=
+			ctx->synced_phys + ctx->synced_len))
+		rtcore_icache_sync_phys_range(req.pc, req.prog_size);
+	req.t_stage[JRT_STAGE_SYNC] = __arch_counter_get_cntpct();
 
 	mutex_lock(&sched_lock);
-	int res = mpsc_push(tojrt_ring, &req, 0);
-	writel_relaxed(1u << bit_index32(spi), gicd + GICD_ISPENDR(reg_index32(spi)));
-	wmb();
+	req.t_doorbell = __arch_counter_get_cntpct();
+	req.t_stage[JRT_STAGE_LOCK] = req.t_doorbell;
+	res = mpsc_push(tojrt_ring, &req, 0);
+	rtcore_doorbell(spi);
 	mutex_unlock(&sched_lock);
 	pr_info("rtcore: shed_sent %i\n", res);
+
+	args.job_id = req.job_id;
+	if (copy_to_user((void __user *)arg, &args, sizeof(args)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Read an image straight from the page cache into the code window,
+ * then make exactly the written bytes visible to instruction fetch.
+ */
+static long rtcore_load_fd(struct file *file, unsigned long arg)
+{
+	rtcore_ctx_t *ctx;
+	load_fd_args_t args;
+	struct file *src;
+	phys_addr_t slot_phys;
+	loff_t pos, size;
+	size_t room;
+	ssize_t n;
+
+	ctx = file->private_data;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+
+	if (!ctx || !ctx->mapped) {
+		pr_err("rtcore: no mmap registered on this fd\n");
+		return -EINVAL;
+	}
+
+	if (
+		args.slot_user < ctx->user_base ||
+		args.slot_user >= ctx->user_base + ctx->user_len) {
+		pr_err(
+			"rtcore: slot_user 0x%llx not "
+			"within mapping [0x%lx..0x%lx)\n",
+			args.slot_user,
+			ctx->user_base,
+			ctx->user_base + ctx->user_len);
+		return -EFAULT;
+	}
+
+	slot_phys = ctx->phys_base +
+		(phys_addr_t)(args.slot_user - ctx->user_base);
+	room = ctx->user_base + ctx->user_len - args.slot_user;
+
+	src = fget(args.fd);
+	if (!src)
+		return -EBADF;
+
+	size = i_size_read(file_inode(src));
+	if (size <= 0 || size > room) {
+		pr_err("rtcore: image of %lld bytes does not fit slot (%zu)\n",
+			size, room);
+		fput(src);
+		return -ENOSPC;
+	}
+
+	pos = 0;
+	n = kernel_read(
+		src,
+		(void *)((uintptr_t)jrt_mem_virt + (slot_phys - JRT_CODE_PHYS)),
+		size,
+		&pos);
+	fput(src);
+
+	if (n < 0)
+		return n;
+	if (n != size)
+		return -EIO;
+
+	rtcore_icache_sync_phys_range(slot_phys, n);
+	/* jobs started from inside it skip their sync in rtcore_sched_prog */
+	ctx->synced_phys = slot_phys;
+	ctx->synced_len = n;
+
+	args.size = n;
+	if (copy_to_user((void __user *)arg, &args, sizeof(args)))
+		return -EFAULT;
+	return 0;
+}
+
+static void rtcore_img_evict(rtcore_img_t *img)
+{
+	pr_info("rtcore: evict image %u (%zu bytes at 0x%pa)\n",
+		img->id, img->size, &img->phys);
+
+	hash_del(&img->node);
+	list_del(&img->lru);
+	idr_remove(&img_idr, img->id);
+	gen_pool_free(img_pool, img->phys, img->size);
+	kfree(img);
+}
+
+/* allocate from the cache region, evicting idle images oldest first */
+static phys_addr_t rtcore_img_alloc(size_t size)
+{
+	rtcore_img_t *img, *victim;
+	phys_addr_t phys;
+
+	for (;;) {
+		phys = gen_pool_alloc(img_pool, size);
+		if (phys)
+			return phys;
+
+		victim = NULL;
+		list_for_each_entry(img, &img_lru, lru) {
+			if (!img->refs && !img->running) {
+				victim = img;
+				break;
+			}
+		}
+		if (!victim)
+			return 0;
+		rtcore_img_evict(victim);
+	}
+}
+
+static void rtcore_img_put_locked(rtcore_ctx_t *ctx, rtcore_img_t *img)
+{
+	/* unreferenced images stay cached until their space is needed */
+	ctx->img_refs[img->id]--;
+	img->refs--;
+}
+
+/*
+ * crc32_le and crc32c both run on the ARMv8 CRC32 instructions when the
+ * CPU has them, together they form a 64 bit key.
+ */
+static int rtcore_img_hash(struct file *src, loff_t size, void *buf, u32 crc[2])
+{
+	loff_t pos;
+	ssize_t n;
+	u32 c, c2;
+
+	c = ~0u;
+	c2 = ~0u;
+	pos = 0;
+	while (pos < size) {
+		n = kernel_read(src, buf, min_t(loff_t, PAGE_SIZE, size - pos), &pos);
+		if (n <= 0)
+			return n < 0 ? n : -EIO;
+		c = crc32_le(c, buf, n);
+		c2 = crc32c(c2, buf, n);
+	}
+	crc[0] = ~c;
+	crc[1] = ~c2;
+	return 0;
+}
+
+/*
+ * A loaded ELF image no longer matches its file, the file's SHA-256 is
+ * kept instead and stands in for the byte compare.
+ */
+static int rtcore_img_sha(struct file *src, loff_t size, void *buf,
+	u8 sha[SHA256_DIGEST_SIZE])
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0)
+	struct sha256_ctx st;
+#else
+	struct sha256_state st;
+#endif
+	loff_t pos;
+	ssize_t n;
+
+	sha256_init(&st);
+	pos = 0;
+	while (pos < size) {
+		n = kernel_read(src, buf, min_t(loff_t, PAGE_SIZE, size - pos), &pos);
+		if (n <= 0)
+			return n < 0 ? n : -EIO;
+		sha256_update(&st, buf, n);
+	}
+	sha256_final(&st, sha);
+	return 0;
+}
+
+/* a key match is only a candidate, compare the bytes before sharing */
+static bool rtcore_img_same(struct file *src, rtcore_img_t *img, void *buf)
+{
+	u8 sha[SHA256_DIGEST_SIZE];
+
+	return !rtcore_img_sha(src, img->file_size, buf, sha) &&
+		!memcmp(sha, img->sha, sizeof(sha));
+}
+
+static rtcore_img_t *rtcore_img_lookup(struct file *src, size_t size,
+	const u32 crc[2], void *buf)
+{
+	rtcore_img_t *img;
+
+	hash_for_each_possible(img_hash, img, node, crc[0]) {
+		if (img->crc == crc[0] && img->crc2 == crc[1] &&
+			img->file_size == size &&
+			rtcore_img_same(src, img, buf))
+			return img;
+	}
+	return NULL;
+}
+
+/* PIE images run at their offset in the code window */
+static int rtcore_img_place(struct file *src, const rtcore_elf_t *elf,
+	phys_addr_t phys)
+{
+	return rtcore_elf_load(src, elf, code_virt(phys),
+		phys + JRT_IMAGE_HDR_SIZE - JRT_CODE_PHYS);
+}
+
+static rtcore_img_t *rtcore_img_insert(struct file *src, size_t size,
+	const u32 crc[2], void *buf)
+{
+	rtcore_img_t *img;
+	rtcore_elf_t *elf;
+	phys_addr_t phys;
+	size_t len;
+	int id, res;
+
+	img = kzalloc(sizeof(*img), GFP_KERNEL);
+	elf = kmalloc(sizeof(*elf), GFP_KERNEL);
+	if (!img || !elf) {
+		res = -ENOMEM;
+		goto err;
+	}
+
+	/* instances share the cached pages read-only, a flat image has no
+	 * writable segment to give each of them */
+	res = rtcore_elf_probe(src, size, elf);
+	if (res < 0)
+		goto err;
+	if (!res) {
+		pr_err("rtcore: only ELF images can be cached\n");
+		res = -ENOEXEC;
+		goto err;
+	}
+	res = rtcore_img_sha(src, size, buf, img->sha);
+	if (res)
+		goto err;
+	len = rtcore_elf_size(elf);
+
+	phys = rtcore_img_alloc(len);
+	if (!phys) {
+		res = -ENOSPC;
+		goto err;
+	}
+
+	res = rtcore_img_place(src, elf, phys);
+	if (res)
+		goto err_free;
+
+	id = idr_alloc(&img_idr, img, 1, RTCORE_IMG_MAX, GFP_KERNEL);
+	if (id < 0) {
+		res = id;
+		goto err_free;
+	}
+
+	rtcore_icache_sync_phys_range(phys, len);
+
+	img->id = id;
+	img->gen = ++img_gen;
+	img->crc = crc[0];
+	img->crc2 = crc[1];
+	img->flags = JRT_REQ_ELF;
+	img->file_size = size;
+	img->size = len;
+	img->phys = phys;
+	hash_add(img_hash, &img->node, crc[0]);
+	list_add_tail(&img->lru, &img_lru);
+
+	pr_info("rtcore: cached image %u (%zu bytes, crc %08x) at 0x%pa\n",
+		id, len, crc[0], &phys);
+	kfree(elf);
+	return img;
+
+err_free:
+	gen_pool_free(img_pool, phys, len);
+err:
+	kfree(elf);
+	kfree(img);
+	return ERR_PTR(res);
+}
+
+/*
+ * Look an image up by content, loading it into the cache on a miss.
+ * A hit costs two reads from the page cache and no code window space.
+ * ELF images are loaded and relocated once, on the miss.
+ */
+static long rtcore_img_load(struct file *file, unsigned long arg)
+{
+	rtcore_ctx_t *ctx;
+	img_load_args_t args;
+	rtcore_img_t *img;
+	struct file *src;
+	loff_t size;
+	void *buf;
+	u32 crc[2];
+	int res;
+
+	ctx = file->private_data;
+
+	if (copy_from_user(&args, (void __user *)arg, sizeof(args)))
+		return -EFAULT;
+
+	src = fget(args.fd);
+	if (!src)
+		return -EBADF;
+
+	size = i_size_read(file_inode(src));
+	if (size <= 0 || size > img_cache_size) {
+		fput(src);
+		return size <= 0 ? -EINVAL : -EFBIG;
+	}
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf) {
+		fput(src);
+		return -ENOMEM;
+	}
+
+	res = rtcore_img_hash(src, size, buf, crc);
+	if (res)
+		goto out;
+
+	mutex_lock(&img_lock);
+	rtcore_reap_locked();
+	img = rtcore_img_lookup(src, size, crc, buf);
+	if (!img)
+		img = rtcore_img_insert(src, size, crc, buf);
+	if (IS_ERR(img)) {
+		res = PTR_ERR(img);
+		mutex_unlock(&img_lock);
+		goto out;
+	}
+	if (ctx->img_refs[img->id] == U16_MAX) {
+		res = -EMFILE;
+		mutex_unlock(&img_lock);
+		goto out;
+	}
+	img->refs++;
+	ctx->img_refs[img->id]++;
+	list_move_tail(&img->lru, &img_lru);
+	args.handle = img->id;
+	args.size = img->size;
+	mutex_unlock(&img_lock);
+
+	if (copy_to_user((void __user *)arg, &args, sizeof(args)))
+		res = -EFAULT;
+out:
+	kfree(buf);
+	fput(src);
+	return res;
+}
+
+static long rtcore_img_put(struct file *file, unsigned long arg)
+{
+	rtcore_ctx_t *ctx;
+	rtcore_img_t *img;
+	u64 handle;
+
+	ctx = file->private_data;
+
+	if (copy_from_user(&handle, (void __user *)arg, sizeof(handle)))
+		return -EFAULT;
+
+	if (!handle || handle >= RTCORE_IMG_MAX || !ctx->img_refs[handle])
+		return -ENOENT;
+
+	mutex_lock(&img_lock);
+	img = idr_find(&img_idr, handle);
+	if (img)
+		rtcore_img_put_locked(ctx, img);
+	mutex_unlock(&img_lock);
+	return img ? 0 : -ENOENT;
+}
+
+/*
+ * completion records (jrt_done_rec_t) of jobs submitted through this fd,
+ * -EAGAIN when there are none: wait for them with poll
+ */
+static ssize_t rtcore_read(struct file *filp, char __user *buf, size_t len, loff_t *off)
+{
+	rtcore_ctx_t *ctx;
+	unsigned int copied;
+	int res;
+
+	ctx = filp->private_data;
+
+	if (len < sizeof(jrt_done_rec_t))
+		return -EINVAL;
+
+	mutex_lock(&img_lock);
+	rtcore_reap_locked();
+	res = kfifo_to_user(&ctx->done, buf, len, &copied);
+	mutex_unlock(&img_lock);
+
+	if (res)
+		return res;
+	return copied ? copied : -EAGAIN;
+}
+
+/* readable when a completion of a job submitted through this fd is queued */
+static __poll_t rtcore_poll(struct file *filp, poll_table *wait)
+{
+	rtcore_ctx_t *ctx;
+	__poll_t mask;
+
+	ctx = filp->private_data;
+
+	poll_wait(filp, &done_wq, wait);
+	mutex_lock(&img_lock);
+	rtcore_reap_locked();
+	mask = kfifo_is_empty(&ctx->done) ? 0 : EPOLLIN | EPOLLRDNORM;
+	mutex_unlock(&img_lock);
+	return mask;
+}
+
+static long rtcore_code_info(struct file *file, unsigned long arg)
+{
+	code_info_t info;
+
+	/* the image cache sits above everything mmap hands out */
+	info.code_phys = JRT_CODE_PHYS;
+	info.code_size = JRT_CODE_SIZE - img_cache_size;
+	info.code_used = G_MEM_OFF;
+
+	if (copy_to_user((void __user *)arg, &info, sizeof(info)))
+		return -EFAULT;
 	return 0;
 }
 
@@ -325,6 +1029,30 @@ static long rtcore_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return rtcore_start_cpu(file, arg);
 	case RTCORE_IOCTL_SCHED_PROG:
 		return rtcore_sched_prog(file, arg);
+	case RTCORE_IOCTL_CODE_INFO:
+		return rtcore_code_info(file, arg);
+	case RTCORE_IOCTL_LOAD_FD:
+		return rtcore_load_fd(file, arg);
+	case RTCORE_IOCTL_IMG_LOAD:
+		return rtcore_img_load(file, arg);
+	case RTCORE_IOCTL_IMG_PUT:
+		return rtcore_img_put(file, arg);
+	case RTCORE_IOCTL_EVT_SIGNAL:
+		return rtcore_evt_signal(arg);
+	case RTCORE_IOCTL_EVT_BIND:
+		return rtcore_evt_bind(file->private_data, arg);
+	case RTCORE_IOCTL_BUF_ALLOC:
+		return rtcore_buf_alloc(file->private_data, arg);
+	case RTCORE_IOCTL_BUF_FREE:
+		return rtcore_buf_free(file->private_data, arg);
+	case RTCORE_IOCTL_CHAN_CREATE:
+		return rtcore_chan_create(arg);
+	case RTCORE_IOCTL_HIST_RESET:
+		return rtcore_stats_hist_reset(arg);
+	case RTCORE_IOCTL_PROF:
+		return rtcore_prof_ctl(arg);
+	case RTCORE_IOCTL_PMU_SEL:
+		return rtcore_stats_pmu_sel(arg);
 	default:
 		return -ENOTTY;
 	}
@@ -342,9 +1070,20 @@ static int rtcore_mmap(struct file *filp, struct vm_area_struct *vma)
 	ctx = filp->private_data;
 	size = vma->vm_end - vma->vm_start;
 
+	if (vma->vm_pgoff >= (RTCORE_PROF_MMAP_OFF >> PAGE_SHIFT))
+		return rtcore_prof_mmap(vma);
+	if (vma->vm_pgoff >= (RTCORE_CLOCK_MMAP_OFF >> PAGE_SHIFT))
+		return rtcore_clock_mmap(vma);
+	if (vma->vm_pgoff >= (RTCORE_STATS_MMAP_OFF >> PAGE_SHIFT))
+		return rtcore_stats_mmap(vma);
+	if (vma->vm_pgoff >= (RTCORE_CHAN_MMAP_OFF >> PAGE_SHIFT))
+		return rtcore_chan_mmap(vma);
+	if (vma->vm_pgoff >= (RTCORE_BUF_MMAP_OFF >> PAGE_SHIFT))
+		return rtcore_buf_mmap(ctx, vma);
+
 	sz = G_MEM_OFF + size;
-	/* Sanity vs your reserved window usage */
-	if (sz > JRT_CODE_SIZE) {
+	/* Sanity vs your reserved window usage (the top is the image cache) */
+	if (sz > JRT_CODE_SIZE - img_cache_size) {
 		pr_err("rtcore: mmap size too large (%lu bytes)\n", sz);
 		return -EINVAL;
 	}
@@ -396,6 +1135,37 @@ static inline void ipc_init(struct mpsc_ring *r)
 	memset(r->flags, 0, TOJRT_SIZE);
 }
 
+static inline void ipc_done_init(struct spsc_ring *r)
+{
+	smp_store_release(&r->head, 0);
+	smp_store_release(&r->tail, 0);
+	r->dropped = 0;
+}
+
+static int img_cache_init(void)
+{
+	phys_addr_t base;
+
+	if (!img_cache_size || img_cache_size >= JRT_CODE_SIZE ||
+		!PAGE_ALIGNED(img_cache_size)) {
+		pr_err("rtcore: bad img_cache_size 0x%lx\n", img_cache_size);
+		return -EINVAL;
+	}
+
+	img_pool = gen_pool_create(PAGE_SHIFT, -1);
+	if (!img_pool)
+		return -ENOMEM;
+
+	base = JRT_CODE_PHYS + JRT_CODE_SIZE - img_cache_size;
+	if (gen_pool_add(img_pool, base, img_cache_size, -1)) {
+		gen_pool_destroy(img_pool);
+		return -ENOMEM;
+	}
+	pr_info("rtcore: image cache 0x%lx bytes at 0x%pa\n",
+		img_cache_size, &base);
+	return 0;
+}
+
 static int __init rtcore_init(void)
 {
 	alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
@@ -420,15 +1190,69 @@ static int __init rtcore_init(void)
 		return -ENOMEM;
 	}
 
+	fromjrt_ring = memremap(FROMJRT_RING_ADDR, FROMJRT_RING_SIZE, MEMREMAP_WB);
+	if (!fromjrt_ring) {
+		pr_err("rtcore: failed to map FROMJRT_RING memory\n");
+		return -ENOMEM;
+	}
+
+	if (img_cache_init())
+		return -EINVAL;
+
+	if (rtcore_evt_init())
+		return -ENODEV;
+
+	if (rtcore_buf_init())
+		return -ENOMEM;
+
+	if (rtcore_chan_init())
+		return -ENOMEM;
+
+	if (rtcore_stats_init())
+		return -ENOMEM;
+
+	if (rtcore_clock_init())
+		return -ENOMEM;
+
+	rtcore_submit_init();
+
+	if (rtcore_prof_init())
+		return -ENOMEM;
+
 	pr_info("rtcore: registered with major %d\n", MAJOR(dev_num));
 	pr_info("rtcore: module loaded\n");
 	ipc_init(tojrt_ring);
-	pr_info("rtcore: initialized linux -> jrt ipc\n");
+	ipc_done_init(fromjrt_ring);
+	pr_info("rtcore: initialized linux <-> jrt ipc\n");
 	return 0;
 }
 
 static void __exit rtcore_exit(void)
 {
+	rtcore_img_t *img, *tmp;
+	rtcore_job_t *job;
+	unsigned long idx;
+
+	/* no completion kicks after this */
+	rtcore_evt_exit();
+	cancel_work_sync(&done_work);
+
+	xa_for_each(&job_xa, idx, job)
+		kfree(job);
+	xa_destroy(&job_xa);
+	list_for_each_entry_safe(img, tmp, &img_lru, lru)
+		rtcore_img_evict(img);
+	gen_pool_destroy(img_pool);
+	idr_destroy(&img_idr);
+
+	rtcore_buf_exit();
+	rtcore_chan_exit();
+	rtcore_stats_exit();
+	rtcore_clock_exit();
+	rtcore_submit_exit();
+	rtcore_prof_exit();
+
+	memunmap(fromjrt_ring);
 	memunmap(jrt_mem_virt);
 	device_destroy(rtcore_class, dev_num);
 	class_destroy(rtcore_class);
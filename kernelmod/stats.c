@@ -0,0 +1,90 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+
+#include "rtcore.h"
+#include "memory_layout.h"
+#include "stats.h"
+
+static DEFINE_MUTEX(stats_lock);
+static struct jrt_stats_page *stats_page;
+
+int rtcore_stats_init(void)
+{
+	stats_page = memremap(STATS_PAGE_ADDR, STATS_PAGE_SIZE, MEMREMAP_WB);
+	if (!stats_page) {
+		pr_err("rtcore: failed to map STATS_PAGE memory\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void rtcore_stats_exit(void)
+{
+	memunmap(stats_page);
+}
+
+/* JRT writes the stats page, Linux only ever reads it */
+int rtcore_stats_mmap(struct vm_area_struct *vma)
+{
+	unsigned long size;
+
+	size = vma->vm_end - vma->vm_start;
+	if ((vma->vm_pgoff << PAGE_SHIFT) != RTCORE_STATS_MMAP_OFF ||
+		size > PAGE_ALIGN(STATS_PAGE_SIZE) ||
+		(vma->vm_flags & VM_WRITE))
+		return -EINVAL;
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_pfn_range(vma, vma->vm_start, STATS_PAGE_ADDR >> PAGE_SHIFT,
+		size, vma->vm_page_prot);
+}
+
+/* JRT clears a histogram itself when it sees its reset count move */
+long rtcore_stats_hist_reset(unsigned long arg)
+{
+	u32 mask, i;
+
+	if (copy_from_user(&mask, (void __user *)arg, sizeof(mask)))
+		return -EFAULT;
+	if (mask & ~((1u << JRT_HIST_NR) - 1))
+		return -EINVAL;
+
+	mutex_lock(&stats_lock);
+	for (i = 0; i < JRT_HIST_NR; ++i) {
+		if (mask & (1u << i))
+			WRITE_ONCE(stats_page->hist_reset[i],
+				stats_page->hist_reset[i] + 1);
+	}
+	mutex_unlock(&stats_lock);
+	return 0;
+}
+
+/*
+ * JRT programs sel[] at its next context switch, skipping what the core
+ * does not implement, and says what it counts in pmu_cfg.event[].
+ */
+long rtcore_stats_pmu_sel(unsigned long arg)
+{
+	pmu_sel_args_t a;
+	u32 i;
+
+	if (copy_from_user(&a, (void __user *)arg, sizeof(a)))
+		return -EFAULT;
+	if (!READ_ONCE(stats_page->pmu_cfg.flags))
+		return -ENODEV;
+
+	mutex_lock(&stats_lock);
+	for (i = 0; i < JRT_PMU_EVENTS; ++i)
+		WRITE_ONCE(stats_page->pmu_cfg.sel[i], a.event[i]);
+	smp_store_release(&stats_page->pmu_cfg.sel_gen,
+		stats_page->pmu_cfg.sel_gen + 1);
+	mutex_unlock(&stats_lock);
+	return 0;
+}
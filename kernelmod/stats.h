@@ -0,0 +1,24 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_STATS_H_
+#define _RTCORE_STATS_H_
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+/*
+ * The JRT stats page (shared/stats.h). JRT writes it, user space maps it
+ * read-only, the module only ever asks for histogram resets and PMU
+ * event selections.
+ */
+
+int rtcore_stats_init(void);
+void rtcore_stats_exit(void);
+
+int rtcore_stats_mmap(struct vm_area_struct *vma);
+long rtcore_stats_hist_reset(unsigned long arg);
+long rtcore_stats_pmu_sel(unsigned long arg);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+
+#include "rtcore.h"
+#include "clock.h"
+#include "submit.h"
+
+/* hist[0] is the whole path, ioctl to first switch in */
+#define SUBMIT_TOTAL	JRT_STAGE_IOCTL
+
+static const char *const submit_names[JRT_STAGE_NR] = {
+	[SUBMIT_TOTAL] = "total",
+	[JRT_STAGE_COPY] = "copy",
+	[JRT_STAGE_SYNC] = "sync",
+	[JRT_STAGE_LOCK] = "lock",
+	[JRT_STAGE_SLOT] = "slot",
+	[JRT_STAGE_IRQ] = "doorbell",
+	[JRT_STAGE_POP] = "pop",
+	[JRT_STAGE_ALLOC] = "alloc",
+	[JRT_STAGE_PROC] = "proc",
+	[JRT_STAGE_READY] = "ready",
+	[JRT_STAGE_RUN] = "eret",
+};
+
+static DEFINE_MUTEX(submit_lock);
+static struct jrt_hist submit_hist[JRT_STAGE_NR];
+static struct dentry *submit_dir;
+
+static void submit_clear(void)
+{
+	u32 i;
+
+	memset(submit_hist, 0, sizeof(submit_hist));
+	for (i = 0; i < JRT_STAGE_NR; ++i)
+		submit_hist[i].min = U64_MAX;
+}
+
+static void submit_add(struct jrt_hist *h, u64 v)
+{
+	h->bucket[jrt_hist_index(v)]++;
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	if (v >> JRT_HIST_BITS)
+		h->overflow++;
+}
+
+/* a stage counts when it and the one before it were stamped, in order */
+void rtcore_submit_account(const jrt_done_rec_t *rec)
+{
+	const u64 *t;
+	u32 i;
+
+	t = rec->t_stage;
+	mutex_lock(&submit_lock);
+	for (i = 1; i < JRT_STAGE_NR; ++i) {
+		if (t[i - 1] && t[i] >= t[i - 1])
+			submit_add(&submit_hist[i], t[i] - t[i - 1]);
+	}
+	if (t[JRT_STAGE_IOCTL] && t[JRT_STAGE_RUN] >= t[JRT_STAGE_IOCTL])
+		submit_add(&submit_hist[SUBMIT_TOTAL],
+			t[JRT_STAGE_RUN] - t[JRT_STAGE_IOCTL]);
+	mutex_unlock(&submit_lock);
+}
+
+/* upper bound of the bucket holding the q-th permille of the samples */
+static u64 submit_pct(const struct jrt_hist *h, u32 q)
+{
+	u64 want, seen;
+	u32 i;
+
+	want = div_u64(h->count * q + 999, 1000);
+	if (!want)
+		want = 1;
+	seen = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS; ++i) {
+		seen += h->bucket[i];
+		if (seen >= want)
+			return min(jrt_hist_value(i), h->max);
+	}
+	return h->max;
+}
+
+static int submit_show(struct seq_file *m, void *v)
+{
+	const struct jrt_hist *h;
+	u32 i;
+
+	seq_printf(m, "%-9s %10s %10s %10s %10s %10s %10s\n", "(ns)",
+		"count", "min", "avg", "p50", "p99", "max");
+	mutex_lock(&submit_lock);
+	for (i = 0; i < JRT_STAGE_NR; ++i) {
+		h = &submit_hist[i];
+		if (!h->count) {
+			seq_printf(m, "%-9s %10d\n", submit_names[i], 0);
+			continue;
+		}
+		seq_printf(m, "%-9s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+			submit_names[i], h->count,
+			rtcore_clock_ns(h->min),
+			rtcore_clock_ns(div64_u64(h->sum, h->count)),
+			rtcore_clock_ns(submit_pct(h, 500)),
+			rtcore_clock_ns(submit_pct(h, 990)),
+			rtcore_clock_ns(h->max));
+	}
+	mutex_unlock(&submit_lock);
+	return 0;
+}
+
+static int submit_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, submit_show, NULL);
+}
+
+/* any write starts the histograms over */
+static ssize_t submit_write(struct file *file, const char __user *buf,
+	size_t len, loff_t *ppos)
+{
+	mutex_lock(&submit_lock);
+	submit_clear();
+	mutex_unlock(&submit_lock);
+	return len;
+}
+
+static const struct file_operations submit_fops = {
+	.owner = THIS_MODULE,
+	.open = submit_open,
+	.read = seq_read,
+	.write = submit_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+int rtcore_submit_init(void)
+{
+	submit_clear();
+	/* debugfs is a debugging aid, the module works without it */
+	submit_dir = debugfs_create_dir("rtcore", NULL);
+	debugfs_create_file("submit", 0600, submit_dir, NULL, &submit_fops);
+	return 0;
+}
+
+void rtcore_submit_exit(void)
+{
+	debugfs_remove_recursive(submit_dir);
+}
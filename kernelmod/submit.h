@@ -0,0 +1,23 @@
+/**
+ * Author: Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+
+#ifndef _RTCORE_SUBMIT_H_
+#define _RTCORE_SUBMIT_H_
+
+#include <linux/types.h>
+
+#include "mailbox.h"
+
+/*
+ * Per-stage submission latency (JRT_STAGE_* in shared/mailbox.h), taken
+ * from the stamps each completion record carries back. Shown and reset
+ * through debugfs: rtcore/submit.
+ */
+
+int rtcore_submit_init(void);
+void rtcore_submit_exit(void);
+
+void rtcore_submit_account(const jrt_done_rec_t *rec);
+
+#endif
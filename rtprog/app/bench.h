@@ -0,0 +1,98 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*
+ * Sample collection for the bench_* programs. Samples are CNTPCT tick
+ * deltas, kept as min/max/sum and a log histogram (shared/hist.h) for
+ * the percentiles. bench_print() divides every figure by per, for
+ * samples that time a batch of per operations.
+ */
+#include "uart.h"
+#include "timer.h"
+#include "hist.h"
+
+struct bench {
+	u64 count;
+	u64 min;
+	u64 max;
+	u64 sum;
+	u32 bucket[JRT_HIST_BUCKETS];
+};
+
+static inline void bench_reset(struct bench *b)
+{
+	u32 i;
+
+	b->count = 0;
+	b->min = ~0ull;
+	b->max = 0;
+	b->sum = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS; ++i)
+		b->bucket[i] = 0;
+}
+
+static inline void bench_add(struct bench *b, u64 t)
+{
+	if (t < b->min)
+		b->min = t;
+	if (t > b->max)
+		b->max = t;
+	b->sum += t;
+	b->count++;
+	b->bucket[jrt_hist_index(t)]++;
+}
+
+// upper bound of the permille'th sample, exact at the top
+static inline u64 bench_pct(struct bench *b, u32 permille)
+{
+	u64 want, seen;
+	u32 i;
+
+	want = (b->count * permille + 999) / 1000;
+	seen = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS - 1; ++i) {
+		seen += b->bucket[i];
+		if (seen >= want)
+			break;
+	}
+	return jrt_hist_value(i) < b->max ? jrt_hist_value(i) : b->max;
+}
+
+static inline void bench_print(const char *name, struct bench *b, u32 per)
+{
+	uart_puts(name);
+	if (!b->count) {
+		uart_puts(": no samples\n");
+		return;
+	}
+	uart_puts(": min ");
+	uart_putu64(ns_from_ticks(b->min) / per);
+	uart_puts(" ns, mean ");
+	uart_putu64(ns_from_ticks(b->sum) / (b->count * per));
+	uart_puts(" ns, p50 ");
+	uart_putu64(ns_from_ticks(bench_pct(b, 500)) / per);
+	uart_puts(" ns, p99 ");
+	uart_putu64(ns_from_ticks(bench_pct(b, 990)) / per);
+	uart_puts(" ns, max ");
+	uart_putu64(ns_from_ticks(b->max) / per);
+	uart_puts(" ns\n");
+}
+
+// the non-empty buckets, one line each
+static inline void bench_print_hist(struct bench *b)
+{
+	u32 i;
+
+	for (i = 0; i < JRT_HIST_BUCKETS; ++i) {
+		if (!b->bucket[i])
+			continue;
+		uart_puts("  <= ");
+		uart_putu64(ns_from_ticks(jrt_hist_value(i)));
+		uart_puts(" ns: ");
+		uart_putu32(b->bucket[i]);
+		uart_puts("\n");
+	}
+}
+
+#endif
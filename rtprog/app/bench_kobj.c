@@ -0,0 +1,84 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+/*
+ * Post-to-wakeup latency of semaphores, message queues and event flags.
+ *
+ * A worker thread with the earliest possible deadline blocks on each
+ * object in turn, main posts and the worker timestamps its wakeup. The
+ * post preempts main, so every sample is one syscall, one wake and one
+ * switch. The post time travels in shared mem, or in the message itself
+ * for the queue.
+ */
+#include "syscall.h"
+#include "bench.h"
+
+#define BENCH_SAMPLES	256
+
+struct shared {
+	u32 sem;
+	u32 mq;
+	u32 flags;
+	volatile u64 t_post;
+};
+
+// the worker shares our .bss, the samples do not need to fit in mem
+static struct bench g_b[3];
+
+static void worker(void *mem, u64 mem_size, void *arg)
+{
+	struct shared *s;
+	ipc_msg_t m;
+	u32 i;
+
+	s = mem;
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		sys_sem_wait(s->sem, KOBJ_FOREVER);
+		bench_add(&g_b[0], sys_mrs_cntpct() - s->t_post);
+	}
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		sys_mq_recv(s->mq, &m, KOBJ_FOREVER);
+		bench_add(&g_b[1], sys_mrs_cntpct() - m.w[0]);
+	}
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		sys_flags_wait(s->flags, 1, FLAGS_CONSUME, KOBJ_FOREVER);
+		bench_add(&g_b[2], sys_mrs_cntpct() - s->t_post);
+	}
+}
+
+int main(void *mem, u64 mem_size)
+{
+	struct shared *s;
+	ipc_msg_t m;
+	u32 i;
+
+	s = mem;
+	for (i = 0; i < 3; ++i)
+		bench_reset(&g_b[i]);
+	s->sem = sys_sem_create(0);
+	s->mq = sys_mq_create(4);
+	s->flags = sys_flags_create();
+
+	// deadline 1 beats anything main can have, the worker runs at once
+	sys_thread(1, worker, NULL, 0x1000);
+
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		s->t_post = sys_mrs_cntpct();
+		sys_sem_post(s->sem);
+	}
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		m.w[0] = sys_mrs_cntpct();
+		sys_mq_send(s->mq, &m, KOBJ_FOREVER);
+	}
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		s->t_post = sys_mrs_cntpct();
+		sys_flags_set(s->flags, 1);
+	}
+
+	bench_print("sem_post -> sem_wait", &g_b[0], 1);
+	bench_print("mq_send -> mq_recv", &g_b[1], 1);
+	bench_print("flags_set -> flags_wait", &g_b[2], 1);
+
+	sys_kobj_destroy(s->sem);
+	sys_kobj_destroy(s->mq);
+	sys_kobj_destroy(s->flags);
+	return 0;
+}
@@ -0,0 +1,120 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+/*
+ * Timer interrupts saved by timer slack on a mixed workload.
+ *
+ * One hard thread with a deadline wakes every BENCH_HARD_US, BENCH_SOFT
+ * soft background threads wake at their own odd periods. Each pass runs
+ * for BENCH_PASS_MS, first with no slack and then with BENCH_SLACK_US on
+ * the soft waits, and reads the CNTP interrupt counts off the stats page.
+ * The hard thread's worst lateness should not move between the passes.
+ */
+#include "uart.h"
+#include "syscall.h"
+#include "timer.h"
+#include "stats.h"
+#include "memory_layout.h"
+
+#define BENCH_SOFT	8
+#define BENCH_HARD_US	1000
+#define BENCH_SOFT_US	700	/* + 130 us per soft thread */
+#define BENCH_SLACK_US	300
+#define BENCH_PASS_MS	2000
+
+struct shared {
+	u64 end;		/* pass ends, ticks */
+	u64 slack;		/* soft waits, ticks */
+	volatile u32 running;
+	u64 wakeups;
+	u64 hard_late_max;
+};
+
+static void hard(void *mem, u64 mem_size, void *arg)
+{
+	struct shared *s;
+	u64 period, t, late;
+
+	s = mem;
+	period = ticks_from_us(BENCH_HARD_US);
+	for (t = sys_gettime() + period; t < s->end; t += period) {
+		sys_wait_until(t);
+		late = sys_gettime() - t;
+		if (late > s->hard_late_max)
+			s->hard_late_max = late;
+		__atomic_fetch_add(&s->wakeups, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_sub(&s->running, 1, __ATOMIC_RELEASE);
+}
+
+static void soft(void *mem, u64 mem_size, void *arg)
+{
+	struct shared *s;
+	u64 period, t;
+
+	s = mem;
+	period = ticks_from_us(BENCH_SOFT_US + 130 * (u64)(uintptr_t)arg);
+	for (t = sys_gettime() + period; t < s->end; t += period) {
+		sys_wait_slack(t, s->slack);
+		__atomic_fetch_add(&s->wakeups, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_sub(&s->running, 1, __ATOMIC_RELEASE);
+}
+
+static void timer_counts(u64 *irqs, u64 *saved)
+{
+	struct jrt_stats_page *page;
+	u32 i;
+
+	page = (void *)STATS_PAGE_ADDR;
+	*irqs = 0;
+	*saved = 0;
+	for (i = 0; i < JRT_STATS_CPUS; ++i) {
+		*irqs += page->cpu[i].timer_irqs;
+		*saved += page->cpu[i].timer_saved;
+	}
+}
+
+static void bench_pass(struct shared *s, u64 slack_us)
+{
+	u64 irqs0, saved0, irqs1, saved1, secs;
+	u64 i;
+
+	s->slack = ticks_from_us(slack_us);
+	s->end = sys_gettime() + ticks_from_us(BENCH_PASS_MS * 1000);
+	s->wakeups = 0;
+	s->hard_late_max = 0;
+	s->running = BENCH_SOFT + 1;
+
+	timer_counts(&irqs0, &saved0);
+	sys_thread(s->end + ticks_from_us(BENCH_HARD_US), hard, NULL, 0x1000);
+	for (i = 0; i < BENCH_SOFT; ++i)
+		sys_thread(~0ull, soft, (void *)(uintptr_t)i, 0x1000);
+	while (__atomic_load_n(&s->running, __ATOMIC_ACQUIRE))
+		sys_wait_until(sys_gettime() + ticks_from_us(BENCH_PASS_MS * 100));
+	timer_counts(&irqs1, &saved1);
+
+	secs = BENCH_PASS_MS / 1000;
+	uart_puts("slack ");
+	uart_putu64(slack_us);
+	uart_puts(" us: wakeups/s ");
+	uart_putu64(s->wakeups / secs);
+	uart_puts(", timer irqs/s ");
+	uart_putu64((irqs1 - irqs0) / secs);
+	uart_puts(", saved/s ");
+	uart_putu64((saved1 - saved0) / secs);
+	uart_puts(", hard late max ");
+	uart_putu64(ns_from_ticks(s->hard_late_max));
+	uart_puts(" ns\n");
+}
+
+int main(void *mem, u64 mem_size)
+{
+	struct shared *s;
+
+	s = mem;
+	uart_puts("timer slack, 1 hard + ");
+	uart_putu32(BENCH_SOFT);
+	uart_puts(" soft periodic threads\n");
+	bench_pass(s, 0);
+	bench_pass(s, BENCH_SLACK_US);
+	return 0;
+}
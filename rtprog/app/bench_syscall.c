@@ -0,0 +1,53 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+/*
+ * Syscall round trip latency. The fast path calls are timed next to a
+ * futex wait on a value that never matches, which returns -EAGAIN after
+ * the full context save/restore and serves as the slow path baseline.
+ *
+ * The counter ticks far slower than a fast syscall, so each sample times
+ * a batch of calls and reports per call figures.
+ */
+#include "syscall.h"
+#include "bench.h"
+
+#define BENCH_BATCH	256
+#define BENCH_SAMPLES	64
+
+static struct bench g_b;
+
+#define BENCH(name, call)						\
+	do {								\
+		u64 t0, t1;						\
+		u32 i, j;						\
+									\
+		bench_reset(&g_b);					\
+		for (i = 0; i < BENCH_SAMPLES; ++i) {			\
+			t0 = sys_mrs_cntpct();				\
+			for (j = 0; j < BENCH_BATCH; ++j)		\
+				(void)(call);				\
+			t1 = sys_mrs_cntpct();				\
+			bench_add(&g_b, t1 - t0);			\
+		}							\
+		bench_print(name, &g_b, BENCH_BATCH);			\
+	} while (0)
+
+int main(void *mem, u64 mem_size)
+{
+	u32 *futex;
+
+	futex = mem;
+	*futex = 0;
+
+	uart_puts("syscall round trip, ");
+	uart_putu32(BENCH_SAMPLES);
+	uart_puts(" x ");
+	uart_putu32(BENCH_BATCH);
+	uart_puts(" calls, per call\n");
+
+	BENCH("gettime (fast)", sys_gettime());
+	BENCH("getpid (fast)", sys_getpid());
+	BENCH("yield, nothing ready (fast)", sys_yield());
+	BENCH("futex_wake, no waiters (fast)", sys_futex_wake(futex, 1));
+	BENCH("futex_wait, EAGAIN (slow)", sys_futex_wait(futex, 1));
+	return 0;
+}
@@ -0,0 +1,57 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+/*
+ * Timed wakeup error: how late a sys_wait_until() returns after the
+ * tick it asked for, with early wake compensation off and then on.
+ *
+ * Each pass first lets the calibration settle, then sleeps to a fresh
+ * target BENCH_SAMPLES times and collects (return - target) in a log
+ * histogram (shared/hist.h). The spread between the passes is what the
+ * compensation buys.
+ */
+#include "syscall.h"
+#include "bench.h"
+
+#define BENCH_WARMUP	256
+#define BENCH_SAMPLES	1024
+#define BENCH_PERIOD_US	500
+#define BENCH_PERMILLE	990
+
+static void bench_pass(struct bench *b, u32 permille)
+{
+	u64 period, target;
+	u32 i;
+
+	sys_wake_comp(permille);
+	period = ticks_from_us(BENCH_PERIOD_US);
+	bench_reset(b);
+	for (i = 0; i < BENCH_WARMUP + BENCH_SAMPLES; ++i) {
+		target = sys_gettime() + period;
+		sys_wait_until(target);
+		if (i >= BENCH_WARMUP)
+			bench_add(b, sys_gettime() - target);
+	}
+}
+
+int main(void *mem, u64 mem_size)
+{
+	struct bench *b;
+
+	b = mem;
+	uart_puts("timed wakeup error, ");
+	uart_putu32(BENCH_SAMPLES);
+	uart_puts(" sleeps of ");
+	uart_putu32(BENCH_PERIOD_US);
+	uart_puts(" us\n");
+
+	bench_pass(b, 0);
+	bench_print("compensation off", b, 1);
+	bench_print_hist(b);
+
+	bench_pass(b, BENCH_PERMILLE);
+	uart_puts("early by ");
+	uart_putu64(ns_from_ticks(sys_wake_comp(BENCH_PERMILLE)));
+	uart_puts(" ns\n");
+	bench_print("compensation on (p99)", b, 1);
+	bench_print_hist(b);
+	return 0;
+}
@@ -0,0 +1,94 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+/*
+ * First iteration latency of a periodic job with pre-release warm-up
+ * off and then on.
+ *
+ * Every BENCH_PERIOD_US the job wakes and chases pointers once through
+ * a BENCH_TABLE byte table, one dependent load per line, so the time it
+ * takes is the time its lines and pages take to come back. Collected is
+ * (end of the chase - release). The second pass declares the table and
+ * the chase code as hot ranges with a BENCH_LEAD_US lead.
+ *
+ * Meant to run while Linux hammers memory on the other cores, e.g.
+ * "while :; do dd if=/dev/zero of=/dev/null bs=16M; done &" a few times
+ * over, so the lines are gone by the next release. Needs a mem_req of
+ * at least BENCH_TABLE + 16 KiB, the stack lives at the top of it.
+ */
+#include "syscall.h"
+#include "bench.h"
+
+#define BENCH_TABLE	(64 * 1024)
+#define BENCH_LINES	(BENCH_TABLE / 64)
+#define BENCH_STRIDE	389	/* odd, the chase visits every line */
+#define BENCH_ITERS	200
+#define BENCH_PERIOD_US	10000
+#define BENCH_LEAD_US	100
+
+struct line {
+	struct line *next;
+	u64 pad[7];
+};
+
+static u64 chase(struct line *l)
+{
+	u32 i;
+
+	for (i = 0; i < BENCH_LINES; ++i)
+		l = l->next;
+	return (u64)(uintptr_t)l;
+}
+
+static void table_init(struct line *t)
+{
+	u32 i;
+
+	for (i = 0; i < BENCH_LINES; ++i)
+		t[i].next = &t[(i + BENCH_STRIDE) % BENCH_LINES];
+}
+
+static void bench_pass(struct bench *b, struct line *t)
+{
+	volatile u64 sink;
+	u64 period, target;
+	u32 i;
+
+	period = ticks_from_us(BENCH_PERIOD_US);
+	bench_reset(b);
+	sink = 0;
+	target = sys_gettime() + period;
+	for (i = 0; i < BENCH_ITERS; ++i, target += period) {
+		sys_wait_until(target);
+		sink += chase(t);
+		bench_add(b, sys_gettime() - target);
+	}
+}
+
+int main(void *mem, u64 mem_size)
+{
+	struct bench *b;
+	struct line *t;
+
+	if (mem_size < BENCH_TABLE + 16384) {
+		uart_puts("bench_warm: mem_req too small\n");
+		return 1;
+	}
+	b = mem;
+	t = (struct line *)((u8 *)mem + 4096);
+	table_init(t);
+	uart_puts("first iteration latency, ");
+	uart_putu32(BENCH_TABLE / 1024);
+	uart_puts(" KiB chase every ");
+	uart_putu32(BENCH_PERIOD_US);
+	uart_puts(" us\n");
+
+	sys_warm_lead(0);
+	bench_pass(b, t);
+	bench_print("warm-up off", b, 1);
+
+	sys_warm_range(t, BENCH_TABLE, WARM_DATA);
+	sys_warm_range((const void *)chase, 256, WARM_CODE);
+	sys_warm_lead(ticks_from_us(BENCH_LEAD_US));
+	bench_pass(b, t);
+	bench_print("warm-up on", b, 1);
+	return 0;
+}
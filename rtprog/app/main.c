@@ -27,7 +27,7 @@ int main(void *mem, u64 mem_size)
 
 
 	uart_puts("\n waiting 1 sec\n");
-	syscall(SYSCALL_WAIT_UNTIL, dl_ticks);
+	sys_wait_until(dl_ticks);
 	uart_puts("\nterminating\n");
 	return 0;
 }
@@ -46,7 +46,8 @@ int main(void *mem, u64 mem_size)
 	dl_us = now_us + 5000000ULL;
 	dl_ticks = ticks_from_us(dl_us);
 
-	syscall(SYSCALL_SPAWN, dl_ticks, (uintptr_t)func, NULL, 0xFF);
+	// worker shares main's mem, only needs a stack
+	sys_thread(dl_ticks, func, NULL, 0x1000);
 	for (int i = 0; i < 10; ++i)
 		wait(2, mem, mem_size, 1);
 	uart_puts("main exit\n");
@@ -82,7 +83,7 @@ void wait(u32 sec, void *mem, u64 mem_size, u32 p)
 	uart_puts("\n waiting ");
 	uart_putu32(sec);
 	uart_puts(" sec\n");
-	syscall(SYSCALL_WAIT_UNTIL, dl_ticks);
+	sys_wait_until(dl_ticks);
 	uart_puts("\nterminating\n");
 	return;
 }
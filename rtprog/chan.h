@@ -0,0 +1,17 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_CHAN_H_
+#define _JRT_CHAN_H_
+
+#include "types.h"
+#include "../shared/chan.h"
+
+/*
+ * JRT side of the shared-state channels in shared/chan.h. The area is in
+ * the kernel window every process map links, so RT tasks open a channel
+ * once and then use the inline chan_seq_write()/chan_tb_read() on it
+ * without entering the kernel.
+ */
+
+s64 chan_open(chan_t *c, const char *name, u32 type);
+
+#endif
@@ -0,0 +1,126 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "color.h"
+#include "alloc.h"
+#include "uart.h"
+#include "string.h"
+#include "memory_layout.h"
+
+#define COLOR_PAGES	(COLOR_POOL_SIZE / JRT_COLOR_PAGE)
+
+extern alloc_t G_ALLOC;
+
+static u64 G_COLOR_USED[(COLOR_PAGES + 63) / 64];
+// pages of the allocation starting at a page, 0 elsewhere
+static u32 G_COLOR_LEN[COLOR_PAGES];
+// longest run of RT pages, nothing longer can be colored
+static u32 G_COLOR_RUN;
+
+static inline uintptr_t color_pa(u32 i)
+{
+	return COLOR_POOL_ADDR + (uintptr_t)i * JRT_COLOR_PAGE;
+}
+
+static inline bool color_page_free(u32 i)
+{
+	return jrt_color_rt(color_pa(i)) &&
+		!((G_COLOR_USED[i / 64] >> (i % 64)) & 1);
+}
+
+static void color_mark(u32 first, u32 n, bool used)
+{
+	u32 i;
+
+	for (i = first; i < first + n; ++i) {
+		if (used)
+			G_COLOR_USED[i / 64] |= 1ull << (i % 64);
+		else
+			G_COLOR_USED[i / 64] &= ~(1ull << (i % 64));
+	}
+}
+
+void color_init(void)
+{
+	u32 i, run;
+
+	memset(G_COLOR_USED, 0, sizeof(G_COLOR_USED));
+	memset(G_COLOR_LEN, 0, sizeof(G_COLOR_LEN));
+	G_COLOR_RUN = 0;
+	run = 0;
+	for (i = 0; i < COLOR_PAGES; ++i) {
+		run = jrt_color_rt(color_pa(i)) ? run + 1 : 0;
+		if (run > G_COLOR_RUN)
+			G_COLOR_RUN = run;
+	}
+
+	uart_puts("[COLOR] ");
+	uart_putu32(JRT_NCOLORS);
+	uart_puts(" colors, RT mask ");
+	uart_puthex(JRT_RT_COLORS);
+	uart_puts(", colored up to ");
+	uart_putu32(G_COLOR_RUN * (JRT_COLOR_PAGE / 1024));
+	uart_puts(" KiB\n");
+}
+
+// first fit, with a contiguous mask every run is as long as any other
+static void *color_take(size_t len)
+{
+	u32 i, n, run;
+
+	n = (len + JRT_COLOR_PAGE - 1) / JRT_COLOR_PAGE;
+	if (!n || n > G_COLOR_RUN)
+		return NULL;
+
+	run = 0;
+	for (i = 0; i < COLOR_PAGES; ++i) {
+		run = color_page_free(i) ? run + 1 : 0;
+		if (run < n)
+			continue;
+		i -= n - 1;
+		color_mark(i, n, true);
+		G_COLOR_LEN[i] = n;
+		return (void *)color_pa(i);
+	}
+	return NULL;
+}
+
+static void *color_fallback(size_t len, u64 align)
+{
+	return align ? aligned_alloc(&G_ALLOC, len, align) : alloc(&G_ALLOC, len);
+}
+
+void *color_alloc(size_t len)
+{
+	void *p;
+
+	p = color_take(len);
+	return p ? p : color_fallback(len, 0);
+}
+
+void *color_alloc_pages(size_t len)
+{
+	void *p;
+
+	p = color_take(len);
+	return p ? p : color_fallback(len, JRT_COLOR_PAGE);
+}
+
+bool color_rt(const void *p)
+{
+	uintptr_t a;
+
+	a = (uintptr_t)p;
+	return a >= COLOR_POOL_ADDR && a < COLOR_POOL_ADDR + COLOR_POOL_SIZE;
+}
+
+void color_free(void *p)
+{
+	u32 i;
+
+	if (!color_rt(p)) {
+		free(&G_ALLOC, p);
+		return;
+	}
+	i = ((uintptr_t)p - COLOR_POOL_ADDR) / JRT_COLOR_PAGE;
+	color_mark(i, G_COLOR_LEN[i], false);
+	G_COLOR_LEN[i] = 0;
+}
@@ -0,0 +1,30 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_COLOR_H_
+#define _JRT_COLOR_H_
+
+#include "types.h"
+#include "../shared/color.h"
+
+/*
+ * RT process memory from the page-colored pool (COLOR_POOL_ADDR): only
+ * pages of the JRT_RT_COLORS colors of shared/color.h are handed out,
+ * so the LLC sets they use are not the ones Linux keeps refilling.
+ *
+ * Process memory is identity mapped, an allocation has to be a run of
+ * consecutive RT pages. Requests longer than the longest run, and any
+ * the pool has no run left for, come uncolored from G_ALLOC; color_rt()
+ * tells them apart and a job on such memory completes with
+ * JRT_DONE_UNCOLORED. Pages of the other colors in the pool stay unused.
+ */
+
+void color_init(void);
+
+void *color_alloc(size_t len);
+// page aligned also when it falls back to G_ALLOC
+void *color_alloc_pages(size_t len);
+// p from either pool
+void color_free(void *p);
+// p came from the colored pool
+bool color_rt(const void *p);
+
+#endif
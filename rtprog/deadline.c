@@ -0,0 +1,120 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "deadline.h"
+#include "sched.h"
+#include "heap.h"
+#include "kobj.h"
+#include "endpoint.h"
+#include "stats.h"
+#include "uart.h"
+
+extern void jrt_exit(u64 status);
+
+void dl_arm(sched_t *sc, proc_t *p)
+{
+	if (!p->abs_deadline || p->abs_deadline == DL_BACKGROUND)
+		return;
+	if (heap_push(&sc->deadlines, p->abs_deadline, p)) {
+		uart_puts("[DL] deadline heap full, no overrun timer\n");
+		return;
+	}
+	sched_arm_timer(sc);
+}
+
+/* the timer may still fire for it, dl_expire finds nothing then */
+void dl_disarm(sched_t *sc, proc_t *p)
+{
+	proc_t *w;
+	u64 dl;
+
+	if (p->dl_idx == HEAP_NO_IDX)
+		return;
+	heap_remove(&sc->deadlines, p->dl_idx, &dl, (void**)&w);
+}
+
+static void dl_demote(sched_t *sc, proc_t *p)
+{
+	p->abs_deadline = DL_BACKGROUND;
+	// a server keeps its caller's deadline until it replies
+	if (p->ipc_caller)
+		return;
+	p->eff_deadline = DL_BACKGROUND;
+	sched_requeue(sc, p);
+}
+
+static void dl_kill(sched_t *sc, proc_t *p)
+{
+	p->dl_killed = true;
+	p->ctx.pc = (uintptr_t)jrt_exit;
+	p->ctx.x[0] = -SYS_ETIMEDOUT;
+
+	// running or queued: it exits the next time it runs
+	if (p->state != PROC_WAITING || p->ready_idx != HEAP_NO_IDX)
+		return;
+	// whatever it waits on, it stops waiting
+	if (p->wait_obj)
+		kobj_timeout(p);
+	sched_futex_cancel(sc, p);
+	ep_proc_exit(p);
+	sched_unsleep(sc, p);
+	p->state = PROC_READY;
+	sched_ready_proc(sc, p->pid);
+}
+
+static void dl_miss(sched_t *sc, proc_t *p, u64 now)
+{
+	uart_puts("[DL] pid ");
+	uart_putu32(p->pid);
+	uart_puts(" missed ");
+	uart_putu64(p->abs_deadline);
+	uart_puts(" at ");
+	uart_putu64(now);
+	uart_puts("\n");
+
+	p->dl_missed = true;
+	stats_overrun(p, p->miss_policy == JRT_MISS_KILL);
+
+	switch (p->miss_policy) {
+	case JRT_MISS_NOTIFY:
+		if (flags_raise(p->as, p->miss_flags, p->miss_bits) < 0)
+			uart_puts("[DL] notify: no such flags object\n");
+		break;
+	case JRT_MISS_DEMOTE:
+		dl_demote(sc, p);
+		break;
+	case JRT_MISS_KILL:
+		dl_kill(sc, p);
+		break;
+	default:
+		break;
+	}
+}
+
+u32 dl_expire(sched_t *sc, u64 now)
+{
+	proc_t *p;
+	u64 dl;
+	u32 n;
+
+	n = 0;
+	while (!heap_empty(&sc->deadlines)) {
+		heap_peek(&sc->deadlines, &dl, (void**)&p);
+		if (dl > now)
+			break;
+		heap_pop(&sc->deadlines, &dl, (void**)&p);
+		dl_miss(sc, p, now);
+		n++;
+	}
+	return n;
+}
+
+s64 dl_policy(proc_t *p, u64 policy, u64 flags, u64 bits)
+{
+	if (policy > JRT_MISS_KILL)
+		return -SYS_EINVAL;
+	if (policy == JRT_MISS_NOTIFY && !bits)
+		return -SYS_EINVAL;
+	p->miss_policy = policy;
+	p->miss_flags = flags;
+	p->miss_bits = bits;
+	return 0;
+}
@@ -0,0 +1,35 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _DEADLINE_H_
+#define _DEADLINE_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "../shared/mailbox.h"
+
+/*
+ * Deadline overrun timers. Every proc with an absolute deadline sits in
+ * the scheduler's deadline heap until it exits, sched_arm_timer() arms
+ * the sched ktimer for whichever of it and the timing wheel is due
+ * first. When a deadline passes with its proc still alive, timer_fn
+ * records the miss and applies the proc's JRT_MISS_* policy:
+ *
+ *  CONTINUE: nothing else.
+ *  NOTIFY:   set miss_bits in the event flags object miss_flags, a
+ *            handler thread of the task waits on it.
+ *  DEMOTE:   the proc keeps running, behind every proc with a deadline.
+ *  KILL:     the proc resumes in jrt_exit(), so it leaves through the
+ *            normal exit path and its job is reported JRT_DONE_KILLED.
+ *            Any wait is cut short, a call it serves fails with
+ *            -SYS_EPIPE.
+ */
+
+/* ready key of demoted procs */
+#define DL_BACKGROUND	(~0ull)
+
+void dl_arm(sched_t *sc, proc_t *p);
+void dl_disarm(sched_t *sc, proc_t *p);
+// timer_fn: handle every deadline up to now, returns misses handled
+u32 dl_expire(sched_t *sc, u64 now);
+s64 dl_policy(proc_t *p, u64 policy, u64 flags, u64 bits);
+
+#endif
@@ -0,0 +1,253 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "endpoint.h"
+#include "sched.h"
+#include "syscall.h"
+
+extern sched_t G_SCHED;
+
+static endpoint_t G_EP[EP_MAX];
+
+void ep_init(void)
+{
+	u32 i;
+
+	for (i = 0; i < EP_MAX; ++i) {
+		G_EP[i].used = 0;
+		G_EP[i].owner = NULL;
+		G_EP[i].server = NULL;
+		G_EP[i].send_head = NULL;
+		G_EP[i].send_tail = NULL;
+	}
+}
+
+static endpoint_t *ep_get(u64 id)
+{
+	if (id >= EP_MAX || !G_EP[id].used)
+		return NULL;
+	return &G_EP[id];
+}
+
+s64 ep_create(proc_t *p)
+{
+	u32 i;
+
+	for (i = 0; i < EP_MAX; ++i) {
+		if (!G_EP[i].used) {
+			G_EP[i].used = 1;
+			G_EP[i].owner = p->as;
+			return i;
+		}
+	}
+	return -SYS_ENOSPC;
+}
+
+static void ep_fail(proc_t *w)
+{
+	w->ctx.x[0] = -SYS_EPIPE;
+	w->state = PROC_READY;
+	sched_ready_proc(&G_SCHED, w->pid);
+}
+
+// fails the waiting server and queued callers, returns procs woken
+static u32 ep_free(endpoint_t *ep)
+{
+	proc_t *c;
+	u32 n;
+
+	n = 0;
+	if (ep->server) {
+		ep_fail(ep->server);
+		ep->server = NULL;
+		++n;
+	}
+	while ((c = ep->send_head)) {
+		ep->send_head = c->ipc_next;
+		c->ipc_next = NULL;
+		ep_fail(c);
+		++n;
+	}
+	ep->send_tail = NULL;
+	ep->owner = NULL;
+	ep->used = 0;
+	return n;
+}
+
+s64 ep_destroy(proc_t *p, u64 id)
+{
+	endpoint_t *ep;
+
+	ep = ep_get(id);
+	if (!ep || ep->owner != p->as)
+		return -SYS_EINVAL;
+	if (ep_free(ep))
+		sched(&G_SCHED, sched_switch_irq);
+	return 0;
+}
+
+// payload is x1..x4, x0 carries the endpoint in and the status out
+static inline void ipc_copy(proc_t *from, proc_t *to)
+{
+	to->ctx.x[1] = from->ctx.x[1];
+	to->ctx.x[2] = from->ctx.x[2];
+	to->ctx.x[3] = from->ctx.x[3];
+	to->ctx.x[4] = from->ctx.x[4];
+}
+
+// s starts serving c, on c's deadline
+static void ipc_receive(proc_t *s, proc_t *c)
+{
+	ipc_copy(c, s);
+	s->ctx.x[0] = c->pid;
+	s->ipc_caller = c;
+	c->ipc_server = s;
+	if (c->eff_deadline < s->eff_deadline)
+		s->eff_deadline = c->eff_deadline;
+}
+
+/* direct switch, the heaps are left alone */
+static void ipc_switch(proc_t *c, proc_t *n)
+{
+	c->state = PROC_WAITING;
+	n->state = PROC_RUNNING;
+	sched_switch_irq(&G_SCHED, c, n);
+}
+
+s64 ep_call(proc_t *p, u64 id)
+{
+	endpoint_t *ep;
+	proc_t *s;
+
+	ep = ep_get(id);
+	if (!ep)
+		return -SYS_EINVAL;
+
+	s = ep->server;
+	if (s) {
+		ep->server = NULL;
+		ipc_receive(s, p);
+		ipc_switch(p, s);
+		return 0;
+	}
+
+	// server busy or not there yet, queue up and let the scheduler pick
+	p->ipc_next = NULL;
+	if (ep->send_tail)
+		ep->send_tail->ipc_next = p;
+	else
+		ep->send_head = p;
+	ep->send_tail = p;
+
+	sched_yield(&G_SCHED);
+	p->state = PROC_WAITING;
+	return 0;
+}
+
+s64 ep_reply_wait(proc_t *p, u64 id)
+{
+	endpoint_t *ep;
+	proc_t *c, *n;
+
+	// the reply is owed even if the endpoint went away mid call
+	c = p->ipc_caller;
+	if (c) {
+		p->ipc_caller = NULL;
+		c->ipc_server = NULL;
+		ipc_copy(p, c);
+		c->ctx.x[0] = 0;
+	}
+	// also when the caller was killed mid call
+	p->eff_deadline = p->abs_deadline;
+
+	ep = ep_get(id);
+	if (!ep) {
+		if (c) {
+			c->state = PROC_READY;
+			sched_ready_proc(&G_SCHED, c->pid);
+			sched(&G_SCHED, sched_switch_irq);
+		}
+		return -SYS_EINVAL;
+	}
+
+	n = ep->send_head;
+	if (n) {
+		// next call already queued: serve it without blocking
+		ep->send_head = n->ipc_next;
+		if (!ep->send_head)
+			ep->send_tail = NULL;
+		n->ipc_next = NULL;
+		ipc_receive(p, n);
+		if (c) {
+			c->state = PROC_READY;
+			sched_ready_proc(&G_SCHED, c->pid);
+			sched(&G_SCHED, sched_switch_irq);
+		}
+		return n->pid;
+	}
+
+	ep->server = p;
+	if (c) {
+		ipc_switch(p, c);
+	} else {
+		sched_yield(&G_SCHED);
+		p->state = PROC_WAITING;
+	}
+	return 0;
+}
+
+static void ep_unqueue(endpoint_t *ep, proc_t *p)
+{
+	proc_t *c, *prev;
+
+	prev = NULL;
+	for (c = ep->send_head; c; prev = c, c = c->ipc_next) {
+		if (c != p)
+			continue;
+		if (prev)
+			prev->ipc_next = c->ipc_next;
+		else
+			ep->send_head = c->ipc_next;
+		if (ep->send_tail == c)
+			ep->send_tail = prev;
+		c->ipc_next = NULL;
+		return;
+	}
+}
+
+void ep_proc_exit(proc_t *p)
+{
+	endpoint_t *ep;
+	proc_t *c;
+	u32 i;
+
+	for (i = 0; i < EP_MAX; ++i) {
+		ep = &G_EP[i];
+		if (!ep->used)
+			continue;
+		if (ep->server == p)
+			ep->server = NULL;
+		ep_unqueue(ep, p);
+	}
+
+	// a call of p being served: the reply goes nowhere
+	if (p->ipc_server) {
+		p->ipc_server->ipc_caller = NULL;
+		p->ipc_server = NULL;
+	}
+
+	c = p->ipc_caller;
+	if (!c)
+		return;
+	p->ipc_caller = NULL;
+	c->ipc_server = NULL;
+	ep_fail(c);
+}
+
+void ep_as_exit(aspace_t *as)
+{
+	u32 i;
+
+	for (i = 0; i < EP_MAX; ++i) {
+		if (G_EP[i].used && G_EP[i].owner == as)
+			ep_free(&G_EP[i]);
+	}
+}
@@ -0,0 +1,44 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _ENDPOINT_H_
+#define _ENDPOINT_H_
+
+#include "types.h"
+#include "sched_structs.h"
+
+/*
+ * Synchronous IPC endpoints.
+ *
+ * A call hands x1..x4 of the caller to the server waiting on the
+ * endpoint and switches straight to it, the server running on the
+ * caller's deadline until it replies. A reply hands x1..x4 back and
+ * switches straight back. As long as the server is waiting when the call
+ * comes in, neither direction touches the ready heap.
+ *
+ * An endpoint belongs to the process that created it and goes away with
+ * it, anyone blocked on it then gets -SYS_EPIPE.
+ */
+
+#define EP_MAX (64)
+
+typedef struct endpoint {
+	u32 used;
+	aspace_t *owner;	/* process that created it */
+	proc_t *server;		/* blocked in reply_wait, NULL if busy */
+	proc_t *send_head;	/* callers that found no server, FIFO */
+	proc_t *send_tail;
+} endpoint_t;
+
+void ep_init(void);
+s64 ep_create(proc_t *p);
+s64 ep_destroy(proc_t *p, u64 id);
+s64 ep_call(proc_t *p, u64 id);
+s64 ep_reply_wait(proc_t *p, u64 id);
+/*
+ * p exits or is killed: a call it serves fails with -SYS_EPIPE, it
+ * leaves every endpoint and a server of its own call replies to nobody.
+ */
+void ep_proc_exit(proc_t *p);
+// the last thread of as is exiting: free its endpoints
+void ep_as_exit(aspace_t *as);
+
+#endif
@@ -146,3 +146,10 @@ void gic_enable_spi(u32 spi)
 	// Enable it
 	mmio_w32(GICD_BASE + GICD_ISENABLER(r32i(spi)), (1u << b32i(spi)));
 }
+
+void gic_raise_spi(u32 spi)
+{
+	// order our stores before the receiver's handler runs
+	asm volatile("dsb ishst" ::: "memory");
+	mmio_w32(GICD_BASE + GICD_ISPENDR(r32i(spi)), (1u << b32i(spi)));
+}
@@ -84,6 +84,14 @@ static inline u64 sys_mrs_mpidr(void)
 	return v;
 }
 
+static inline u64 sys_mrs_cntp_cval(void)
+{
+	u64	v;
+
+	asm volatile("mrs %0, CNTP_CVAL_EL0" : "=r"(v));
+	return v;
+}
+
 static inline void sys_msr_cntp_cval(u64 v)
 {
 	asm volatile("msr CNTP_CVAL_EL0, %0" :: "r"(v));
@@ -123,6 +131,9 @@ extern void gic_enable_dist(void);
 
 void gic_enable_spi(u32 spi);
 
+// set spi pending, whoever it is routed to takes it
+void gic_raise_spi(u32 spi);
+
 int gic_enable_ppi(u32 ppi, u8 prio, int group1ns);
 
 uintptr_t gicr_base_for_this_cpu(void);
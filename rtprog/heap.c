@@ -5,6 +5,12 @@
 static inline size_t parent(size_t i) { return (i - 1) / HEAP_D; }
 static inline size_t child (size_t i, size_t k) { return HEAP_D * i + 1 + k; }
 
+static inline void set_idx(minheap_t *h, size_t i, size_t v)
+{
+	if (h->idx_off != HEAP_NO_IDX)
+		*(size_t *)((u8 *)h->a[i].val + h->idx_off) = v;
+}
+
 static inline void swap_nodes(minheap_t *h, size_t i, size_t j)
 {
 	//heap_node_t *ti;
@@ -19,6 +25,8 @@ static inline void swap_nodes(minheap_t *h, size_t i, size_t j)
 	memcpy(&h->a[j], &tmp, sizeof(heap_node_t));
 	h->a[i].idx = i;
 	h->a[j].idx = j;
+	set_idx(h, i, i);
+	set_idx(h, j, j);
 }
 
 static inline void sift_up(minheap_t *h, size_t i)
@@ -79,6 +87,7 @@ int heap_push(minheap_t *h, u64 key, void *data)
 	h->a[i].key = key;
 	h->a[i].val = data;
 	h->a[i].idx = i;
+	set_idx(h, i, i);
 	sift_up(h, i);
 	return 0;
 }
@@ -96,14 +105,37 @@ void heap_pop(minheap_t *h, u64 *key, void **data)
 	*data = min->val;
 	*key = min->key;
 	min->idx = SIZE_MAX;
+	set_idx(h, 0, HEAP_NO_IDX);
 
 	if (--h->len) {
 		h->a[0] = h->a[h->len];
 		h->a[0].idx = 0;
+		set_idx(h, 0, 0);
 		sift_down(h, 0);
 	}
 	return;
 }
+
+void heap_remove(minheap_t *h, size_t i, u64 *key, void **data)
+{
+	*data = NULL;
+	if (i >= h->len)
+		return;
+
+	*data = h->a[i].val;
+	*key = h->a[i].key;
+	set_idx(h, i, HEAP_NO_IDX);
+
+	if (i == --h->len)
+		return;
+	h->a[i] = h->a[h->len];
+	h->a[i].idx = i;
+	set_idx(h, i, i);
+	if (i > 0 && h->a[i].key < h->a[parent(i)].key)
+		sift_up(h, i);
+	else
+		sift_down(h, i);
+}
 void heap_peek(minheap_t *h, u64 *key, void **data)
 {
 	if (heap_empty(h)) {
@@ -11,6 +11,21 @@ static inline void heap_init(minheap_t *h, heap_node_t *storage, size_t cap)
 	h->a   = storage;
 	h->len = 0;
 	h->cap = cap;
+	h->idx_off = HEAP_NO_IDX;
+}
+
+/*
+ * The heap keeps *(size_t *)(val + idx_off) equal to the position of val,
+ * or HEAP_NO_IDX once it leaves, so heap_remove() needs no search.
+ */
+static inline void heap_init_indexed(
+	minheap_t *h,
+	heap_node_t *storage,
+	size_t cap,
+	size_t idx_off)
+{
+	heap_init(h, storage, cap);
+	h->idx_off = idx_off;
 }
 
 static inline int heap_empty(const minheap_t *h) { return h->len == 0; }
@@ -19,6 +34,8 @@ static inline int heap_full (const minheap_t *h) { return h->len == h->cap; }
 void heap_pop(minheap_t *h, u64 *key, void **data);
 void heap_peek(minheap_t *h, u64 *key, void **data);
 int heap_push(minheap_t *h, u64 key, void *data);
+// remove the element at position i, O(log n)
+void heap_remove(minheap_t *h, size_t i, u64 *key, void **data);
 
 // invokes iterf(last, key, val, arg); for each element,
 void heap_iter(minheap_t *h, void *arg, void (*iterf)(bool,u64,void*,void*));
@@ -18,8 +18,11 @@ typedef struct minheap {
 	heap_node_t *a;	// array of pointers to nodes
 	size_t len;	// current size
 	size_t cap;	// capacity
+	size_t idx_off;	// offset of a size_t in *val tracking its position
 } minheap_t;
 
+#define HEAP_NO_IDX SIZE_MAX
+
 #endif
 
 
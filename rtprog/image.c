@@ -0,0 +1,311 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "image.h"
+#include "mmu.h"
+#include "uart.h"
+#include "color.h"
+#include "string.h"
+#include "syscall_table.h"
+
+static image_t G_IMAGES[IMAGE_CACHE_MAX];
+static u64 G_IMAGE_CLOCK;
+
+/*
+ * ASIDs belong to cache slots, not processes: a slot keeps its ASID for
+ * every map it ever holds and the TLB is cleaned when the map changes.
+ * ASID 0 is the kernel map.
+ */
+static inline u16 image_asid(image_t *img)
+{
+	return (u16)(img - G_IMAGES) + 1;
+}
+
+/* except instances of priv images, their maps take ASIDs above the slots */
+#define IMAGE_ASID_FIRST	(IMAGE_CACHE_MAX + 1)
+#define IMAGE_ASID_MAX		(256)
+static u64 G_INST_ASID[IMAGE_ASID_MAX / 64];
+
+static s32 image_asid_alloc(void)
+{
+	u32 a;
+
+	for (a = IMAGE_ASID_FIRST; a < IMAGE_ASID_MAX; ++a) {
+		if (!((G_INST_ASID[a / 64] >> (a % 64)) & 1)) {
+			G_INST_ASID[a / 64] |= 1ull << (a % 64);
+			return a;
+		}
+	}
+	return -1;
+}
+
+// the TLB is clean of it before the next instance gets it
+static void image_asid_free(u16 asid)
+{
+	tlbi_asid(asid);
+	G_INST_ASID[asid / 64] &= ~(1ull << (asid % 64));
+}
+
+void image_init(void)
+{
+	memset(G_IMAGES, 0, sizeof(G_IMAGES));
+	memset(G_INST_ASID, 0, sizeof(G_INST_ASID));
+	G_IMAGE_CLOCK = 0;
+}
+
+static void image_release(image_t *img)
+{
+	if (img->map.root.l0) {
+		mmu_map_destroy(&img->map);
+		tlbi_asid(image_asid(img));
+	}
+	img->priv = false;
+	img->used = false;
+}
+
+static void image_evict(image_t *img)
+{
+	uart_puts("[IMG] evict ");
+	uart_puthex(img->pa);
+	uart_puts("\n");
+
+	image_release(img);
+}
+
+/*
+ * Map the segments of an image placed by the rtcore ELF loader. Read-only
+ * segments map the cached image directly, writable ones get a fresh copy
+ * from the page-frame pool with .bss zeroed there, kept in wseg[].
+ */
+static s32 image_map_segs(image_t *img, mmu_map_t *map, void **wseg)
+{
+	const jrt_image_hdr_t *h;
+	const jrt_image_seg_t *s;
+	u64 base, len, attrs;
+	u8 *w;
+	u32 i;
+
+	h = (const jrt_image_hdr_t *)(uintptr_t)img->pa;
+	base = img->pa + JRT_IMAGE_HDR_SIZE;
+	for (i = 0; i < h->nseg; ++i) {
+		s = &h->seg[i];
+		len = (s->memsz + PAGE_SIZE - 1) & PAGE_MASK;
+
+		if (!(s->flags & JRT_SEG_W)) {
+			attrs = s->flags & JRT_SEG_X ? PTE_PROC_RX : PTE_PROC_RO;
+			map_range_pages(map->root,
+				h->va + s->off, base + s->off, len, attrs);
+			continue;
+		}
+
+		w = color_alloc_pages(len);
+		if (!w)
+			return -SYS_ENOSPC;
+		memcpy(w, (void *)(uintptr_t)(base + s->off), s->filesz);
+		memset(w + s->filesz, 0, len - s->filesz);
+		wseg[i] = w;
+		map_range_pages(map->root,
+			h->va + s->off, (uintptr_t)w, len, PTE_PROC_RW);
+	}
+	return 0;
+}
+
+/*
+ * Check the header the rtcore ELF loader wrote. Images without writable
+ * segments get the shared map now, the others one per instance.
+ */
+static int image_map_elf(image_t *img)
+{
+	const jrt_image_hdr_t *h;
+	u32 i;
+
+	h = (const jrt_image_hdr_t *)(uintptr_t)img->pa;
+	if (h->magic != JRT_IMAGE_MAGIC ||
+		h->nseg > JRT_IMAGE_SEG_MAX ||
+		h->va + h->size > CODE_0)
+		return -1;
+
+	img->entry = h->va + h->entry;
+	img->priv = false;
+	for (i = 0; i < h->nseg; ++i)
+		img->priv |= !!(h->seg[i].flags & JRT_SEG_W);
+	if (img->priv)
+		return 0;
+
+	img->map = proc_map_create_base(image_asid(img));
+	return image_map_segs(img, &img->map, NULL) ? -1 : 0;
+}
+
+image_t *image_get(u64 pa, u64 size, u32 flags, u64 tag, s32 *err)
+{
+	image_t *img, *free, *lru;
+	u32 i;
+
+	// flat images write themselves, a shared RO map would fault them
+	if ((flags & IMAGE_RO) && !(flags & IMAGE_ELF)) {
+		uart_puts("[IMG] flat images cannot be cached\n");
+		*err = -SYS_EINVAL;
+		return NULL;
+	}
+
+	free = NULL;
+	lru = NULL;
+	for (i = 0; i < IMAGE_CACHE_MAX; ++i) {
+		img = &G_IMAGES[i];
+		if (!img->used) {
+			if (!free)
+				free = img;
+			continue;
+		}
+		if (img->pa == pa && img->size == size && img->flags == flags &&
+			img->tag == tag)
+			goto hit;
+		// the module evicted it and placed another image here
+		if (tag && img->pa == pa && img->tag != tag && !img->refs) {
+			image_evict(img);
+			if (!free)
+				free = img;
+			continue;
+		}
+		if (!img->refs && (!lru || img->last_use < lru->last_use))
+			lru = img;
+	}
+
+	if (!free) {
+		if (!lru) {
+			uart_puts("[IMG] every slot is in use\n");
+			*err = -SYS_ENOSPC;
+			return NULL;
+		}
+		image_evict(lru);
+		free = lru;
+	}
+
+	img = free;
+	img->pa = pa;
+	img->size = size;
+	img->flags = flags;
+	img->tag = tag;
+	img->refs = 0;
+	img->used = true;
+	if (flags & IMAGE_ELF) {
+		if (image_map_elf(img)) {
+			uart_puts("[IMG] bad ELF image\n");
+			image_release(img);
+			*err = -SYS_EINVAL;
+			return NULL;
+		}
+	} else {
+		// flat binary, linked to run at 0
+		img->map = proc_map_create(pa, size, image_asid(img),
+			PTE_PROC_RWX);
+		img->entry = 0;
+	}
+	uart_puts("[IMG] new ");
+	uart_puthex(pa);
+	uart_puts(" asid ");
+	uart_putu32(img->map.asid);
+	uart_puts("\n");
+hit:
+	img->refs++;
+	img->last_use = ++G_IMAGE_CLOCK;
+	return img;
+}
+
+bool image_maps(const image_t *img, u64 va, u64 len)
+{
+	const jrt_image_hdr_t *h;
+	const jrt_image_seg_t *s;
+	u64 lo, hi;
+	u32 i;
+
+	if (va + len < va)
+		return false;
+	if (!(img->flags & IMAGE_ELF))
+		return va + len <= img->size;
+
+	h = (const jrt_image_hdr_t *)(uintptr_t)img->pa;
+	for (i = 0; i < h->nseg; ++i) {
+		s = &h->seg[i];
+		lo = h->va + s->off;
+		hi = lo + ((s->memsz + PAGE_SIZE - 1) & PAGE_MASK);
+		if (va >= lo && va + len <= hi)
+			return true;
+	}
+	return false;
+}
+
+image_t *image_ref(image_t *img)
+{
+	img->refs++;
+	img->last_use = ++G_IMAGE_CLOCK;
+	return img;
+}
+
+void image_put(image_t *img)
+{
+	if (!img || !img->refs)
+		return;
+	// keep the map, the next launch of this image reuses it
+	img->refs--;
+}
+
+s32 image_instance(image_t *img, mmu_map_t *map, void **wseg)
+{
+	s32 asid, res;
+
+	memset(wseg, 0, JRT_IMAGE_SEG_MAX * sizeof(*wseg));
+	if (!img->priv) {
+		*map = img->map;
+		return 0;
+	}
+	asid = image_asid_alloc();
+	if (asid < 0) {
+		uart_puts("[IMG] out of instance ASIDs\n");
+		return -SYS_ENOSPC;
+	}
+	*map = proc_map_create_base(asid);
+	res = image_map_segs(img, map, wseg);
+	if (res)
+		image_instance_put(img, map, wseg);
+	return res;
+}
+
+void image_instance_put(image_t *img, mmu_map_t *map, void **wseg)
+{
+	u16 asid;
+	u32 i;
+
+	if (!img->priv)
+		return;
+	asid = map->asid;
+	mmu_map_destroy(map);
+	image_asid_free(asid);
+	for (i = 0; i < JRT_IMAGE_SEG_MAX; ++i) {
+		if (wseg[i])
+			color_free(wseg[i]);
+		wseg[i] = NULL;
+	}
+}
+
+void dump_images(int v)
+{
+	image_t *img;
+	u32 i;
+
+	if (v < 2)
+		return;
+	for (i = 0; i < IMAGE_CACHE_MAX; ++i) {
+		img = &G_IMAGES[i];
+		if (!img->used)
+			continue;
+		uart_puts("[IMG] ");
+		uart_putu32(i);
+		uart_puts(": pa ");
+		uart_puthex(img->pa);
+		uart_puts(" size ");
+		uart_putu64(img->size);
+		uart_puts(" refs ");
+		uart_putu32(img->refs);
+		uart_puts(img->flags & IMAGE_ELF ? " elf" : "");
+		uart_puts(img->flags & IMAGE_RO ? " ro\n" : " rwx\n");
+	}
+}
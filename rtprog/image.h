@@ -0,0 +1,65 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include "types.h"
+#include "mmu_structs.h"
+#include "jrt_image.h"
+
+/*
+ * Process images and their prebuilt page tables.
+ *
+ * Every instance of the same image shares one mmu_map_t, so a repeat
+ * launch is a table lookup instead of a page table build. Entries with no
+ * running instance stay cached until the slot is needed (LRU).
+ *
+ * ELF images with writable segments are the exception: every instance
+ * gets its own copy of .data and a zeroed .bss, so nothing carries over
+ * between launches or leaks between concurrent ones. Such an instance
+ * has a map of its own, built at launch, with an ASID from the range
+ * above the slots (image_instance).
+ */
+
+#define IMAGE_CACHE_MAX (64)
+
+/* map the image read-only, instances share it (module image cache, ELF) */
+#define IMAGE_RO (1u << 0)
+/* pa points to a jrt_image_hdr_t, segments are mapped as described */
+#define IMAGE_ELF (1u << 1)
+
+#define IMAGE_TAG(id, gen)	(((u64)(gen) << 32) | (id))
+
+typedef struct image {
+	u64 pa;
+	u64 size;
+	u32 flags;
+	u64 tag;	/* IMAGE_TAG from the module */
+	u32 refs;	/* live processes using map */
+	u64 last_use;
+	u64 entry;	/* initial pc */
+	mmu_map_t map;	/* unused when priv */
+	bool priv;	/* writable segments, a map per instance */
+	bool used;
+} image_t;
+
+void image_init(void);
+
+/*
+ * tag: the module's image id and generation (IMAGE_TAG), 0 for images
+ * outside its cache. NULL with *err set when every slot is in use or
+ * the image is bad.
+ */
+image_t *image_get(u64 pa, u64 size, u32 flags, u64 tag, s32 *err);
+image_t *image_ref(image_t *img);
+void image_put(image_t *img);
+/*
+ * The map a new instance of img runs on, with fresh copies of its
+ * writable segments in wseg[]. -SYS_ENOSPC when out of memory or ASIDs.
+ */
+s32 image_instance(image_t *img, mmu_map_t *map, void **wseg);
+void image_instance_put(image_t *img, mmu_map_t *map, void **wseg);
+// [va, va + len) is mapped by img's own pages
+bool image_maps(const image_t *img, u64 va, u64 len);
+
+void dump_images(int v);
+#endif
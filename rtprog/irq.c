@@ -6,6 +6,7 @@
 
 irq_fn_t spi_table[1020-32]; /* SPIs 32..1019 */
 irq_fn_t ppi_table[32];      /* 0..31 */
+u64 G_NIRQ;
 
 void irq_register_ppi(u32 intid, irq_fn_t fn)  /* intid < 32 */
 {
@@ -51,6 +52,7 @@ void irq_dispatch(ctx_t *ctx, u32 intid)
 {
 	irq_fn_t f;
 
+	G_NIRQ++;
 	//uart_puts("irq (");
 	//uart_putu32(intid);
 	//uart_puts(") ctx:\n");
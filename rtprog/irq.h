@@ -7,6 +7,9 @@
 #include "sched.h"
 typedef void (*irq_fn_t)(ctx_t*);
 
+/* interrupts dispatched since boot */
+extern u64 G_NIRQ;
+
 void irq_init(void);
 void irq_register_ppi(u32 intid, irq_fn_t fn);
 void irq_register_spi(u32 intid, irq_fn_t fn);
@@ -0,0 +1,366 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "kobj.h"
+#include "sched.h"
+#include "heap.h"
+#include "timer.h"
+
+extern sched_t G_SCHED;
+
+static kobj_t G_KOBJ[KOBJ_MAX];
+
+void kobj_init(void)
+{
+	u32 i;
+
+	for (i = 0; i < KOBJ_MAX; ++i)
+		G_KOBJ[i].type = KOBJ_FREE;
+}
+
+static inline aspace_t *kobj_as(proc_t *p)
+{
+	return p ? p->as : NULL;
+}
+
+static kobj_t *kobj_get(aspace_t *as, u64 id, kobj_type_t type)
+{
+	if (id >= KOBJ_MAX || G_KOBJ[id].type != type)
+		return NULL;
+	if (G_KOBJ[id].owner && G_KOBJ[id].owner != as)
+		return NULL;
+	return &G_KOBJ[id];
+}
+
+static s64 kobj_alloc(proc_t *p, kobj_type_t type, kobj_t **o)
+{
+	u32 i;
+
+	for (i = 0; i < KOBJ_MAX; ++i) {
+		if (G_KOBJ[i].type == KOBJ_FREE) {
+			*o = &G_KOBJ[i];
+			(*o)->type = type;
+			(*o)->pinned = 0;
+			(*o)->owner = kobj_as(p);
+			heap_init_indexed(&(*o)->waiters, (*o)->wn, KOBJ_WAIT_MAX,
+				__builtin_offsetof(proc_t, obj_idx));
+			return i;
+		}
+	}
+	return -SYS_ENOSPC;
+}
+
+s64 kobj_destroy(proc_t *p, u64 id)
+{
+	if (id >= KOBJ_MAX || G_KOBJ[id].type == KOBJ_FREE)
+		return -SYS_EINVAL;
+	if (G_KOBJ[id].pinned || G_KOBJ[id].owner != p->as)
+		return -SYS_EINVAL;
+	if (!heap_empty(&G_KOBJ[id].waiters))
+		return -SYS_EBUSY;
+	G_KOBJ[id].type = KOBJ_FREE;
+	return 0;
+}
+
+void kobj_pin(u64 id)
+{
+	G_KOBJ[id].pinned = 1;
+	G_KOBJ[id].owner = NULL;
+}
+
+// only threads of as could wait on its objects, none is left
+void kobj_as_exit(aspace_t *as)
+{
+	u32 i;
+
+	for (i = 0; i < KOBJ_MAX; ++i) {
+		if (G_KOBJ[i].type != KOBJ_FREE && !G_KOBJ[i].pinned &&
+			G_KOBJ[i].owner == as)
+			G_KOBJ[i].type = KOBJ_FREE;
+	}
+}
+
+/*
+ * Block the caller on o until woken or until (ticks). The wakeup writes
+ * the result into the caller's x0 after this returns to take_syscall.
+ */
+static s64 kobj_block(kobj_t *o, proc_t *p, u64 until)
+{
+	if (until == KOBJ_NOWAIT)
+		return -SYS_EAGAIN;
+	if (until != KOBJ_FOREVER && until <= time_now_ticks())
+		return -SYS_ETIMEDOUT;
+	if (heap_push(&o->waiters, p->eff_deadline, p))
+		return -SYS_ENOSPC;
+
+	p->wait_obj = o;
+	sched_yield(&G_SCHED);
+	p->state = PROC_WAITING;
+	if (until != KOBJ_FOREVER)
+		sched_sleep(&G_SCHED, p, until);
+	return 0;
+}
+
+static proc_t *kobj_pop(kobj_t *o)
+{
+	proc_t *p;
+	u64 dl;
+
+	heap_pop(&o->waiters, &dl, (void**)&p);
+	return p;
+}
+
+// readies p, the caller makes the one sched() decision afterwards
+static void kobj_wake(proc_t *p, s64 r)
+{
+	p->ctx.x[0] = r;
+	p->wait_obj = NULL;
+	sched_unsleep(&G_SCHED, p);
+	p->state = PROC_READY;
+	sched_ready_proc(&G_SCHED, p->pid);
+}
+
+void kobj_timeout(proc_t *p)
+{
+	kobj_t *o;
+	proc_t *w;
+	u64 dl;
+
+	o = p->wait_obj;
+	heap_remove(&o->waiters, p->obj_idx, &dl, (void**)&w);
+	p->wait_obj = NULL;
+	p->ctx.x[0] = -SYS_ETIMEDOUT;
+}
+
+/* message queues, a message travels in x1..x4 */
+
+static inline void msg_copy(u64 *dst, const u64 *src)
+{
+	dst[0] = src[0];
+	dst[1] = src[1];
+	dst[2] = src[2];
+	dst[3] = src[3];
+}
+
+s64 mq_create(proc_t *p, u64 depth)
+{
+	kobj_t *o;
+	s64 id;
+
+	if (!depth || depth > MQ_DEPTH_MAX)
+		return -SYS_EINVAL;
+	id = kobj_alloc(p, KOBJ_MQ, &o);
+	if (id < 0)
+		return id;
+	o->mq.head = 0;
+	o->mq.len = 0;
+	o->mq.depth = depth;
+	o->mq.senders = 0;
+	return id;
+}
+
+static void mq_push(kobj_t *o, const u64 *msg)
+{
+	msg_copy(o->mq.msg[(o->mq.head + o->mq.len) % o->mq.depth], msg);
+	o->mq.len++;
+}
+
+s64 mq_send(proc_t *p, u64 id, u64 until)
+{
+	kobj_t *o;
+	proc_t *r;
+
+	o = kobj_get(p->as, id, KOBJ_MQ);
+	if (!o)
+		return -SYS_EINVAL;
+
+	if (o->mq.len < o->mq.depth) {
+		// receivers only wait on an empty queue: hand it over
+		if (!heap_empty(&o->waiters)) {
+			r = kobj_pop(o);
+			msg_copy(&r->ctx.x[1], &p->ctx.x[1]);
+			kobj_wake(r, 0);
+			sched(&G_SCHED, sched_switch_irq);
+			return 0;
+		}
+		mq_push(o, &p->ctx.x[1]);
+		return 0;
+	}
+
+	o->mq.senders = 1;
+	return kobj_block(o, p, until);
+}
+
+s64 mq_recv(proc_t *p, u64 id, u64 until)
+{
+	kobj_t *o;
+	proc_t *s;
+
+	o = kobj_get(p->as, id, KOBJ_MQ);
+	if (!o)
+		return -SYS_EINVAL;
+
+	if (o->mq.len) {
+		msg_copy(&p->ctx.x[1], o->mq.msg[o->mq.head]);
+		o->mq.head = (o->mq.head + 1) % o->mq.depth;
+		o->mq.len--;
+		// a slot opened up for the most urgent blocked sender
+		if (o->mq.senders && !heap_empty(&o->waiters)) {
+			s = kobj_pop(o);
+			mq_push(o, &s->ctx.x[1]);
+			kobj_wake(s, 0);
+			sched(&G_SCHED, sched_switch_irq);
+		}
+		return 0;
+	}
+
+	o->mq.senders = 0;
+	return kobj_block(o, p, until);
+}
+
+/* counting semaphores */
+
+s64 sem_create(proc_t *p, u64 count)
+{
+	kobj_t *o;
+	s64 id;
+
+	id = kobj_alloc(p, KOBJ_SEM, &o);
+	if (id < 0)
+		return id;
+	o->sem.count = count;
+	return id;
+}
+
+s64 sem_wait(proc_t *p, u64 id, u64 until)
+{
+	kobj_t *o;
+
+	o = kobj_get(p->as, id, KOBJ_SEM);
+	if (!o)
+		return -SYS_EINVAL;
+
+	if (o->sem.count) {
+		o->sem.count--;
+		return 0;
+	}
+	return kobj_block(o, p, until);
+}
+
+s64 sem_post(proc_t *p, u64 id)
+{
+	kobj_t *o;
+
+	o = kobj_get(p->as, id, KOBJ_SEM);
+	if (!o)
+		return -SYS_EINVAL;
+
+	// the count only grows while nobody waits
+	if (heap_empty(&o->waiters)) {
+		o->sem.count++;
+		return 0;
+	}
+	kobj_wake(kobj_pop(o), 0);
+	sched(&G_SCHED, sched_switch_irq);
+	return 0;
+}
+
+/* event flags, waiters pass mask in x1 and mode in x2 */
+
+s64 flags_create(proc_t *p)
+{
+	kobj_t *o;
+	s64 id;
+
+	id = kobj_alloc(p, KOBJ_FLAGS, &o);
+	if (id < 0)
+		return id;
+	o->flags.bits = 0;
+	return id;
+}
+
+static bool flags_match(u64 bits, u64 mask, u64 mode)
+{
+	if (mode & FLAGS_ALL)
+		return (bits & mask) == mask;
+	return (bits & mask) != 0;
+}
+
+s64 flags_wait(proc_t *p, u64 id, u64 mask, u64 mode, u64 until)
+{
+	kobj_t *o;
+	u64 got;
+
+	o = kobj_get(p->as, id, KOBJ_FLAGS);
+	if (!o)
+		return -SYS_EINVAL;
+	// results come back in x0 next to negative errors
+	if (!mask || (mask >> 63))
+		return -SYS_EINVAL;
+
+	if (flags_match(o->flags.bits, mask, mode)) {
+		got = o->flags.bits & mask;
+		if (mode & FLAGS_CONSUME)
+			o->flags.bits &= ~got;
+		return got;
+	}
+	return kobj_block(o, p, until);
+}
+
+/*
+ * Every satisfied waiter sees the bits as set here, consumed bits are
+ * cleared once all of them have been collected.
+ */
+s64 flags_raise(aspace_t *as, u64 id, u64 bits)
+{
+	proc_t *hit[KOBJ_WAIT_MAX];
+	kobj_t *o;
+	proc_t *w;
+	u64 consume, mask, mode, dl;
+	size_t i, n;
+
+	o = kobj_get(as, id, KOBJ_FLAGS);
+	if (!o)
+		return -SYS_EINVAL;
+
+	o->flags.bits |= bits;
+	consume = 0;
+	n = 0;
+	for (i = 0; i < o->waiters.len; ++i) {
+		w = o->waiters.a[i].val;
+		mask = w->ctx.x[1];
+		mode = w->ctx.x[2];
+		if (flags_match(o->flags.bits, mask, mode))
+			hit[n++] = w;
+	}
+	for (i = 0; i < n; ++i) {
+		w = hit[i];
+		mask = w->ctx.x[1];
+		mode = w->ctx.x[2];
+		if (mode & FLAGS_CONSUME)
+			consume |= o->flags.bits & mask;
+		heap_remove(&o->waiters, w->obj_idx, &dl, (void**)&w);
+		kobj_wake(w, o->flags.bits & mask);
+	}
+	o->flags.bits &= ~consume;
+	return n;
+}
+
+s64 flags_set(proc_t *p, u64 id, u64 bits)
+{
+	s64 n;
+
+	n = flags_raise(kobj_as(p), id, bits);
+	if (n > 0)
+		sched(&G_SCHED, sched_switch_irq);
+	return n < 0 ? n : 0;
+}
+
+s64 flags_clear(proc_t *p, u64 id, u64 bits)
+{
+	kobj_t *o;
+
+	o = kobj_get(p->as, id, KOBJ_FLAGS);
+	if (!o)
+		return -SYS_EINVAL;
+	o->flags.bits &= ~bits;
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _KOBJ_H_
+#define _KOBJ_H_
+
+#include "types.h"
+#include "heap_structs.h"
+#include "sched_structs.h"
+#include "syscall_table.h"
+
+/*
+ * Asynchronous kernel objects: message queues, counting semaphores and
+ * event flag groups.
+ *
+ * All of them live in a fixed pool and carry their storage inline, so
+ * nothing is allocated after create. Blocked procs sit in the object's
+ * waiter heap ordered by deadline and, with a timeout, on the scheduler
+ * timing wheel as well. Whichever fires first takes them out of the
+ * other. A post wakes the earliest deadline waiter in O(log n) and the
+ * syscall makes one sched() call at the end.
+ *
+ * An object belongs to the process that created it, only its threads
+ * reach it and it is freed when the last of them exits. Pinned objects
+ * belong to the kernel and are open to every process.
+ */
+
+#define KOBJ_MAX	(64)
+#define KOBJ_WAIT_MAX	(16)
+#define MQ_DEPTH_MAX	(16)
+#define MQ_MSG_WORDS	(4)	/* a message is x1..x4 */
+
+typedef enum kobj_type {
+	KOBJ_FREE,
+	KOBJ_MQ,
+	KOBJ_SEM,
+	KOBJ_FLAGS
+} kobj_type_t;
+
+typedef struct kobj {
+	kobj_type_t type;
+	u32 pinned;		/* owned by the kernel, can not be destroyed */
+	aspace_t *owner;	/* creating process, NULL once pinned */
+	heap_node_t wn[KOBJ_WAIT_MAX];
+	minheap_t waiters;	/* by eff_deadline */
+	union {
+		struct {
+			u32 head;
+			u32 len;
+			u32 depth;
+			u32 senders;	/* waiters are senders, the queue is full */
+			u64 msg[MQ_DEPTH_MAX][MQ_MSG_WORDS];
+		} mq;
+		struct {
+			u64 count;
+		} sem;
+		struct {
+			u64 bits;
+		} flags;
+	};
+} kobj_t;
+
+/*
+ * p is the calling proc. The kernel passes NULL for its own objects,
+ * flags_raise takes the process the raise is done for.
+ */
+void kobj_init(void);
+s64 kobj_destroy(proc_t *p, u64 id);
+void kobj_pin(u64 id);
+// the last thread of as is exiting: free its objects
+void kobj_as_exit(aspace_t *as);
+
+s64 mq_create(proc_t *p, u64 depth);
+s64 mq_send(proc_t *p, u64 id, u64 until);
+s64 mq_recv(proc_t *p, u64 id, u64 until);
+
+s64 sem_create(proc_t *p, u64 count);
+s64 sem_wait(proc_t *p, u64 id, u64 until);
+s64 sem_post(proc_t *p, u64 id);
+
+s64 flags_create(proc_t *p);
+s64 flags_wait(proc_t *p, u64 id, u64 mask, u64 mode, u64 until);
+s64 flags_set(proc_t *p, u64 id, u64 bits);
+s64 flags_clear(proc_t *p, u64 id, u64 bits);
+// flags_set for timer callbacks: no sched() call, returns procs woken
+s64 flags_raise(aspace_t *as, u64 id, u64 bits);
+
+// timer_fn: p's timeout expired while blocked on p->wait_obj
+void kobj_timeout(proc_t *p);
+
+#endif
@@ -0,0 +1,201 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "ktimer.h"
+#include "twheel.h"
+#include "timer.h"
+#include "syscall_table.h"
+#include "../shared/hist.h"
+
+/*
+ * Early wake compensation. CNTP is set g_early ticks ahead of the first
+ * expiry and ktimer_expire() spins out the rest on CNTPCT, so the trip
+ * from the comparator through timer_fn to the switch is taken before
+ * the expiry rather than after it. g_early is a percentile of that trip
+ * as measured at dispatch, kept over a decaying histogram so it follows
+ * the load. Calibration runs with compensation off too.
+ */
+#define KT_CALIB_EVERY		64	/* samples between recomputes */
+#define KT_EARLY_PERMILLE	990	/* default: early enough for 99% */
+#define KT_EARLY_MAX_US		200	/* never spin longer */
+
+static u32 g_calib[JRT_HIST_BUCKETS];
+static u64 g_calib_count;
+static u32 g_calib_new;
+static u32 g_permille;
+static bool g_comp;		/* compensation on */
+static u64 g_early;		/* ticks */
+static u64 g_base;		/* compare value that fired, plus the spin */
+
+static twheel_t g_ktimers;
+static u64 g_armed;		/* CNTP compare value, ~0: off, 0: fired */
+static bool g_expiring;		/* in ktimer_expire, program once at the end */
+static tw_node_t *g_batch;	/* expired, callbacks not run yet */
+
+void ktimer_init(void)
+{
+	tw_init(&g_ktimers);
+	g_armed = ~0ull;
+	g_expiring = false;
+	g_batch = NULL;
+	g_permille = KT_EARLY_PERMILLE;
+	g_comp = true;
+	g_early = 0;
+	g_calib_count = 0;
+	g_calib_new = 0;
+}
+
+static inline u64 ktimer_lead(void)
+{
+	return g_comp ? g_early : 0;
+}
+
+static void ktimer_program(void)
+{
+	u64 next;
+
+	if (g_expiring)
+		return;
+	next = tw_next(&g_ktimers);
+	if (next == g_armed)
+		return;
+	g_armed = next;
+	if (next != ~0ull)
+		timer_schedule_at_ticks(next - ktimer_lead());
+	else
+		timer_cancel();
+}
+
+u64 ktimer_next(void)
+{
+	return tw_next(&g_ktimers);
+}
+
+void ktimer_setup(ktimer_t *t, ktimer_fn_t fn)
+{
+	tw_node_init(&t->node);
+	t->fn = fn;
+	t->period = 0;
+	t->due = false;
+}
+
+// a callback stopped or restarted a timer of the batch still to run
+static void ktimer_unbatch(ktimer_t *t)
+{
+	tw_node_t **pp;
+
+	for (pp = &g_batch; *pp; pp = &(*pp)->next) {
+		if (*pp == &t->node) {
+			*pp = t->node.next;
+			break;
+		}
+	}
+	t->due = false;
+}
+
+void ktimer_start(ktimer_t *t, u64 expires, u64 period)
+{
+	if (t->due)
+		ktimer_unbatch(t);
+	tw_del(&g_ktimers, &t->node);
+	t->period = period;
+	tw_add(&g_ktimers, &t->node, expires);
+	ktimer_program();
+}
+
+void ktimer_stop(ktimer_t *t)
+{
+	if (t->due)
+		ktimer_unbatch(t);
+	if (!tw_queued(&t->node))
+		return;
+	tw_del(&g_ktimers, &t->node);
+	ktimer_program();
+}
+
+bool ktimer_expire(struct ctx *c, u64 now)
+{
+	tw_node_t *n;
+	ktimer_t *t;
+	u64 at, next;
+	bool ready;
+
+	g_base = sys_mrs_cntp_cval();
+	next = tw_next(&g_ktimers);
+	// woken early on purpose: spin out the rest, nothing is released early
+	if (next > now && next - now <= ktimer_lead()) {
+		at = now;
+		while ((now = time_now_ticks()) < next)
+			;
+		g_base += now - at;
+	}
+
+	g_expiring = true;
+	// CNTP fired and stays asserted, always program or cancel it below
+	g_armed = 0;
+	tw_expire(&g_ktimers, now, &g_batch);
+	for (n = g_batch; n; n = n->next)
+		((ktimer_t *)n)->due = true;
+
+	ready = false;
+	while ((n = g_batch)) {
+		g_batch = n->next;
+		t = (ktimer_t *)n;
+		t->due = false;
+		if (t->period) {
+			// periods missed while late are dropped, not replayed
+			at = n->expires + t->period;
+			if (at <= now)
+				at += ((now - at) / t->period + 1) * t->period;
+			tw_add(&g_ktimers, n, at);
+		}
+		if (t->fn(t, c, now))
+			ready = true;
+	}
+	g_expiring = false;
+	ktimer_program();
+	return ready;
+}
+
+u64 ktimer_base(void)
+{
+	return g_base;
+}
+
+void ktimer_calib(u64 lat)
+{
+	u64 want, seen, max;
+	u32 i;
+
+	g_calib[jrt_hist_index(lat)]++;
+	g_calib_count++;
+	if (++g_calib_new < KT_CALIB_EVERY)
+		return;
+	g_calib_new = 0;
+
+	want = (g_calib_count * g_permille + 999) / 1000;
+	seen = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS - 1; ++i) {
+		seen += g_calib[i];
+		if (seen >= want)
+			break;
+	}
+	max = ticks_from_us(KT_EARLY_MAX_US);
+	g_early = jrt_hist_value(i) < max ? jrt_hist_value(i) : max;
+
+	// halve the history, recent wakeups weigh the most
+	g_calib_count = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS; ++i) {
+		g_calib[i] >>= 1;
+		g_calib_count += g_calib[i];
+	}
+}
+
+s64 ktimer_comp(u64 permille)
+{
+	if (permille > 1000)
+		return -SYS_EINVAL;
+	g_comp = permille != 0;
+	if (g_comp)
+		g_permille = permille;
+	// the next recompute uses it, the lead changes with the next program
+	return g_early;
+}
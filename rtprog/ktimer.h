@@ -0,0 +1,45 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _KTIMER_H_
+#define _KTIMER_H_
+
+#include "types.h"
+#include "ktimer_structs.h"
+
+/*
+ * Kernel timers. CNTP has one comparator, every user of it arms a
+ * ktimer instead: the scheduler's wakeups and deadline timers, the
+ * process timers of utimer.c and the periodic tick of timer.c all go
+ * on one timing wheel and CNTP is always set to its earliest expiry.
+ *
+ * Callbacks run from timer_fn with the batch still open, so timers they
+ * start or stop only reprogram CNTP once the batch is done. timer_fn
+ * makes one sched() decision for everything the batch readied.
+ */
+
+void ktimer_init(void);
+void ktimer_setup(ktimer_t *t, ktimer_fn_t fn);
+// (re)arm t at expires, then every period ticks if period is not 0
+void ktimer_start(ktimer_t *t, u64 expires, u64 period);
+void ktimer_stop(ktimer_t *t);
+// earliest expiry armed, ~0 when none
+u64 ktimer_next(void);
+static inline bool ktimer_active(const ktimer_t *t)
+{
+	return t->node.slot != TW_NO_SLOT || t->due;
+}
+// timer_fn: run every timer due by now, true if any of them readied a proc
+bool ktimer_expire(struct ctx *c, u64 now);
+
+/*
+ * Early wake compensation: CNTP goes off ahead of time by a calibrated
+ * percentile of the timer to dispatch latency and the remainder is spun
+ * out. ktimer_base() is where the running batch's latency starts,
+ * ktimer_calib() takes one dispatch latency sample from there.
+ * ktimer_comp() sets the percentile in per mille, 0 turns it off, and
+ * returns the compensation calibrated so far, in ticks.
+ */
+u64 ktimer_base(void);
+void ktimer_calib(u64 lat);
+s64 ktimer_comp(u64 permille);
+
+#endif
@@ -0,0 +1,21 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _KTIMER_STRUCTS_H_
+#define _KTIMER_STRUCTS_H_
+
+#include "types.h"
+#include "twheel_structs.h"
+
+struct ctx;
+struct ktimer;
+
+// runs in the timer interrupt, true if it made a proc ready
+typedef bool (*ktimer_fn_t)(struct ktimer *t, struct ctx *c, u64 now);
+
+typedef struct ktimer {
+	tw_node_t node;		/* on the CNTP queue while armed */
+	ktimer_fn_t fn;
+	u64 period;		/* ticks, 0: one shot */
+	bool due;		/* expired, callback not run yet */
+} ktimer_t;
+
+#endif
@@ -185,33 +185,70 @@ static inline void map_gic(pt_root_t r)
 }
 // ---------- Builders ----------
 
+// Kernel root, its [CODE_0, MEM_END] subtree is linked into every process
+static pt_root_t G_KERN_ROOT;
+
+// 1 GiB L1 slots covering [CODE_0, MEM_END]
+#define SHARED_L1_FIRST	(CODE_0 & ~((1ULL << 30) - 1))
+#define SHARED_L1_LAST	(MEM_END & ~((1ULL << 30) - 1))
+
+// Link the kernel's tables for [CODE_0, MEM_END] instead of copying them:
+// no page-table memory per process and the kernel stays mapped, so traps
+// don't need to switch to the kernel map.
+static void share_kernel(pt_root_t r)
+{
+	u64 va, *kl1, *l1;
+
+	KASSERT(G_KERN_ROOT.l0);
+	for (va = SHARED_L1_FIRST; va <= SHARED_L1_LAST; va += 1ULL << 30) {
+		kl1 = (u64*)(G_KERN_ROOT.l0[idx_l0(va)] & ~0xFFFULL);
+		l1 = ensure_next(r.l0, idx_l0(va));
+		KASSERT(!valid(l1[idx_l1(va)]));
+		l1[idx_l1(va)] = kl1[idx_l1(va)];
+	}
+}
+
+// Unlink the shared kernel subtree so pt_root_free leaves it alone
+static void unshare_kernel(pt_root_t r)
+{
+	u64 va, d, *l1;
+
+	if (r.l0 == G_KERN_ROOT.l0)
+		return;
+	for (va = SHARED_L1_FIRST; va <= SHARED_L1_LAST; va += 1ULL << 30) {
+		d = r.l0[idx_l0(va)];
+		if (!valid(d))
+			continue;
+		l1 = (u64*)(d & ~0xFFFULL);
+		l1[idx_l1(va)] = 0;
+	}
+}
+
 // Per-process map:
-//   [0, CODE_0)  →  [proc_base, proc_base+CODE_0)   (RWX, nG=1)
-//   [CODE_0, __kernel_end) → identity (RWX, global)
-//   [MEM_0, MEM_END]       → identity (RWX, global)
-//   Everything else unmapped (so other procs aren't visible).
-void build_process_map(pt_root_t r, u64 proc_base_pa, u64 proc_image_len)
+//   [0, CODE_0)  →  [proc_base, proc_base+CODE_0)   (attrs, nG=1)
+//   [CODE_0, MEM_END] → kernel tables (RWX, global), shared
+//   UART, GIC → identity (device, global)
+// Procs run at EL1, so the kernel mapping is no protection loss.
+static void build_process_common(pt_root_t r)
+{
+	share_kernel(r);
+	map_uart(r);
+	map_gic(r);
+}
+
+void build_process_map(pt_root_t r, u64 proc_base_pa, u64 proc_image_len, u64 attrs)
 {
-	u64 low_len, k_end;
+	u64 low_len;
 
 	low_len = CODE_0;
 	if (proc_image_len < low_len)
 		low_len = proc_image_len;
 
-	// Low window (per-proc)
-	map_range_pages(r, 0, proc_base_pa, low_len, PTE_PROC_RWX);
-
-	// Kernel identity
-	k_end = (u64)__kernel_end;
-	if (proc_base_pa < k_end)
-		k_end = proc_base_pa;
-	if (k_end > CODE_0)
-		map_range_pages(r, CODE_0, CODE_0, k_end - CODE_0, PTE_KERN_RWX);
+	// Low window (per-proc), must stay below the shared kernel slots
+	KASSERT(low_len <= SHARED_L1_FIRST);
+	map_range_pages(r, 0, proc_base_pa, low_len, attrs);
 
-	// Allocator identity
-	map_range_pages(r, MEM_0, MEM_0, (MEM_END + 1ULL) - MEM_0, PTE_KERN_RWX);
-
-	map_uart(r);
+	build_process_common(r);
 }
 
 // Kernel master map (used only while running kernel):
@@ -229,12 +266,24 @@ void build_kernel_map(pt_root_t r)
 // ---------- Map handles ----------
 typedef struct { pt_root_t root; u16 asid; } _map_any_t;
 
-mmu_map_t proc_map_create(u64 proc_base_pa, u64 image_len, u16 asid)
+mmu_map_t proc_map_create(u64 proc_base_pa, u64 image_len, u16 asid, u64 attrs)
 {
 	pt_root_t r;
 	mmu_map_t pm;
 	r = pt_root_new();
-	build_process_map(r, proc_base_pa, image_len);
+	build_process_map(r, proc_base_pa, image_len, attrs);
+	pm = (mmu_map_t){ .root = r, .asid = asid };
+	return pm;
+}
+
+// Process map without an image, the caller maps the segments below CODE_0
+mmu_map_t proc_map_create_base(u16 asid)
+{
+	pt_root_t r;
+	mmu_map_t pm;
+
+	r = pt_root_new();
+	build_process_common(r);
 	pm = (mmu_map_t){ .root = r, .asid = asid };
 	return pm;
 }
@@ -247,6 +296,7 @@ mmu_map_t kern_map_create(u16 asid)
 	r = pt_root_new();
 	build_kernel_map(r);
 	km = (mmu_map_t){ .root = r, .asid = asid };
+	G_KERN_ROOT = r;
 	return km;
 }
 // ---- internal walker: free table pages, never data frames ----
@@ -287,21 +337,35 @@ void pt_root_free(pt_root_t r)
 	free_table_level(r.l0, 0);
 }
 
+// what TTBR0 holds right now
+static mmu_map_t G_ACTIVE;
+
 void mmu_map_switch(const mmu_map_t *pm)
 {
-	// If reusing ASIDs, TLBI that ASID first:
-	// tlbi_asid(pm->asid); dsb ish; isb();
-	//
+	// threads of one process (and instances of one image) share a map,
+	// switching between them leaves TTBR0 alone
+	if (pm->root.l0_pa == G_ACTIVE.root.l0_pa && pm->asid == G_ACTIVE.asid)
+		return;
+	// ASIDs are reused per image slot, image.c TLBIs them on eviction
 	//uart_puts("[MMU] switch:\n");
 	//dump_map(pm);
 	write_ttbr0_asid(pm->root.l0_pa, pm->asid);
+	G_ACTIVE = *pm;
 	// global kernel entries remain valid; ISB suffices.
 }
 
 void mmu_map_destroy(mmu_map_t *km)
 {
+	mmu_map_t kern;
+
 	if (!km)
 		return;
+	// never free the tables we are running on
+	if (km->root.l0_pa == G_ACTIVE.root.l0_pa) {
+		kern = (mmu_map_t){ .root = G_KERN_ROOT, .asid = 0 };
+		mmu_map_switch(&kern);
+	}
+	unshare_kernel(km->root);
 	pt_root_free(km->root);
 	km->root.l0 = NULL;
 	km->root.l0_pa = 0;
@@ -316,6 +380,7 @@ void mmu_enable(mmu_map_t *m)
 	G_MAIR = make_mair_el1();
 	G_TCR = make_tcr_el1(VA_BITS, PA_BITS, /*enable_ttbr1=*/false);
 	el1_mmu_on(G_MAIR, G_TCR, m->root.l0_pa);
+	G_ACTIVE = *m;
 }
 
 
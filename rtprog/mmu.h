@@ -74,6 +74,20 @@ extern char __kernel_end[];
 			PTE_AP_RW_EL1|PTE_ATTRIDX(MAIR_IDX_NORMAL) | \
 			PTE_UXN|PTE_nG)
 
+// Shared (cached) images: read-only, still executable at EL1
+#define PTE_PROC_RX (PTE_VALID|DESC_PAGE|PTE_AF|PTE_SH_INNER| \
+			PTE_AP_RO_EL1|PTE_ATTRIDX(MAIR_IDX_NORMAL) | \
+			PTE_UXN|PTE_nG)
+
+// ELF segments: data is never executable
+#define PTE_PROC_RO (PTE_VALID|DESC_PAGE|PTE_AF|PTE_SH_INNER| \
+			PTE_AP_RO_EL1|PTE_ATTRIDX(MAIR_IDX_NORMAL) | \
+			PTE_UXN|PTE_PXN|PTE_nG)
+
+#define PTE_PROC_RW (PTE_VALID|DESC_PAGE|PTE_AF|PTE_SH_INNER| \
+			PTE_AP_RW_EL1|PTE_ATTRIDX(MAIR_IDX_NORMAL) | \
+			PTE_UXN|PTE_PXN|PTE_nG)
+
 #define PTE_DEV_RW_G  (PTE_VALID | DESC_PAGE | PTE_AF | PTE_SH_OUTER | \
 			PTE_AP_RW_EL1 | PTE_ATTRIDX(MAIR_IDX_DEVICE) | \
 			PTE_UXN | PTE_PXN /* nG=0 → global */)
@@ -93,16 +107,18 @@ void      map_range_pages(pt_root_t r, u64 va, u64 pa, u64 len, u64 attrs);
 
 // ==== High-level builders ====
 void build_kernel_map(pt_root_t r);                       // identity map kernel + allocator, RWX
-void build_process_map(pt_root_t r, u64 proc_base_pa, u64 proc_image_len);
+void build_process_map(pt_root_t r, u64 proc_base_pa, u64 proc_image_len, u64 attrs);
 
 // ==== EL1 MMU control ====
 void el1_mmu_on(u64 mair, u64 tcr, u64 ttbr0_pa);
 void write_ttbr0_asid(u64 ttbr0_pa, u16 asid);
 void tlbi_all(void);
 void tlbi_asid(u16 asid);
+void dcache_clean_inval_all(void);
 
 // ==== Process map handle & switch ====
-mmu_map_t proc_map_create(u64 proc_base_pa, u64 image_len, u16 asid);
+mmu_map_t proc_map_create(u64 proc_base_pa, u64 image_len, u16 asid, u64 attrs);
+mmu_map_t proc_map_create_base(u16 asid);
 mmu_map_t kern_map_create(u16 asid);
 void mmu_map_switch(const mmu_map_t *pm);
 
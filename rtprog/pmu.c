@@ -0,0 +1,201 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "pmu.h"
+#include "string.h"
+#include "memory_layout.h"
+
+#define PMCR_E		(1u << 0)
+#define PMCR_P		(1u << 1)	/* reset the event counters */
+#define PMCR_LC		(1u << 6)	/* cycle counter overflows at 64 bits */
+#define PMCR_N(v)	(((v) >> 11) & 0x1f)
+#define PMU_CYCLES	(1u << 31)	/* PMCCNTR in the PMxxSET/CLR masks */
+
+static struct jrt_stats_page *g_stats = (void*)STATS_PAGE_ADDR;
+static bool g_has;
+static u32 g_nevt;		/* event counters in use */
+static u64 g_bias;		/* pmu_ccnt_write() moves, see there */
+static u64 g_last_cyc;
+static u32 g_last_evt[JRT_PMU_EVENTS];
+
+static const u32 g_default[JRT_PMU_EVENTS] = {
+	JRT_PMU_INST_RETIRED,
+	JRT_PMU_L1D_REFILL,
+	JRT_PMU_L2D_REFILL,
+	JRT_PMU_L1D_TLB_REFILL,
+};
+
+// PMUVer: 0 none, 0xf IMPLEMENTATION DEFINED, neither is usable here
+static bool pmu_present(void)
+{
+	u64 v;
+
+	asm volatile("mrs %0, ID_AA64DFR0_EL1" : "=r"(v));
+	v = (v >> 8) & 0xf;
+	return v && v != 0xf;
+}
+
+static u32 pmu_evcnt_read(u32 i)
+{
+	u64 v;
+
+	switch (i) {
+	case 0: asm volatile("mrs %0, PMEVCNTR0_EL0" : "=r"(v)); break;
+	case 1: asm volatile("mrs %0, PMEVCNTR1_EL0" : "=r"(v)); break;
+	case 2: asm volatile("mrs %0, PMEVCNTR2_EL0" : "=r"(v)); break;
+	default: asm volatile("mrs %0, PMEVCNTR3_EL0" : "=r"(v)); break;
+	}
+	return (u32)v;
+}
+
+// count at EL0 and EL1, JRT runs processes at EL1 as well
+static void pmu_evtype_write(u32 i, u64 ev)
+{
+	switch (i) {
+	case 0: asm volatile("msr PMEVTYPER0_EL0, %0" :: "r"(ev)); break;
+	case 1: asm volatile("msr PMEVTYPER1_EL0, %0" :: "r"(ev)); break;
+	case 2: asm volatile("msr PMEVTYPER2_EL0, %0" :: "r"(ev)); break;
+	default: asm volatile("msr PMEVTYPER3_EL0, %0" :: "r"(ev)); break;
+	}
+}
+
+// common events 0..63 are advertised in PMCEID0/1
+static bool pmu_event_ok(u32 ev)
+{
+	u64 v;
+
+	if (ev >= 64)
+		return false;
+	if (ev < 32)
+		asm volatile("mrs %0, PMCEID0_EL0" : "=r"(v));
+	else
+		asm volatile("mrs %0, PMCEID1_EL0" : "=r"(v));
+	return (v >> (ev & 31)) & 1;
+}
+
+u64 pmu_ccnt_read(void)
+{
+	u64 v;
+
+	asm volatile("mrs %0, PMCCNTR_EL0" : "=r"(v));
+	return v + g_bias;
+}
+
+/*
+ * Whoever loads the cycle counter keeps the virtual count going: the
+ * bias absorbs the jump, pmu_ccnt_read() never sees it.
+ */
+void pmu_ccnt_write(u64 v)
+{
+	u64 cur;
+
+	asm volatile("mrs %0, PMCCNTR_EL0" : "=r"(cur));
+	g_bias += cur - v;
+	asm volatile("msr PMCCNTR_EL0, %0" :: "r"(v));
+}
+
+bool pmu_has(void)
+{
+	return g_has;
+}
+
+/*
+ * Program sel[] onto the event counters, in order, dropping events the
+ * core does not implement. Event totals restart under the new gen.
+ */
+static void pmu_program(const u32 *sel, u32 gen)
+{
+	struct jrt_pmu_cfg *cfg;
+	struct jrt_pmu_stats *s;
+	u64 pmcr, en;
+	u32 i, n, ncnt;
+
+	cfg = &g_stats->pmu_cfg;
+	asm volatile("mrs %0, PMCR_EL0" : "=r"(pmcr));
+	ncnt = PMCR_N(pmcr);
+
+	asm volatile("msr PMCNTENCLR_EL0, %0" :: "r"((u64)((1u << JRT_PMU_EVENTS) - 1)));
+	__atomic_store_n(&cfg->seq, cfg->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	en = 0;
+	n = 0;
+	for (i = 0; i < JRT_PMU_EVENTS; ++i) {
+		cfg->event[i] = JRT_PMU_NONE;
+		if (i >= ncnt || sel[i] == JRT_PMU_NONE || !pmu_event_ok(sel[i]))
+			continue;
+		pmu_evtype_write(i, sel[i]);
+		cfg->event[i] = sel[i];
+		en |= 1u << i;
+		n = i + 1;
+	}
+	cfg->ncounters = ncnt;
+	cfg->gen = gen;
+	__atomic_store_n(&cfg->seq, cfg->seq + 1, __ATOMIC_RELEASE);
+
+	for (i = 0; i < JRT_STATS_PROCS; ++i) {
+		s = &g_stats->pmu[i];
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memset(s->event, 0, sizeof(s->event));
+		s->gen = gen;
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+	}
+
+	asm volatile("msr PMCR_EL0, %0" :: "r"(pmcr | PMCR_E | PMCR_LC | PMCR_P));
+	asm volatile("msr PMCNTENSET_EL0, %0" :: "r"(en | PMU_CYCLES));
+	asm volatile("isb");
+	g_nevt = n;
+	for (i = 0; i < g_nevt; ++i)
+		g_last_evt[i] = pmu_evcnt_read(i);
+}
+
+void pmu_init(void)
+{
+	struct jrt_pmu_cfg *cfg;
+	u32 i;
+
+	cfg = &g_stats->pmu_cfg;
+	g_has = pmu_present();
+	for (i = 0; i < JRT_PMU_EVENTS; ++i)
+		cfg->event[i] = JRT_PMU_NONE;
+	if (!g_has) {
+		cfg->flags = 0;
+		return;
+	}
+	asm volatile("msr PMCCFILTR_EL0, %0" :: "r"((u64)0));
+	pmu_program(g_default, cfg->sel_gen);
+	cfg->flags = JRT_PMU_CYCLES;
+	g_last_cyc = pmu_ccnt_read();
+}
+
+void pmu_switch(proc_t *c, proc_t *n)
+{
+	struct jrt_pmu_stats *s;
+	u32 evt[JRT_PMU_EVENTS];
+	u32 i, gen;
+	u64 cyc;
+
+	if (!g_has)
+		return;
+
+	cyc = pmu_ccnt_read();
+	for (i = 0; i < g_nevt; ++i)
+		evt[i] = pmu_evcnt_read(i);
+
+	// the idle proc has no stats slot, its counts are dropped
+	if (c->stats) {
+		s = &g_stats->pmu[c->stats - g_stats->proc];
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		s->cycles += cyc - g_last_cyc;
+		// 32-bit event counters, a slice never wraps one
+		for (i = 0; i < g_nevt; ++i)
+			s->event[i] += (u32)(evt[i] - g_last_evt[i]);
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+	}
+	g_last_cyc = cyc;
+	for (i = 0; i < g_nevt; ++i)
+		g_last_evt[i] = evt[i];
+
+	gen = __atomic_load_n(&g_stats->pmu_cfg.sel_gen, __ATOMIC_ACQUIRE);
+	if (gen != g_stats->pmu_cfg.gen)
+		pmu_program(g_stats->pmu_cfg.sel, gen);
+}
@@ -0,0 +1,29 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_PMU_H_
+#define _JRT_PMU_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "../shared/stats.h"
+
+/*
+ * Per-process PMU counts (jrt_pmu_stats in shared/stats.h). The counters
+ * run freely, a process' virtual counters are what they advanced by
+ * while it was switched in: pmu_switch() charges the progress since the
+ * last switch to the outgoing process (saving its state) and starts the
+ * incoming one from the current values (restoring it). Event selection
+ * changes from Linux are picked up at the next switch.
+ *
+ * Cores without event counters, or without the events asked for, count
+ * cycles only. The cycle counter is shared with the profiler's PMU
+ * source, which moves it through pmu_ccnt_write() so no cycles are lost.
+ */
+
+void pmu_init(void);
+bool pmu_has(void);
+void pmu_switch(proc_t *c, proc_t *n);
+
+u64 pmu_ccnt_read(void);
+void pmu_ccnt_write(u64 v);
+
+#endif
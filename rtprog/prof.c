@@ -0,0 +1,182 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "prof.h"
+#include "sched.h"
+#include "irq.h"
+#include "gic.h"
+#include "timer.h"
+#include "mmu.h"
+#include "pmu.h"
+#include "memory_layout.h"
+
+extern sched_t G_SCHED;
+
+#define PMU_PPI		(23)	/* PMU overflow, QEMU virt */
+#define PMU_CYCLES	(1u << 31)	/* PMCCNTR in the PMxxSET/CLR masks */
+
+static struct jrt_prof_area *g_prof = (void*)PROF_AREA_ADDR;
+static u64 g_period;
+static u64 g_next;		/* CNTV compare value of the next sample */
+
+static inline void cntv_arm(u64 cval)
+{
+	asm volatile("msr CNTV_CVAL_EL0, %0" :: "r"(cval));
+	asm volatile("msr CNTV_CTL_EL0, %0" :: "r"((u64)1));
+	asm volatile("isb");
+}
+
+static inline void cntv_stop(void)
+{
+	asm volatile("msr CNTV_CTL_EL0, %0" :: "r"((u64)0));
+	asm volatile("isb");
+}
+
+// overflow after period more cycles, pmu.c keeps the cycle count whole
+static void pmu_start(u64 period)
+{
+	pmu_ccnt_write(-period);
+	asm volatile("msr PMOVSCLR_EL0, %0" :: "r"((u64)PMU_CYCLES));
+	asm volatile("msr PMINTENSET_EL1, %0" :: "r"((u64)PMU_CYCLES));
+	asm volatile("isb");
+}
+
+// the cycle counter keeps counting for the per-process totals
+static void pmu_stop(void)
+{
+	asm volatile("msr PMINTENCLR_EL1, %0" :: "r"((u64)PMU_CYCLES));
+	asm volatile("msr PMOVSCLR_EL0, %0" :: "r"((u64)PMU_CYCLES));
+	asm volatile("isb");
+}
+
+static bool prof_stack_ok(u64 fp, u64 lo, u64 hi)
+{
+	return !(fp & 7) && fp >= lo && fp + 16 <= hi;
+}
+
+/*
+ * Follow the frame records from x29 while they stay on the interrupted
+ * stack and move up it, anything else ends the walk: a sample must
+ * never fault.
+ */
+static u16 prof_walk(const ctx_t *c, proc_t *p, u64 *out)
+{
+	u64 fp, lo, hi, lr;
+	u16 n;
+
+	lo = c->sp;
+	hi = p == &G_SCHED.p0 ? JRT_STACK_START : p->stack_top;
+	fp = c->x[29];
+	for (n = 0; n < JRT_PROF_DEPTH; ++n) {
+		if (!prof_stack_ok(fp, lo, hi))
+			break;
+		lr = ((u64 *)(uintptr_t)fp)[1];
+		if (!lr)
+			break;
+		out[n] = lr;
+		lo = fp + 16;
+		fp = ((u64 *)(uintptr_t)fp)[0];
+	}
+	return n;
+}
+
+static void prof_sample(ctx_t *c)
+{
+	struct jrt_prof_sample *s;
+	proc_t *p;
+	u32 head;
+
+	head = g_prof->head;
+	if (head - __atomic_load_n(&g_prof->tail, __ATOMIC_ACQUIRE) >=
+			JRT_PROF_SLOTS) {
+		g_prof->dropped++;
+		return;
+	}
+
+	p = G_SCHED.curr;
+	s = &g_prof->s[head & (JRT_PROF_SLOTS - 1)];
+	s->t = time_now_ticks();
+	s->pc = c->pc;
+	s->pid = p->pid;
+	s->flags = 0;
+	if (c->pc >= (uintptr_t)__kernel_start && c->pc < (uintptr_t)__kernel_end)
+		s->flags |= JRT_PROF_S_KERNEL;
+	if (p == &G_SCHED.p0)
+		s->flags |= JRT_PROF_S_IDLE;
+	s->img = p == &G_SCHED.p0 ? 0 : p->pa_pc;
+	s->depth = prof_walk(c, p, s->callers);
+
+	__atomic_store_n(&g_prof->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void prof_timer_irq(ctx_t *c)
+{
+	u64 now;
+
+	prof_sample(c);
+	// keep the rate, but never queue up samples behind a long stall
+	now = time_now_ticks();
+	g_next += g_period;
+	if (g_next <= now)
+		g_next = now + g_period;
+	cntv_arm(g_next);
+}
+
+static void prof_pmu_irq(ctx_t *c)
+{
+	prof_sample(c);
+	asm volatile("msr PMOVSCLR_EL0, %0" :: "r"((u64)PMU_CYCLES));
+	pmu_ccnt_write(-g_period);
+	asm volatile("isb");
+}
+
+static void prof_stop(void)
+{
+	if (g_prof->active == JRT_PROF_TIMER)
+		cntv_stop();
+	else if (g_prof->active == JRT_PROF_PMU)
+		pmu_stop();
+	g_prof->active = JRT_PROF_OFF;
+}
+
+// doorbell from the rtcore module: apply the latest request
+static void prof_ctl_irq(ctx_t *c)
+{
+	u32 seq, source;
+
+	seq = __atomic_load_n(&g_prof->ctl_seq, __ATOMIC_ACQUIRE);
+	source = g_prof->source;
+
+	prof_stop();
+	if (source == JRT_PROF_PMU && (!pmu_has() || !g_prof->cycles))
+		source = JRT_PROF_TIMER;
+	if (source == JRT_PROF_TIMER && g_prof->ticks) {
+		g_period = g_prof->ticks;
+		g_next = time_now_ticks() + g_period;
+		cntv_arm(g_next);
+		g_prof->active = JRT_PROF_TIMER;
+	} else if (source == JRT_PROF_PMU) {
+		g_period = g_prof->cycles;
+		pmu_start(g_period);
+		g_prof->active = JRT_PROF_PMU;
+	}
+	__atomic_store_n(&g_prof->ack_seq, seq, __ATOMIC_RELEASE);
+}
+
+void prof_init(void)
+{
+	g_prof->version = JRT_PROF_VERSION;
+	g_prof->freq = sys_mrs_cntfrq();
+	g_prof->active = JRT_PROF_OFF;
+	g_prof->head = 0;
+	g_prof->dropped = 0;
+	g_prof->tail = 0;
+
+	irq_register_ppi(EL1_VIRT_TIMER_PPI, prof_timer_irq);
+	gic_enable_ppi(EL1_VIRT_TIMER_PPI, 0x80, /*group1ns=*/1);
+	if (pmu_has()) {
+		irq_register_ppi(PMU_PPI, prof_pmu_irq);
+		gic_enable_ppi(PMU_PPI, 0x80, /*group1ns=*/1);
+	}
+	irq_register_spi(PROF_SPI, prof_ctl_irq);
+	gic_enable_spi(PROF_SPI);
+	__atomic_store_n(&g_prof->magic, JRT_PROF_MAGIC, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,17 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_PROF_H_
+#define _JRT_PROF_H_
+
+#include "types.h"
+#include "../shared/prof.h"
+
+/*
+ * JRT side of the sampling profiler in shared/prof.h. prof_init() only
+ * registers the handlers: no source is armed until Linux asks for one,
+ * and stopping disarms it again, so a profiler that is off costs nothing
+ * on any path.
+ */
+
+void prof_init(void);
+
+#endif
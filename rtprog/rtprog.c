@@ -23,6 +23,17 @@
 #include "alloc.h"
 #include "gic.h"
 #include "syscall.h"
+#include "image.h"
+#include "endpoint.h"
+#include "kobj.h"
+#include "xevt.h"
+#include "stats.h"
+#include "deadline.h"
+#include "utimer.h"
+#include "prof.h"
+#include "mmu.h"
+#include "pmu.h"
+#include "color.h"
 
 sched_t G_SCHED;
 alloc_t G_ALLOC;
@@ -97,9 +108,17 @@ void jrt_main(void)
 
 	//set allocator used by mmu
 	mmu_set_alloc(&G_ALLOC);
+	// RT process memory, on the LLC colors Linux is kept off
+	color_init();
 
+	// one CNTP queue for every timer, before anything arms one
+	ktimer_init();
 	// initialize scheduler (also creates kernel mmap)
 	sched_init(&G_SCHED);
+	image_init();
+	ep_init();
+	kobj_init();
+	utimer_init();
 	G_KERNEL_CTX = &G_SCHED.p0.ctx;
 	uart_puts("&G_SCHED: ");
 	uart_puthex((uintptr_t)&G_SCHED);
@@ -112,12 +131,16 @@ void jrt_main(void)
 	uart_puts("\n");
 	// enable mmu with kernel (linear) mmap
 	mmu_enable(&G_SCHED.p0.ctx.mmap);
+	stats_init(&G_SCHED);
+	pmu_init();
 
 	interrupts_enable_all();
 
 	// initialize periodix timer
 	//timer_init();
 	sched_spi_init();
+	xevt_init();
+	prof_init();
 	timer_ppi_init();
 	jrt_loop();
 
@@ -149,45 +172,235 @@ static inline int mpsc_pop(struct mpsc_ring *r, u8 out[TOJRT_REC_SIZE])
 	r->tail = tail + 1;
 	return 0;
 }
-void jrt_exit(void)
+static inline int spsc_push(struct spsc_ring *r, const jrt_done_rec_t *rec)
 {
-	syscall(SYSCALL_EXIT);
+	u32 head;
+
+	head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= FROMJRT_SIZE) {
+		r->dropped++;
+		return -11;
+	}
+
+	memcpy(&r->data[head & FROMJRT_MASK], rec, sizeof(*rec));
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// entered through x30 when a proc returns, x0 holds its return value
+void jrt_exit(u64 status)
+{
+	sys_exit(status);
+}
+
+static struct spsc_ring *g_done_ring = (void*)FROMJRT_RING_ADDR;
+static u32 g_wcet_pid;		/* JRT_REQ_WCET job running, 0: none */
+
+// G_ALLOC stood in for the colored pool somewhere in the job's memory
+static bool job_uncolored(aspace_t *as)
+{
+	u32 i;
+
+	if (as->mem && !color_rt(as->mem))
+		return true;
+	for (i = 0; i < JRT_IMAGE_SEG_MAX; ++i)
+		if (as->wseg[i] && !color_rt(as->wseg[i]))
+			return true;
+	return false;
+}
+
+/*
+ * The root proc of a job exited. Its sibling threads and spawned
+ * processes may still use the job buffer and the image, the record
+ * waits in the aspace until ipc_job_complete.
+ */
+void ipc_job_done(proc_t *p, u64 status)
+{
+	jrt_done_rec_t *rec;
+
+	rec = &p->as->done;
+	rec->job_id = p->job_id;
+	rec->pid = p->pid;
+	rec->status = (s32)status;
+	rec->buf = 0;
+	rec->flags = 0;
+	if (p->dl_missed)
+		rec->flags |= JRT_DONE_LATE;
+	if (p->dl_killed) {
+		rec->flags |= JRT_DONE_KILLED;
+		rec->status = -SYS_ETIMEDOUT;
+	}
+	if (job_uncolored(p->as))
+		rec->flags |= JRT_DONE_UNCOLORED;
+	rec->irqs = p->irqs;
+	memcpy(rec->t_stage, p->t_stage, sizeof(rec->t_stage));
+	rec->t_exec = p->t_exec;
+	p->as->done_deadline = p->abs_deadline;
+}
+
+// as is freed, nothing of the job runs any more
+void ipc_job_complete(aspace_t *as)
+{
+	jrt_done_rec_t *rec;
+
+	rec = &as->done;
+	rec->t_done = time_now_ticks();
+	rec->out_len = as->out_len;
+	rec->out_off = as->out_off;
+	if (as->done_deadline && rec->t_done > as->done_deadline)
+		rec->flags |= JRT_DONE_LATE;
+	if (spsc_push(g_done_ring, rec))
+		uart_puts("[IPC] completion ring full\n");
+	xevt_linux_done();
+
+	// pick up what arrived while the characterization run had the core
+	if (rec->pid == g_wcet_pid) {
+		g_wcet_pid = 0;
+		gic_raise_spi(SCHED_SPI);
+	}
+	rec->job_id = 0;
+}
+
+/*
+ * A submission JRT could not start goes back to Linux as failed, one
+ * bad or excess request must not take the core down.
+ */
+static void ipc_job_reject(jrt_sched_req_t *sr, u64 t_irq, u64 t_pop,
+	s32 status)
+{
+	jrt_done_rec_t rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.job_id = sr->job_id;
+	rec.t_done = time_now_ticks();
+	rec.status = status;
+	rec.flags = JRT_DONE_REJECTED;
+	memcpy(rec.t_stage, sr->t_stage, sizeof(sr->t_stage));
+	rec.t_stage[JRT_STAGE_IRQ] = t_irq;
+	rec.t_stage[JRT_STAGE_POP] = t_pop;
+	if (spsc_push(g_done_ring, &rec))
+		uart_puts("[IPC] completion ring full\n");
+	xevt_linux_done();
+}
+
+/*
+ * The buffer pool is inside the kernel window every process map links,
+ * so the job reaches its buffer at its physical address as is.
+ */
+static void job_set_buf(proc_t *p, jrt_sched_req_t *sr)
+{
+	if (!sr->buf)
+		return;
+	if (sr->buf < BUF_POOL_ADDR ||
+		sr->buf + sr->buf_size > BUF_POOL_ADDR + BUF_POOL_SIZE) {
+		uart_puts("[SCHED] job buffer outside the pool\n");
+		return;
+	}
+	p->as->buf = (void *)(uintptr_t)sr->buf;
+	p->as->buf_size = sr->buf_size;
+	p->ctx.x[2] = sr->buf;
+	p->ctx.x[3] = sr->buf_size;
 }
-void schedule_req(u64 pc, u64 prog_size, u64 mem_req)
+
+void schedule_req(jrt_sched_req_t *sr, u64 t_irq)
 {
+	u64 t_pop, t_alloc, t_proc;
 	u32 pid;
 	void *mem;
+	u64 deadline;
+	image_t *img;
+	proc_t *p;
+	s32 err;
+
+	t_pop = time_now_ticks();
 
 	//interrupts_disable_all();
-	mem = alloc(&G_ALLOC, mem_req);
-	uart_puts("SCHED\n");
-	dump_sched(&G_SCHED, G_VERB);
+	mem = color_alloc(sr->mem_req);
+	t_alloc = time_now_ticks();
+	if (!mem) {
+		uart_puts("[SCHED] no memory for the job\n");
+		ipc_job_reject(sr, t_irq, t_pop, -SYS_ENOSPC);
+		return;
+	}
+
+	// cached images are immutable and shared by all their instances
+	img = image_get(sr->pc, sr->prog_size,
+		(sr->flags & JRT_REQ_CACHED ? IMAGE_RO : 0) |
+		(sr->flags & JRT_REQ_ELF ? IMAGE_ELF : 0),
+		sr->flags & JRT_REQ_CACHED ? IMAGE_TAG(sr->img_id, sr->img_gen) : 0,
+		&err);
+	if (!img) {
+		color_free(mem);
+		ipc_job_reject(sr, t_irq, t_pop, err);
+		return;
+	}
 
-	if (!mem)
-		KERNEL_PANIC(JRT_ENOMEM);
+	// relative deadline from linux, 0 keeps the old "run asap" behaviour.
+	// absolute ones were converted from CLOCK_MONOTONIC on the linux side
+	// (shared/clock.h), a deadline already past is a miss at release
+	if (sr->flags & JRT_REQ_DL_ABS)
+		deadline = sr->deadline_abs;
+	else
+		deadline = sr->deadline_us ?
+			time_now_ticks() + ticks_from_us(sr->deadline_us) : 0;
 
 	pid = sched_new_proc(
 		&G_SCHED,
-		pc,
-		prog_size,
+		img,
 		mem,
-		mem_req,
-		0,
+		sr->mem_req,
+		deadline,
 		jrt_exit);
+	if (!pid) {
+		image_put(img);
+		color_free(mem);
+		ipc_job_reject(sr, t_irq, t_pop, -SYS_ENOSPC);
+		return;
+	}
+	p = sched_get_proc(&G_SCHED, pid);
+	t_proc = time_now_ticks();
+	p->job_id = sr->job_id;
+	p->t_doorbell = sr->t_doorbell;
+	memcpy(p->t_stage, sr->t_stage, sizeof(sr->t_stage));
+	p->t_stage[JRT_STAGE_IRQ] = t_irq;
+	p->t_stage[JRT_STAGE_POP] = t_pop;
+	p->t_stage[JRT_STAGE_ALLOC] = t_alloc;
+	p->t_stage[JRT_STAGE_PROC] = t_proc;
+	p->t_stage[JRT_STAGE_RUN] = 0;
+	// notify has nothing to set until the job names its flags object
+	p->miss_policy = (sr->flags & JRT_REQ_MISS_MASK) >> JRT_REQ_MISS_SHIFT;
+	job_set_buf(p, sr);
+	if (sr->flags & JRT_REQ_WCET)
+		g_wcet_pid = pid;
+
+	sched_ready_proc(&G_SCHED, pid);
+	p->t_stage[JRT_STAGE_READY] = time_now_ticks();
+	if ((sr->flags & (JRT_REQ_WCET | JRT_REQ_COLD)) ==
+			(JRT_REQ_WCET | JRT_REQ_COLD)) {
+		dcache_clean_inval_all();
+		asm volatile("ic iallu");
+		tlbi_all();
+	}
+	sched(&G_SCHED, sched_switch_irq);
+
+	// RUN is stamped on the eret, anything printed here would land in it
+	if (G_VERB <= 2)
+		return;
 	uart_puts("[SCHED] ");
 	uart_putu32(pid);
 	uart_puts(": (");
-	uart_putu64(pc);
+	uart_putu64(sr->pc);
 	uart_puts(", ");
-	uart_putu64(prog_size);
+	uart_putu64(sr->prog_size);
 	uart_puts(", ");
-	uart_putu64(mem_req);
+	uart_putu64(sr->mem_req);
+	uart_puts(", ");
+	uart_putu64(deadline);
 	uart_puts(")\n");
-
-	sched_ready_proc(&G_SCHED, pid);
-	sched(&G_SCHED, sched_switch_irq);
 	uart_puts("SCHED after\n");
 	dump_sched(&G_SCHED, G_VERB);
+	dump_images(G_VERB);
 }
 
 static struct mpsc_ring *g_ipc_ring = (void*)TOJRT_RING_ADDR;
@@ -195,49 +408,35 @@ void ipc_sched(ctx_t *ctx)
 {
 	jrt_sched_req_t sr;
 	int budget;
+	u64 t_irq;
+
+	t_irq = time_now_ticks();
 //	uart_puts("periodic call\n");
-	for (budget = 0; budget < 3; budget++) {
+	for (budget = 0; budget < 3 && !g_wcet_pid; budget++) {
 		if (mpsc_pop(g_ipc_ring, sr.b) != 0)
 			break;
-		schedule_req(sr.pc, sr.prog_size, sr.mem_req);
+		schedule_req(&sr, t_irq);
 	}
 	//uart_puts("periodic call\n");
 }
 
-void timer_fn(ctx_t *)
+void timer_fn(ctx_t *c)
 {
-	proc_t *p;
 	u64 dl;
 	u64 now;
+
+	// first thing, before the prints below skew it
+	now = time_now_ticks();
+	dl = sys_mrs_cntp_cval();
+	if (now >= dl)
+		stats_hist(JRT_HIST_IRQ, now - dl);
+	stats_timer_irq();
 	printf("TIMER[%llu]\n", time_now_ticks());
 	dump_sched(&G_SCHED, G_VERB);
 
-	if (!sched_has_waiting(&G_SCHED)) {
-		timer_cancel();
-		goto ret;
-	}
-	do {
-		heap_pop(&G_SCHED.waiting, &dl, (void**)&p);
-		if (!p)
-			goto ret;
-		now = time_now_ticks();
-
-		if (dl > now) {
-			sched_wait_proc(&G_SCHED, p->pid);
-			//heap_push(&G_SCHED.waiting, dl, p);
-			goto end;
-		}
-		uart_puts("timer dl: ");
-		uart_putu64(dl);
-		uart_puts("\n");
-		sched_ready_proc(&G_SCHED, p->pid);
+	// run every due timer, then decide once for the batch
+	if (ktimer_expire(c, time_now_ticks()))
 		sched(&G_SCHED, sched_switch_irq);
-	} while (sched_has_waiting(&G_SCHED));
-	timer_cancel();
-	goto ret;
-end:
-	timer_schedule_at_ticks(dl);
-ret:
 	uart_puts("TIMER after\n");
 	dump_sched(&G_SCHED, G_VERB);
 }
@@ -4,9 +4,19 @@
 #include "string.h"
 #include "kerror.h"
 #include "uart.h"
-#include "alloc.h"
+#include "color.h"
 #include "timer.h"
-extern alloc_t G_ALLOC;
+#include "image.h"
+#include "stats.h"
+#include "pmu.h"
+#include "deadline.h"
+#include "kobj.h"
+#include "utimer.h"
+#include "warm.h"
+
+// above 2 the switch path traces to the uart, off the job stages
+extern int G_VERB;
+
 proc_t *sched_alloc_proc(sched_t *sc)
 {
 	proc_t *r;
@@ -29,6 +39,53 @@ proc_t *sched_get_proc(sched_t *sc, u32 pid)
 	return &sc->pb[idx];
 }
 
+static aspace_t *sched_alloc_as(sched_t *sc)
+{
+	if (sc->nfree_as <= 0)
+		return NULL;
+	return sc->free_as[--sc->nfree_as];
+}
+
+extern void ipc_job_complete(aspace_t *as);
+
+/*
+ * Freed once its threads and the processes it spawned are gone. Until
+ * then the job buffer and the image stay in use, so that is also when
+ * a job's completion goes to linux.
+ */
+static void sched_free_as(sched_t *sc, aspace_t *as)
+{
+	aspace_t *parent;
+
+	color_free(as->mem);
+	warm_as_free(as);
+	image_instance_put(as->img, &as->map, as->wseg);
+	image_put(as->img);
+	if (as->done.job_id)
+		ipc_job_complete(as);
+	parent = as->parent;
+	as->mem = NULL;
+	as->img = NULL;
+	as->parent = NULL;
+	sc->free_as[sc->nfree_as++] = as;
+
+	if (parent && !--parent->spawned && !parent->refs)
+		sched_free_as(sc, parent);
+}
+
+static void sched_put_as(sched_t *sc, aspace_t *as)
+{
+	if (--as->refs || as->spawned)
+		return;
+	sched_free_as(sc, as);
+}
+
+void sched_hold_as(aspace_t *child, aspace_t *parent)
+{
+	child->parent = parent;
+	parent->spawned++;
+}
+
 void sched_free_proc(sched_t *sc, u32 pid)
 {
 	proc_t *p;
@@ -39,66 +96,167 @@ void sched_free_proc(sched_t *sc, u32 pid)
 		KERNEL_PANIC(JRT_ENOMEM);
 
 	p->state = PROC_UNUSED;
+	dl_disarm(sc, p);
+	warm_proc_free(p);
+	utimer_proc_exit(p);
+	stats_proc_free(p);
 	sc->free_proc[sc->nfree_proc++] = p;
-	free(&G_ALLOC, p->mem);
-	mmu_map_destroy(&p->ctx.mmap);
+	if (p->stack)
+		color_free(p->stack);
+	p->stack = NULL;
+	// the last thread takes the memory and the image with it
+	sched_put_as(sc, p->as);
+	p->as = NULL;
 }
 
-
-u32 sched_new_proc(
+static proc_t *sched_init_proc(
 	sched_t *sc,
-	u64 pc,
-	u64 code_size,
-	void *mem,
-	size_t mem_size,
+	aspace_t *as,
+	u64 sp,
 	u64 deadline,
 	exit_func_t exit)
 {
 	proc_t *p;
-	static u16 asid = 1;
 
 	p = sched_alloc_proc(sc);
 	if (!p)
-		KERNEL_PANIC(JRT_ENOMEM);
+		return NULL;
 
 	//clear regs
 	memset(p->ctx.x, 0, 31 * sizeof(u64));
 
-	// stack pointer and procram counter
-	p->ctx.sp = (uintptr_t)mem + mem_size;
-	// align
-	p->ctx.sp &= ~((uintptr_t)15);
+	// stack pointer, aligned
+	p->ctx.sp = sp & ~((uintptr_t)15);
+	p->stack_top = p->ctx.sp;
 
-	//mmu translates 0->pc
-	p->ctx.pc = 0;
-	//p->ctx.pc = pc;
+	//mmu translates the image to its link (or relocated) address
+	p->ctx.pc = as->img->entry;
 
 	p->ctx.pstate = pstate_el1h(FIQ_MASK);
 
 	// set default args for:
 	// int start(void *mem, size_t mem_size);
-	p->ctx.x[0] = (uintptr_t)mem;
-	p->ctx.x[1] = mem_size;
+	p->ctx.x[0] = (uintptr_t)as->mem;
+	p->ctx.x[1] = as->mem_size;
 
 	// final link
 	p->ctx.x[30] = (uintptr_t)exit;
 
-	// create mmap that maps code to 0:code_size
-	p->ctx.mmap = proc_map_create(pc, code_size, asid++);
-
-	p->pa_pc = pc;
+	// threads of a process share its map, instances of an image too
+	// unless it has writable segments
+	p->ctx.mmap = as->map;
+	p->as = as;
+	p->stack = NULL;
+
+	p->pa_pc = as->img->pa;
+	p->job_id = 0;
+	p->futex_addr = NULL;
+	p->futex_next = NULL;
+	p->ipc_caller = NULL;
+	p->ipc_next = NULL;
+	p->ipc_server = NULL;
+	p->wait_obj = NULL;
+	tw_node_init(&p->tw);
+	p->obj_idx = HEAP_NO_IDX;
+	p->ready_idx = HEAP_NO_IDX;
+	p->dl_idx = HEAP_NO_IDX;
+	p->miss_policy = JRT_MISS_CONTINUE;
+	p->miss_flags = 0;
+	p->miss_bits = 0;
+	p->dl_missed = false;
+	p->dl_killed = false;
+	p->ntimers = 0;
+	p->slack = 0;
+	p->upcall_of = NULL;
 	p->first = 1;
-	p->mem = mem;
-	p->mem_size = mem_size;
-	p->prog_size = code_size;
-	//p->code_size = code_size;
+	p->mem = as->mem;
+	p->mem_size = as->mem_size;
+	p->prog_size = as->img->size;
 	p->eff_deadline = deadline;
 	p->abs_deadline = deadline;
 	p->state = PROC_READY;
-	uart_puts("created proc, start addr: ");
-	uart_puthex(pc);
-	uart_puts("\nPC [0x0,0x50]: \n");
-	dump_mem((void*)(uintptr_t)pc, 0x50);
+	stats_proc_new(p);
+	dl_arm(sc, p);
+	return p;
+}
+
+u32 sched_new_proc(
+	sched_t *sc,
+	image_t *img,
+	void *mem,
+	size_t mem_size,
+	u64 deadline,
+	exit_func_t exit)
+{
+	proc_t *p;
+	aspace_t *as;
+
+	as = sched_alloc_as(sc);
+	if (!as)
+		return 0;
+	if (image_instance(img, &as->map, as->wseg)) {
+		sc->free_as[sc->nfree_as++] = as;
+		return 0;
+	}
+	as->img = img;
+	as->mem = mem;
+	as->mem_size = mem_size;
+	as->refs = 1;
+	as->spawned = 0;
+	as->parent = NULL;
+	as->done.job_id = 0;
+	as->buf = NULL;
+	as->buf_size = 0;
+	as->out_len = 0;
+	as->out_off = 0;
+	as->warm = NULL;
+
+	p = sched_init_proc(sc, as, (uintptr_t)mem + mem_size, deadline, exit);
+	if (!p) {
+		image_instance_put(img, &as->map, as->wseg);
+		sc->free_as[sc->nfree_as++] = as;
+		return 0;
+	}
+
+	if (G_VERB > 2) {
+		uart_puts("created proc, start addr: ");
+		uart_puthex(img->pa);
+		uart_puts("\nPC [0x0,0x50]: \n");
+		dump_mem((void*)(uintptr_t)img->pa, 0x50);
+	}
+	return p->pid;
+}
+
+u32 sched_new_thread(
+	sched_t *sc,
+	proc_t *parent,
+	void *stack,
+	size_t stack_size,
+	u64 deadline,
+	exit_func_t exit)
+{
+	proc_t *p;
+
+	p = sched_init_proc(
+		sc,
+		parent->as,
+		(uintptr_t)stack + stack_size,
+		deadline,
+		exit);
+	if (!p)
+		return 0;
+	parent->as->refs++;
+	p->stack = stack;
+	p->miss_policy = parent->miss_policy;
+	p->miss_flags = parent->miss_flags;
+	p->miss_bits = parent->miss_bits;
+	p->slack = parent->slack;
+
+	uart_puts("created thread ");
+	uart_putu32(p->pid);
+	uart_puts(" of ");
+	uart_putu32(parent->pid);
+	uart_puts("\n");
 	return p->pid;
 }
 
@@ -107,9 +265,12 @@ void sched_ready_proc(sched_t *sc, u32 pid)
 	proc_t *p;
 
 	p = sched_get_proc(sc, pid);
-	uart_puts("READY_PROC(");
-	uart_putu32(pid);
-	uart_puts(")\n");
+	if (G_VERB > 2) {
+		uart_puts("READY_PROC(");
+		uart_putu32(pid);
+		uart_puts(")\n");
+	}
+	stats_ready(p);
 	if (heap_push(&sc->ready, p->eff_deadline, p))
 		KERNEL_PANIC(JRT_ENOMEM);
 }
@@ -123,18 +284,151 @@ void sched_wait_proc(sched_t *sc, u32 pid)
 	uart_putu32(pid);
 	uart_puts(")\n");
 
-	if (heap_push(&sc->waiting, p->wait_until, p))
+	tw_add(&sc->waiting, &p->tw, p->wait_until);
+}
+/*
+ * Timer slack: a soft wait may end anywhere in [until, until + slack].
+ * It rides on the interrupt of a timer already due in that window, or
+ * ends on the coarsest tick boundary inside it, which overlapping soft
+ * waits share. Procs with a deadline always wake at the tick they asked.
+ *
+ * A wait moved onto an instant the comparator is already programmed for,
+ * or one another wait already ends at, costs no interrupt of its own and
+ * counts as saved.
+ */
+static u64 sched_coalesce(sched_t *sc, proc_t *p, u64 until, u64 slack)
+{
+	u64 next, end, g, b;
+
+	if (!slack || (p->abs_deadline && p->abs_deadline != DL_BACKGROUND))
+		return until;
+	end = until + slack;
+	if (end < until)
+		return until;
+	next = ktimer_next();
+	if (next >= until && next <= end) {
+		if (next != until)
+			stats_timer_saved(1);
+		return next;
+	}
+	// g <= slack, so the boundary is never before until
+	g = 1ull << (63 - __builtin_clzll(slack));
+	b = end & ~(g - 1);
+	if (b != until && tw_pending_at(&sc->waiting, b))
+		stats_timer_saved(1);
+	return b;
+}
+
+void sched_sleep_slack(sched_t *sc, proc_t *p, u64 until, u64 slack)
+{
+	p->wait_until = sched_coalesce(sc, p, until, slack);
+	sched_wait_proc(sc, p->pid);
+	sched_arm_timer(sc);
+}
+
+void sched_sleep(sched_t *sc, proc_t *p, u64 until)
+{
+	sched_sleep_slack(sc, p, until, p->slack);
+}
+
+void sched_arm_timer(sched_t *sc)
+{
+	proc_t *p;
+	u64 next, dl;
+
+	next = tw_next(&sc->waiting);
+	if (!heap_empty(&sc->deadlines)) {
+		heap_peek(&sc->deadlines, &dl, (void**)&p);
+		if (dl < next)
+			next = dl;
+	}
+	if (next != ~0ull)
+		ktimer_start(&sc->tmr, next, 0);
+	else
+		ktimer_stop(&sc->tmr);
+}
+
+// releases the due sleepers and handles the overruns, sched() is timer_fn's
+bool sched_timer_fn(ktimer_t *t, struct ctx *c, u64 now)
+{
+	sched_t *sc;
+	u32 n;
+
+	sc = (sched_t *)((u8 *)t - __builtin_offsetof(sched_t, tmr));
+	n = sched_release(sc, now);
+	// overrun timers share the ktimer with the wakeups
+	n += dl_expire(sc, now);
+	sched_arm_timer(sc);
+	return n != 0;
+}
+
+void sched_requeue(sched_t *sc, proc_t *p)
+{
+	proc_t *r;
+	u64 dl;
+
+	if (p->ready_idx == HEAP_NO_IDX)
+		return;
+	heap_remove(&sc->ready, p->ready_idx, &dl, (void**)&r);
+	if (heap_push(&sc->ready, p->eff_deadline, p))
 		KERNEL_PANIC(JRT_ENOMEM);
 }
+
+/* the timer may still fire for it, timer_fn copes with an early wakeup */
+void sched_unsleep(sched_t *sc, proc_t *p)
+{
+	tw_del(&sc->waiting, &p->tw);
+	warm_disarm(p);
+}
+
+void sched_futex_cancel(sched_t *sc, proc_t *p)
+{
+	futex_bucket_t *b;
+	proc_t **pp;
+
+	if (!p->futex_addr)
+		return;
+	b = sched_futex_bucket(sc, p->futex_addr);
+	for (pp = &b->head; *pp; pp = &(*pp)->futex_next) {
+		if (*pp != p)
+			continue;
+		*pp = p->futex_next;
+		b->nwait--;
+		break;
+	}
+	p->futex_next = NULL;
+	p->futex_addr = NULL;
+}
+
 u64 sched_next_wait_deadline(sched_t *sc)
 {
-	proc_t *p;
 	u64 wait_until;
-	if (sched_has_waiting(sc))
-		heap_peek(&sc->waiting, &wait_until, (void**)&p);
-	else
-		wait_until = 0;
-	return wait_until;
+
+	wait_until = tw_next(&sc->waiting);
+	return wait_until == ~0ull ? 0 : wait_until;
+}
+
+/*
+ * Everything due is taken off the wheel in one go and queued, the caller
+ * makes a single scheduling decision for the whole batch.
+ */
+u32 sched_release(sched_t *sc, u64 now)
+{
+	tw_node_t *n, *next;
+	proc_t *p;
+	u32 cnt;
+
+	cnt = tw_expire(&sc->waiting, now, &n);
+	for (; n; n = next) {
+		next = n->next;
+		p = (proc_t *)((u8 *)n - __builtin_offsetof(proc_t, tw));
+		if (p->wait_obj)
+			kobj_timeout(p);
+		p->t_timer = p->wait_until;
+		p->t_fired = ktimer_base();
+		sched_ready_proc(sc, p->pid);
+	}
+	return cnt;
 }
 
 void uart_dump_ctx(ctx_t *c)
@@ -187,6 +481,14 @@ void dump_proc(proc_t *p, int v)
 	uart_puts("\n");
 	dump_map(&p->ctx.mmap);
 }
+static void twprf(bool last, tw_node_t *n, void *a)
+{
+	proc_t *p = (proc_t *)((u8 *)n - __builtin_offsetof(proc_t, tw));
+	int verb = *(int*)a;
+	dump_proc(p, verb);
+	if (!last)
+	uart_puts("}, {");
+}
 static void prf(bool last, u64 k, void *v, void *a)
 {
 	proc_t *p = v;
@@ -201,7 +503,7 @@ void dump_sched(sched_t *s, int v)
 {
 
 	uart_puts("waiting:\n {");
-	heap_iter(&s->waiting, &v, prf);
+	tw_iter(&s->waiting, &v, twprf);
 	uart_puts("}\nready:\n {");
 	heap_iter(&s->ready, &v, prf);
 	uart_puts("}\n");
@@ -210,33 +512,40 @@ void dump_sched(sched_t *s, int v)
 }
 void sched_switch_sync(sched_t *sc, proc_t *c, proc_t *n)
 {
+	stats_switch(c, n);
+	pmu_switch(c, n);
 	sc->pid = n->pid;
 	store_pstate(&c->ctx);
 	sc->curr = n;
-	uart_puts("sync switch FROM:\n");
-
-	uart_dump_ctx(&c->ctx);
-	uart_puts("TO:\n");
-	uart_dump_ctx(&n->ctx);
+	if (G_VERB > 2) {
+		uart_puts("sync switch FROM:\n");
+		uart_dump_ctx(&c->ctx);
+		uart_puts("TO:\n");
+		uart_dump_ctx(&n->ctx);
+	}
 	mmu_map_switch(&n->ctx.mmap);
 	load_pstate(&n->ctx);
 }
 void sched_switch_irq(sched_t *sc, proc_t *c, proc_t *n)
 {
+	stats_switch(c, n);
+	pmu_switch(c, n);
 	sc->pid = n->pid;
 	sc->curr = n;
-	uart_putu32(c->pid);
-	uart_puts(", pc: (");
-	uart_puthex(c->ctx.pc);
-	uart_puts(", PA: ");
-	uart_puthex(c->pa_pc);
-	uart_puts(") -> (pid: ");
-	uart_putu32(n->pid);
-	uart_puts(", pc: (");
-	uart_puthex(n->ctx.pc);
-	uart_puts(", PA: ");
-	uart_puthex(n->pa_pc);
-	uart_puts(")\n");
+	if (G_VERB > 2) {
+		uart_putu32(c->pid);
+		uart_puts(", pc: (");
+		uart_puthex(c->ctx.pc);
+		uart_puts(", PA: ");
+		uart_puthex(c->pa_pc);
+		uart_puts(") -> (pid: ");
+		uart_putu32(n->pid);
+		uart_puts(", pc: (");
+		uart_puthex(n->ctx.pc);
+		uart_puts(", PA: ");
+		uart_puthex(n->pa_pc);
+		uart_puts(")\n");
+	}
 	/*
 	uart_puts("irq switch FROM:\n");
 	uart_dump_ctx(&c->ctx);
@@ -259,9 +568,11 @@ proc_t *sched_yield(sched_t *sc)
 		p = &sc->p0;
 	p->state = PROC_RUNNING;
 	c = sc->pid == 0 ? &sc->p0 : sched_get_proc(sc, sc->pid);
-	uart_puts("[");
-	uart_putu64(time_now_us());
-	uart_puts("][SCHED] yield (pid: ");
+	if (G_VERB > 2) {
+		uart_puts("[");
+		uart_putu64(time_now_us());
+		uart_puts("][SCHED] yield (pid: ");
+	}
 	sched_switch_irq(sc, c, p);
 	return c;
 }
@@ -286,10 +597,11 @@ void sched(sched_t *sc, void (*swp)(sched_t*,proc_t*,proc_t*))
 		c->state = PROC_READY;
 		if (sc->curr->pid != 0)
 			sched_ready_proc(sc, c->pid);
-		uart_puts("[");
-		uart_putu64(time_now_us());
-		uart_puts("][SCHED] switch (pid: ");
-
+		if (G_VERB > 2) {
+			uart_puts("[");
+			uart_putu64(time_now_us());
+			uart_puts("][SCHED] switch (pid: ");
+		}
 		swp(sc, c, p);
 	}
 }
@@ -6,6 +6,8 @@
 #include "types.h"
 #include "sched_structs.h"
 #include "heap.h"
+#include "twheel.h"
+#include "ktimer.h"
 #include "mmu.h"
 // PSTATE / SPSR bits used here
 #define PSR_F   (1u << 6)   // FIQ mask
@@ -48,6 +50,8 @@ static inline s64 pid_to_idx(s64 p)
 	return p - 1;
 }
 
+bool sched_timer_fn(ktimer_t *t, struct ctx *c, u64 now);
+
 static inline void sched_init(sched_t *s)
 {
 	u32 i;
@@ -55,12 +59,26 @@ static inline void sched_init(sched_t *s)
 	for (i = 0; i < MAX_PROC; ++i) {
 		s->pb[i].pid = idx_to_pid(i);
 		s->pb[i].state = PROC_UNUSED;
+		s->pb[i].warm_tmr = NULL;
 		s->free_proc[i] = &s->pb[i];
 	}
+	for (i = 0; i < MAX_AS; ++i) {
+		s->asb[i].warm = NULL;
+		s->free_as[i] = &s->asb[i];
+	}
 	s->nfree_proc = MAX_PROC;
-
-	heap_init(&s->ready, s->rn, READY_MAX);
-	heap_init(&s->waiting, s->wn, READY_MAX);
+	s->nfree_as = MAX_AS;
+
+	heap_init_indexed(&s->ready, s->rn, READY_MAX,
+		__builtin_offsetof(proc_t, ready_idx));
+	tw_init(&s->waiting);
+	ktimer_setup(&s->tmr, sched_timer_fn);
+	heap_init_indexed(&s->deadlines, s->dn, READY_MAX,
+		__builtin_offsetof(proc_t, dl_idx));
+	for (i = 0; i < FUTEX_BUCKETS; ++i) {
+		s->fq[i].head = NULL;
+		s->fq[i].nwait = 0;
+	}
 
 	s->pid = 0;
 	s->p0.pid = 0;
@@ -77,21 +95,55 @@ void sched_ready_proc(sched_t *sc, u32 pid);
 void sched_wait_proc(sched_t *sc, u32 pid);
 static inline bool sched_has_waiting(sched_t *sc)
 {
-	return sc->waiting.len > 0;
+	return !tw_empty(&sc->waiting);
 }
 u64 sched_next_wait_deadline(sched_t *sc);
+// make every proc whose wait expired by now ready, returns how many
+u32 sched_release(sched_t *sc, u64 now);
+// wake p at until (ticks) unless it is woken before, arms the timer
+void sched_sleep(sched_t *sc, proc_t *p, u64 until);
+// as sched_sleep, but p may wake up to slack ticks late, see sched.c
+void sched_sleep_slack(sched_t *sc, proc_t *p, u64 until, u64 slack);
+// woken before until: take p off the timing wheel
+void sched_unsleep(sched_t *sc, proc_t *p);
+
+static inline futex_bucket_t *sched_futex_bucket(sched_t *sc, u32 *uaddr)
+{
+	return &sc->fq[((uintptr_t)uaddr >> FUTEX_HASH_SHIFT) &
+		(FUTEX_BUCKETS - 1)];
+}
+// p stops waiting on its futex, if it waits on one
+void sched_futex_cancel(sched_t *sc, proc_t *p);
+// arm the sched ktimer for the earliest wakeup or deadline, or stop it
+void sched_arm_timer(sched_t *sc);
+// p's ready key changed, move it in the ready heap if it is queued
+void sched_requeue(sched_t *sc, proc_t *p);
 
 
-typedef void (*exit_func_t)(void);
+typedef void (*exit_func_t)(u64 status);
+// 0 when out of processes, procs or maps for another instance of img,
+// mem and img stay the caller's
 u32 sched_new_proc(
 	sched_t *sc,
-	u64 pc,
-	u64 code_size,
+	struct image *img,
 	void *mem,
 	size_t mem_size,
 	u64 deadline,
 	exit_func_t exit);
 
+// child was spawned from parent, which stays until child is freed
+void sched_hold_as(aspace_t *child, aspace_t *parent);
+
+// new thread in parent's address space, only stack and context are new,
+// 0 when out of procs, stack stays the caller's
+u32 sched_new_thread(
+	sched_t *sc,
+	proc_t *parent,
+	void *stack,
+	size_t stack_size,
+	u64 deadline,
+	exit_func_t exit);
+
 proc_t *sched_alloc_proc(sched_t *sc);
 
 void sched_free_proc(sched_t *sc, u32 pid);
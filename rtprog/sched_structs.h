@@ -6,6 +6,18 @@
 #include "types.h"
 #include "mmu_structs.h"
 #include "heap_structs.h"
+#include "twheel_structs.h"
+#include "ktimer_structs.h"
+#include "syscall_table.h"
+#include "mailbox.h"
+#include "jrt_image.h"
+
+struct image;
+struct kobj;
+struct jrt_proc_stats;
+struct utimer;
+struct warm;
+struct warm_tmr;
 
 typedef enum task_state {
 	PROC_READY,
@@ -25,6 +37,27 @@ typedef  struct ctx {
 	mmu_map_t mmap;
 } ctx_t;
 
+/* what the threads of one process share, freed with the last thread */
+typedef struct aspace {
+	struct image *img;	/* code and page tables */
+	mmu_map_t map;		/* img's, or the instance's own (image.h) */
+	void *wseg[JRT_IMAGE_SEG_MAX];	/* this instance's writable segments */
+	void *mem;		/* memory handed to every thread's entry */
+	size_t mem_size;
+	u32 refs;		/* threads using it */
+	u32 spawned;		/* live processes spawned from it */
+	struct aspace *parent;	/* spawner, kept until we are freed */
+	/* root proc of a linux job exited: completion sent once freed */
+	jrt_done_rec_t done;	/* job_id 0: none pending */
+	u64 done_deadline;
+	/* linux job buffer, lent until the completion record */
+	void *buf;
+	u32 buf_size;
+	u32 out_len;		/* sys_job_output(), returned with the job */
+	u64 out_off;
+	struct warm *warm;	/* pre-release warm-up, NULL: never declared */
+} aspace_t;
+
 typedef struct process {
 	ctx_t ctx;
 	u32	pid;
@@ -33,6 +66,7 @@ typedef struct process {
 	u64 pa_pc;
 	/* scheduling */
 	u64	wait_until;      /* how long to wait */
+	u64	slack;           /* default timer slack of its waits, ticks */
 	u64	abs_deadline;   /* base requested deadline */
 	u64	eff_deadline;   /* effective (after inheritance) */
 	u64	wait_start_ns;  /* for fairness */
@@ -41,23 +75,86 @@ typedef struct process {
 	u64 prog_size;
 	void *mem;
 	size_t mem_size;
+
+	aspace_t *as;		/* shared with sibling threads */
+	void *stack;		/* thread stack, NULL: top of as->mem */
+	u64 stack_top;		/* initial sp, bounds frame walks */
+	u64 job_id;		/* linux job, 0 for spawned procs */
+
+	u32 *futex_addr;	/* futex waited on, NULL if none */
+	struct process *futex_next;
+
+	struct process *ipc_caller;	/* call being served, reply goes here */
+	struct process *ipc_next;	/* endpoint send queue */
+	struct process *ipc_server;	/* serving our call, NULL if none */
+
+	struct kobj *wait_obj;	/* queue/semaphore/flags blocked on */
+	tw_node_t tw;		/* timed wait in the sched timing wheel */
+	size_t obj_idx;		/* position in wait_obj's waiters */
+
+	struct jrt_proc_stats *stats;	/* shared stats slot, NULL: none left */
+	u64 t_run;		/* switched in */
+	u64 t_release;		/* activation began, 0: blocked */
+	bool wake_pending;	/* wakeup latency not taken yet */
+	u64 t_timer;		/* timed wakeup target, 0: none */
+	u64 t_fired;		/* its timer batch began, see ktimer_base() */
+	u64 t_doorbell;		/* linux doorbell of the job, 0: dispatched */
+	u64 t_stage[JRT_STAGE_NR];	/* submission of the job, see mailbox.h */
+	u64 t_exec;		/* ticks run so far */
+	u64 irq_mark;		/* G_NIRQ at switch in */
+	u32 irqs;		/* taken while running */
+
+	/* deadline overrun handling, see deadline.h */
+	size_t ready_idx;	/* position in sched ready heap */
+	size_t dl_idx;		/* position in sched deadline heap */
+	u32 miss_policy;	/* JRT_MISS_* */
+	u32 miss_flags;		/* JRT_MISS_NOTIFY: flags object ... */
+	u64 miss_bits;		/* ... and the bits to set in it */
+	bool dl_missed;
+	bool dl_killed;		/* on its way out through jrt_exit */
+
+	struct warm_tmr *warm_tmr;	/* NULL until its first warmed wait */
+
+	/* process timers, see utimer.h */
+	u32 ntimers;		/* created by this thread */
+	struct utimer *upcall_of;	/* timer this thread is an upcall of */
 } proc_t;
 
-#define READY_MAX (0xFF)
+typedef struct futex_bucket {
+	proc_t *head;
+	u32 nwait;		/* read by the syscall fast path */
+	u32 _pad;
+} futex_bucket_t;
+
 #define MAX_PROC (0x1000)
+// processes, the threads of one share theirs
+#define MAX_AS (0x100)
+// every proc can be ready at once, a release may wake hundreds
+#define READY_MAX MAX_PROC
 
 typedef struct sched {
 	proc_t p0; //kernel proc
 	proc_t *curr;
 	u32 pid;
+	// read by the syscall fast path, keep within ldr immediate range
+	minheap_t ready;
+	futex_bucket_t fq[FUTEX_BUCKETS];
+
 	proc_t pb[MAX_PROC];
 	proc_t *free_proc[MAX_PROC];
 	size_t nfree_proc;
 
 	heap_node_t rn[READY_MAX];
-	minheap_t ready;
-	heap_node_t wn[READY_MAX];
-	minheap_t waiting;
+	// timed waits, no limit on sleepers
+	twheel_t waiting;
+	// deadline timers, multiplexed with the timing wheel on tmr
+	heap_node_t dn[READY_MAX];
+	minheap_t deadlines;
+	ktimer_t tmr;		/* earliest of waiting and deadlines */
+
+	aspace_t asb[MAX_AS];
+	aspace_t *free_as[MAX_AS];
+	size_t nfree_as;
 } sched_t;
 
 
@@ -0,0 +1,318 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "stats.h"
+#include "timer.h"
+#include "ktimer.h"
+#include "gic.h"
+#include "irq.h"
+#include "string.h"
+#include "memory_layout.h"
+
+static struct jrt_stats_page *g_stats = (void*)STATS_PAGE_ADDR;
+static u32 g_free_slot[JRT_STATS_PROCS];
+static u32 g_nfree_slot;
+
+// readers retry while seq is odd or has moved
+static inline void stats_begin(u32 *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void stats_end(u32 *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline struct jrt_cpu_stats *stats_cpu(void)
+{
+	return &g_stats->cpu[sys_mrs_mpidr() & (JRT_STATS_CPUS - 1)];
+}
+
+void stats_init(sched_t *sc)
+{
+	struct jrt_cpu_stats *cs;
+	u64 now;
+	u32 i;
+
+	memset(g_stats, 0, sizeof(*g_stats));
+	now = time_now_ticks();
+	g_stats->version = JRT_STATS_VERSION;
+	g_stats->cpu_size = sizeof(struct jrt_cpu_stats);
+	g_stats->proc_size = sizeof(struct jrt_proc_stats);
+	g_stats->ncpu = JRT_STATS_CPUS;
+	g_stats->nproc = JRT_STATS_PROCS;
+	g_stats->freq = sys_mrs_cntfrq();
+	g_stats->t_boot = now;
+	g_stats->hist_size = sizeof(struct jrt_hist);
+	for (i = 0; i < JRT_HIST_NR; ++i)
+		g_stats->hist[i].min = ~0ull;
+
+	// lowest slots first
+	for (i = 0; i < JRT_STATS_PROCS; ++i)
+		g_free_slot[i] = JRT_STATS_PROCS - 1 - i;
+	g_nfree_slot = JRT_STATS_PROCS;
+
+	cs = stats_cpu();
+	cs->online = 1;
+	cs->t_switch = now;
+	sc->p0.t_run = now;
+	sc->p0.stats = NULL;
+	sc->p0.t_release = 0;
+
+	__atomic_store_n(&g_stats->magic, JRT_STATS_MAGIC, __ATOMIC_RELEASE);
+}
+
+void stats_proc_new(proc_t *p)
+{
+	struct jrt_proc_stats *s;
+	struct jrt_pmu_stats *ps;
+
+	p->t_release = 0;
+	p->t_run = 0;
+	p->wake_pending = false;
+	p->t_timer = 0;
+	p->t_fired = 0;
+	p->t_doorbell = 0;
+	p->t_exec = 0;
+	p->irqs = 0;
+	if (!g_nfree_slot) {
+		p->stats = NULL;
+		return;
+	}
+	s = &g_stats->proc[g_free_slot[--g_nfree_slot]];
+	p->stats = s;
+
+	stats_begin(&s->seq);
+	memset((u8 *)s + sizeof(s->seq), 0, sizeof(*s) - sizeof(s->seq));
+	s->state = JRT_STATS_LIVE;
+	s->pid = p->pid;
+	s->deadline = p->abs_deadline;
+	s->t_start = time_now_ticks();
+	stats_end(&s->seq);
+
+	ps = &g_stats->pmu[s - g_stats->proc];
+	stats_begin(&ps->seq);
+	memset((u8 *)ps + sizeof(ps->seq), 0, sizeof(*ps) - sizeof(ps->seq));
+	ps->gen = g_stats->pmu_cfg.gen;
+	stats_end(&ps->seq);
+}
+
+void stats_proc_free(proc_t *p)
+{
+	struct jrt_proc_stats *s;
+	struct jrt_cpu_stats *cs;
+
+	cs = stats_cpu();
+	stats_begin(&cs->seq);
+	cs->jobs++;
+	stats_end(&cs->seq);
+
+	s = p->stats;
+	if (!s)
+		return;
+	stats_begin(&s->seq);
+	s->state = JRT_STATS_EXITED;
+	stats_end(&s->seq);
+	g_free_slot[g_nfree_slot++] = s - g_stats->proc;
+	p->stats = NULL;
+}
+
+// a new activation, unless p is only being put back after a preemption
+void stats_ready(proc_t *p)
+{
+	if (p->t_release)
+		return;
+	p->t_release = time_now_ticks();
+	p->wake_pending = true;
+}
+
+static void stats_switch_out(proc_t *c, u64 now, u64 ran, bool *missed)
+{
+	struct jrt_proc_stats *s;
+	u64 late;
+
+	c->t_exec += ran;
+	c->irqs += G_NIRQ - c->irq_mark;
+	s = c->stats;
+	if (s) {
+		stats_begin(&s->seq);
+		s->runtime += ran;
+	}
+
+	if (c->state == PROC_READY) {
+		if (s)
+			s->preemptions++;
+	} else if (c->t_release) {
+		// blocked or exited: the activation is over
+		if (s && now - c->t_release > s->response_max)
+			s->response_max = now - c->t_release;
+		if (c->abs_deadline && now > c->abs_deadline) {
+			*missed = true;
+			late = now - c->abs_deadline;
+			if (s) {
+				s->deadline_misses++;
+				if (late > s->lateness_max)
+					s->lateness_max = late;
+			}
+		}
+		c->t_release = 0;
+	}
+
+	if (s)
+		stats_end(&s->seq);
+}
+
+static void stats_switch_in(proc_t *n, u64 now)
+{
+	struct jrt_proc_stats *s;
+	u64 lat;
+
+	n->t_run = now;
+	n->irq_mark = G_NIRQ;
+	if (n->t_timer) {
+		if (now > n->t_timer)
+			stats_hist(JRT_HIST_WAKEUP, now - n->t_timer);
+		// calibrates the early wake, compensated or not
+		if (now > n->t_fired)
+			ktimer_calib(now - n->t_fired);
+		n->t_timer = 0;
+	}
+	if (n->t_doorbell) {
+		if (now > n->t_doorbell)
+			stats_hist(JRT_HIST_DOORBELL, now - n->t_doorbell);
+		n->t_doorbell = 0;
+	}
+	// direct switches hand over without readying
+	if (!n->t_release)
+		n->t_release = now;
+
+	s = n->stats;
+	if (!s) {
+		n->wake_pending = false;
+		return;
+	}
+	stats_begin(&s->seq);
+	s->switches++;
+	s->job_id = n->job_id;
+	s->deadline = n->abs_deadline;
+	s->miss_policy = n->miss_policy;
+	if (n->wake_pending) {
+		lat = now - n->t_release;
+		s->wakeups++;
+		s->wakeup_sum += lat;
+		if (lat > s->wakeup_max)
+			s->wakeup_max = lat;
+		n->wake_pending = false;
+	}
+	stats_end(&s->seq);
+}
+
+void stats_switch(proc_t *c, proc_t *n)
+{
+	struct jrt_cpu_stats *cs;
+	bool missed;
+	u64 now, ran;
+
+	now = time_now_ticks();
+	ran = now - c->t_run;
+	missed = false;
+	if (c->pid)
+		stats_switch_out(c, now, ran, &missed);
+	stats_switch_in(n, now);
+
+	cs = stats_cpu();
+	stats_begin(&cs->seq);
+	if (c->pid)
+		cs->busy += ran;
+	else
+		cs->idle += ran;
+	cs->switches++;
+	if (c->pid && c->state == PROC_READY)
+		cs->preemptions++;
+	if (missed)
+		cs->deadline_misses++;
+	cs->curr = n->pid;
+	cs->t_switch = now;
+	stats_end(&cs->seq);
+}
+
+// last thing before the eret into n, a job's first one is its RUN stage
+void stats_eret(proc_t *n)
+{
+	if (n->job_id && !n->t_stage[JRT_STAGE_RUN])
+		n->t_stage[JRT_STAGE_RUN] = time_now_ticks();
+}
+
+void stats_overrun(proc_t *p, bool kill)
+{
+	struct jrt_proc_stats *s;
+	struct jrt_cpu_stats *cs;
+
+	cs = stats_cpu();
+	stats_begin(&cs->seq);
+	cs->overruns++;
+	if (kill)
+		cs->kills++;
+	stats_end(&cs->seq);
+
+	s = p->stats;
+	if (!s)
+		return;
+	stats_begin(&s->seq);
+	s->overruns++;
+	stats_end(&s->seq);
+}
+
+void stats_timer_irq(void)
+{
+	struct jrt_cpu_stats *cs;
+
+	cs = stats_cpu();
+	stats_begin(&cs->seq);
+	cs->timer_irqs++;
+	stats_end(&cs->seq);
+}
+
+void stats_timer_saved(u32 n)
+{
+	struct jrt_cpu_stats *cs;
+
+	cs = stats_cpu();
+	stats_begin(&cs->seq);
+	cs->timer_saved += n;
+	stats_end(&cs->seq);
+}
+
+static void stats_hist_clear(struct jrt_hist *h)
+{
+	h->count = 0;
+	h->sum = 0;
+	h->min = ~0ull;
+	h->max = 0;
+	h->overflow = 0;
+	memset(h->bucket, 0, sizeof(h->bucket));
+}
+
+void stats_hist(u32 id, u64 v)
+{
+	struct jrt_hist *h;
+	u32 reset;
+
+	h = &g_stats->hist[id];
+	reset = __atomic_load_n(&g_stats->hist_reset[id], __ATOMIC_RELAXED);
+	stats_begin(&h->seq);
+	if (reset != h->reset) {
+		stats_hist_clear(h);
+		h->reset = reset;
+	}
+	h->bucket[jrt_hist_index(v)]++;
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	if (v >> JRT_HIST_BITS)
+		h->overflow++;
+	stats_end(&h->seq);
+}
@@ -0,0 +1,34 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_STATS_H_
+#define _JRT_STATS_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "../shared/stats.h"
+
+/*
+ * Runtime accounting into the shared stats page (shared/stats.h). All of
+ * it happens at context switches: the outgoing proc is charged for its
+ * run, an activation ends when a proc is switched out without being
+ * ready (it blocked or exited) and starts when it is readied again.
+ * stats_eret() runs on the exception return into the proc, after the
+ * map switch, and stamps a job's RUN stage on its first one.
+ *
+ * stats_hist() adds one latency sample in ticks to a JRT_HIST_* histogram,
+ * stats_overrun() counts a deadline that passed with p still alive.
+ * stats_timer_irq() and stats_timer_saved() count CNTP interrupts taken
+ * and the ones timer slack made unnecessary.
+ */
+
+void stats_init(sched_t *sc);
+void stats_proc_new(proc_t *p);
+void stats_proc_free(proc_t *p);
+void stats_ready(proc_t *p);
+void stats_switch(proc_t *c, proc_t *n);
+void stats_eret(proc_t *n);
+void stats_hist(u32 id, u64 v);
+void stats_overrun(proc_t *p, bool kill);
+void stats_timer_irq(void);
+void stats_timer_saved(u32 n);
+
+#endif
@@ -68,25 +68,39 @@
 //
 //} proc_t;
 #define PROC_CTX	OF(proc_t, ctx)
+#define PROC_EFF_DEADLINE	OF(proc_t, eff_deadline)
 #define PROC_SIZE	sizeof(proc_t)
 
 // FILE: sched.h
 //typedef struct sched {
 //	proc_t p0; //kernel proc
 //	proc_t *curr;
-//	proc_t pb[MAX_PROC];
-//	proc_t *free_proc[MAX_PROC];
-//	size_t nfree_proc;
-//
-//	heap_node_t rn[READY_MAX];
-//	minheap_t ready;
 //	u32 pid;
+//	minheap_t ready;
+//	futex_bucket_t fq[FUTEX_BUCKETS];
+//	...
 //} sched_t;
 #define SCHED_P0	OF(sched_t, p0)
 #define SCHED_CURR	OF(sched_t, curr)
 #define SCHED_PID	OF(sched_t, pid)
+#define SCHED_READY_A	(OF(sched_t, ready) + OF(minheap_t, a))
+#define SCHED_READY_LEN	(OF(sched_t, ready) + OF(minheap_t, len))
+#define SCHED_FQ	OF(sched_t, fq)
 #define SCHED_SIZE	sizeof(sched_t)
 
+// FILE: heap_structs.h
+#define HEAP_NODE_KEY	OF(heap_node_t, key)
+
+// FILE: sched_structs.h
+//typedef struct futex_bucket {
+//	proc_t *head;
+//	u32 nwait;
+//	u32 _pad;
+//} futex_bucket_t;
+#define FUTEX_NWAIT	OF(futex_bucket_t, nwait)
+#define FUTEX_BUCKET_SHIFT	4
+#define FUTEX_BUCKET_SIZE	sizeof(futex_bucket_t)
+
 #define SAVE_FP 0
 #ifdef AUTOGEN_HEADER
 #include <stdio.h>
@@ -124,10 +138,19 @@ int main(void)
 	printf("	.equ CTX_SIZE,		(%llu)\n",CTX_SIZE);
 	printf("	.equ PROC_CTX,		(%llu)\n",PROC_CTX);
 	printf("	.equ PROC_SIZE,		(%llu)\n",PROC_SIZE);
+	printf("	.equ PROC_EFF_DEADLINE,	(%llu)\n",PROC_EFF_DEADLINE);
 	printf("	.equ SCHED_P0,		(%llu)\n",SCHED_P0);
 	printf("	.equ SCHED_CURR,		(%llu)\n",SCHED_CURR);
 	printf("	.equ SCHED_PID,		(%llu)\n",SCHED_PID);
+	printf("	.equ SCHED_READY_A,	(%llu)\n",SCHED_READY_A);
+	printf("	.equ SCHED_READY_LEN,	(%llu)\n",SCHED_READY_LEN);
+	printf("	.equ SCHED_FQ,		(%llu)\n",SCHED_FQ);
 	printf("	.equ SCHED_SIZE,		(%llu)\n",SCHED_SIZE);
+	printf("	.equ HEAP_NODE_KEY,	(%llu)\n",HEAP_NODE_KEY);
+	printf("	.equ FUTEX_NWAIT,		(%llu)\n",FUTEX_NWAIT);
+	if (FUTEX_BUCKET_SIZE != (1 << FUTEX_BUCKET_SHIFT))
+		return 1;
+	printf("	.equ FUTEX_BUCKET_SHIFT,	(%d)\n",FUTEX_BUCKET_SHIFT);
 
 	printf("	.extern G_SCHED\n");
 	printf("	.extern G_KERNEL_CTX\n");
@@ -5,38 +5,38 @@
 #include "timer.h"
 #include "cpu.h"
 #include "heap.h"
+#include "image.h"
+#include "kerror.h"
+#include "endpoint.h"
+#include "kobj.h"
+#include "xevt.h"
+#include "stats.h"
+#include "deadline.h"
+#include "utimer.h"
+#include "warm.h"
+#include "color.h"
 extern sched_t G_SCHED;
 extern alloc_t G_ALLOC;
 
 extern int G_VERB;
 
-static void wait_until(u64 until)
+static void wait_until(u64 until, u64 slack)
 {
-	proc_t *p, *w;
-	u64 dl;
-	//bool sched_timer;
+	proc_t *p;
 
 	uart_puts("WAIT\n");
 	dump_sched(&G_SCHED, G_VERB);
 
 	p = sched_yield(&G_SCHED);
-	p->wait_until = until;
 	p->state = PROC_WAITING;
-
-	heap_peek(&G_SCHED.waiting, &dl, (void**)&w);
-
-	//sched_timer = !sched_has_waiting(&G_SCHED);
-	sched_wait_proc(&G_SCHED, p->pid);
-	if (w == NULL || dl > until) {
-		if (w)
-			timer_cancel();
-		timer_schedule_at_ticks(until);
-	}
+	sched_sleep_slack(&G_SCHED, p, until, slack);
+	warm_arm(p, p->wait_until);
 	uart_puts("WAIT after\n");
 	dump_sched(&G_SCHED, G_VERB);
 }
 
-extern void jrt_exit(void);
+extern void jrt_exit(u64 status);
+extern void ipc_job_done(proc_t *p, u64 status);
 
 static void exit()
 {
@@ -46,115 +46,430 @@ static void exit()
 	dump_alloc(&G_ALLOC);
 	p = sched_yield(&G_SCHED);
 
+	if (p->job_id)
+		ipc_job_done(p, p->ctx.x[0]);
+	ep_proc_exit(p);
+	// the last thread takes the endpoints and objects of its process
+	if (p->as->refs == 1) {
+		ep_as_exit(p->as);
+		kobj_as_exit(p->as);
+	}
 	sched_free_proc(&G_SCHED, p->pid);
 	uart_puts("after free\n");
 	dump_alloc(&G_ALLOC);
 }
-static void spawn(u64 deadline, u64 ep, u64 ap, u64 mem_req)
+static s64 spawn(u64 deadline, u64 ep, u64 ap, u64 mem_req)
 {
 	proc_t *p;
 	u32 pid;
 	void *mem;
+	image_t *img;
 	uart_puts("SPAWN \n");
 	dump_sched(&G_SCHED, G_VERB);
 
 	//interrupts_disable_all();
-	mem = alloc(&G_ALLOC, mem_req);
+	mem = color_alloc(mem_req);
+	if (!mem)
+		return -SYS_ENOSPC;
 
+	img = image_ref(G_SCHED.curr->as->img);
 	pid = sched_new_proc(
 		&G_SCHED,
-		G_SCHED.curr->pa_pc,
-		G_SCHED.curr->prog_size,
+		img,
 		mem,
 		mem_req,
 		deadline,
 		jrt_exit);
+	if (!pid) {
+		image_put(img);
+		color_free(mem);
+		return -SYS_ENOSPC;
+	}
 	p = sched_get_proc(&G_SCHED, pid);
 	p->ctx.pc = ep;
 	p->ctx.x[2] = ap;
+	// a job is not done while its children run its image
+	sched_hold_as(p->as, G_SCHED.curr->as);
 
 	sched_ready_proc(&G_SCHED, pid);
 	sched(&G_SCHED, sched_switch_irq);
 
 	uart_puts("SPAWN after \n");
 	dump_sched(&G_SCHED, G_VERB);
+	return 0;
 }
 
-void take_syscall(u16 imm __attribute__((unused)))
+/*
+ * Like spawn, but the child joins the caller's process: same map and
+ * ASID (so switching between them touches no TTBR), same mem in x0/x1.
+ * Only the stack is allocated.
+ */
+static s64 thread(u64 deadline, u64 ep, u64 ap, u64 stack_size)
 {
-	switch (G_SCHED.curr->ctx.x[8]) {
-	case SYSCALL_WAIT_UNTIL:
-		uart_puts("take syscall WAIT_UNTIL(");
-		uart_putu64(G_SCHED.curr->pid);
-		uart_puts(", ");
-		uart_putu64(G_SCHED.curr->ctx.x[0]);
-		uart_puts(") (now:");
-		uart_putu64(time_now_ticks());
-		uart_puts(")\n");
-		wait_until(G_SCHED.curr->ctx.x[0]);
-		break;
-	case SYSCALL_EXIT:
-		uart_puts("take syscall EXIT\n");
-		exit();
-		break;
-	case SYSCALL_SPAWN:
-		uart_puts("take syscall SPAWN(");
-		uart_putu64(G_SCHED.curr->pid);
-		uart_puts(", deadline: ");
-		uart_putu64(G_SCHED.curr->ctx.x[0]);
-		uart_puts(") (entry:");
-		uart_puthex(G_SCHED.curr->ctx.x[1]);
-		uart_puts(")\n");
-
-		spawn(
-			G_SCHED.curr->ctx.x[0],
-			G_SCHED.curr->ctx.x[1],
-			G_SCHED.curr->ctx.x[2],
-			G_SCHED.curr->ctx.x[3]);
-		break;
+	proc_t *p;
+	u32 pid;
+	void *stack;
+	uart_puts("THREAD \n");
+	dump_sched(&G_SCHED, G_VERB);
+
+	stack = color_alloc(stack_size);
+	if (!stack)
+		return -SYS_ENOSPC;
+
+	pid = sched_new_thread(
+		&G_SCHED,
+		G_SCHED.curr,
+		stack,
+		stack_size,
+		deadline,
+		jrt_exit);
+	if (!pid) {
+		color_free(stack);
+		return -SYS_ENOSPC;
 	}
+	p = sched_get_proc(&G_SCHED, pid);
+	p->ctx.pc = ep;
+	p->ctx.x[2] = ap;
+
+	sched_ready_proc(&G_SCHED, pid);
+	sched(&G_SCHED, sched_switch_irq);
+
+	uart_puts("THREAD after \n");
+	dump_sched(&G_SCHED, G_VERB);
+	return 0;
+}
+
+/* slow path handlers, args still sit in p->ctx.x[] */
+static s64 do_gettime(proc_t *p)
+{
+	return time_now_ticks();
+}
+
+static s64 do_getpid(proc_t *p)
+{
+	return p->pid;
+}
+
+static s64 do_yield(proc_t *p)
+{
+	proc_t *n;
+	u64 dl;
+
+	heap_peek(&G_SCHED.ready, &dl, (void**)&n);
+	if (!n || dl > p->eff_deadline)
+		return 0;
+
+	// we go back behind procs with the same deadline
+	heap_pop(&G_SCHED.ready, &dl, (void**)&n);
+	n->state = PROC_RUNNING;
+	p->state = PROC_READY;
+	sched_ready_proc(&G_SCHED, p->pid);
+	sched_switch_irq(&G_SCHED, p, n);
+	return 0;
+}
+
+/*
+ * Sleep while *uaddr == val. Maps are per process, so a futex is the
+ * (address space, address) pair, siblings share it through p->as.
+ */
+static s64 do_futex_wait(proc_t *p)
+{
+	futex_bucket_t *b;
+	u32 *uaddr;
+
+	uaddr = (u32 *)(uintptr_t)p->ctx.x[0];
+	if ((uintptr_t)uaddr & 3)
+		return -SYS_EINVAL;
+	// we run on the caller's map, and nothing runs between here and the block
+	if (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE) != (u32)p->ctx.x[1])
+		return -SYS_EAGAIN;
+
+	b = sched_futex_bucket(&G_SCHED, uaddr);
+	p->futex_addr = uaddr;
+	p->futex_next = b->head;
+	b->head = p;
+	b->nwait++;
+
+	sched_yield(&G_SCHED);
+	p->state = PROC_WAITING;
+	return 0;
 }
-static inline u64 invoke_syscall(u64 nr, u64 a0,u64 a1,u64 a2,u64 a3,u64 a4,u64 a5)
-{
-	register u64 x8 asm("x8") = nr;
-	register u64 x0 asm("x0") = a0;
-	register u64 x1 asm("x1") = a1;
-	register u64 x2 asm("x2") = a2;
-	register u64 x3 asm("x3") = a3;
-	register u64 x4 asm("x4") = a4;
-	register u64 x5 asm("x5") = a5;
-	asm volatile("svc #0" : "+r"(x0)
-			: "r"(x1),"r"(x2),"r"(x3),"r"(x4),"r"(x5),"r"(x8)
-			: "memory","cc");
-	return x0; // return value
-}
-void syscall(syscall_t call, ...)
-{
-	va_list va;
-	u64 wait_until;
-
-	va_start(va, call);
-	switch (call) {
-	case SYSCALL_WAIT_UNTIL:
-		wait_until = va_arg(va, u64);
-		uart_puts("invoke syscall WAIT_UNTIL(");
-		uart_putu64(wait_until);
-		uart_puts(")\n");
-		invoke_syscall(SYSCALL_WAIT_UNTIL, wait_until, 0, 0, 0, 0, 0);
-		break;
-	case SYSCALL_EXIT:
-		invoke_syscall(SYSCALL_EXIT, 0, 0, 0, 0, 0, 0);
-		break;
-	case SYSCALL_SPAWN:
-		invoke_syscall(
-			SYSCALL_SPAWN,
-			va_arg(va, u64),
-			va_arg(va, u64),
-			va_arg(va, u64),
-			va_arg(va, u64),
-			0, 0);
-		break;
-	default:
-		break;
+
+static s64 do_futex_wake(proc_t *p)
+{
+	futex_bucket_t *b;
+	proc_t **pp, *w;
+	u32 *uaddr;
+	u32 n, woken;
+
+	uaddr = (u32 *)(uintptr_t)p->ctx.x[0];
+	n = p->ctx.x[1];
+	b = sched_futex_bucket(&G_SCHED, uaddr);
+
+	woken = 0;
+	pp = &b->head;
+	while (*pp && woken < n) {
+		w = *pp;
+		if (w->futex_addr != uaddr || w->as != p->as) {
+			pp = &w->futex_next;
+			continue;
+		}
+		*pp = w->futex_next;
+		w->futex_next = NULL;
+		w->futex_addr = NULL;
+		b->nwait--;
+		w->state = PROC_READY;
+		sched_ready_proc(&G_SCHED, w->pid);
+		woken++;
 	}
+
+	// one decision for all of them
+	if (woken)
+		sched(&G_SCHED, sched_switch_irq);
+	return woken;
+}
+
+static s64 do_wait_until(proc_t *p)
+{
+	uart_puts("take syscall WAIT_UNTIL(");
+	uart_putu64(p->pid);
+	uart_puts(", ");
+	uart_putu64(p->ctx.x[0]);
+	uart_puts(") (now:");
+	uart_putu64(time_now_ticks());
+	uart_puts(")\n");
+	wait_until(p->ctx.x[0], p->slack);
+	return 0;
+}
+
+static s64 do_wait_slack(proc_t *p)
+{
+	wait_until(p->ctx.x[0], p->ctx.x[1]);
+	return 0;
+}
+
+// default slack of p's waits, kobj timeouts included, returns the old one
+static s64 do_timer_slack(proc_t *p)
+{
+	u64 old;
+
+	old = p->slack;
+	p->slack = p->ctx.x[0];
+	return old;
+}
+
+static s64 do_exit(proc_t *p)
+{
+	uart_puts("take syscall EXIT\n");
+	exit();
+	return 0;
+}
+
+static s64 do_spawn(proc_t *p)
+{
+	uart_puts("take syscall SPAWN(");
+	uart_putu64(p->pid);
+	uart_puts(", deadline: ");
+	uart_putu64(p->ctx.x[0]);
+	uart_puts(") (entry:");
+	uart_puthex(p->ctx.x[1]);
+	uart_puts(")\n");
+
+	return spawn(p->ctx.x[0], p->ctx.x[1], p->ctx.x[2], p->ctx.x[3]);
+}
+
+static s64 do_thread(proc_t *p)
+{
+	uart_puts("take syscall THREAD(");
+	uart_putu64(p->pid);
+	uart_puts(", deadline: ");
+	uart_putu64(p->ctx.x[0]);
+	uart_puts(") (entry:");
+	uart_puthex(p->ctx.x[1]);
+	uart_puts(")\n");
+
+	return thread(p->ctx.x[0], p->ctx.x[1], p->ctx.x[2], p->ctx.x[3]);
+}
+
+static s64 do_ep_create(proc_t *p)
+{
+	return ep_create(p);
+}
+
+static s64 do_ep_destroy(proc_t *p)
+{
+	return ep_destroy(p, p->ctx.x[0]);
+}
+
+static s64 do_ipc_call(proc_t *p)
+{
+	return ep_call(p, p->ctx.x[0]);
+}
+
+static s64 do_ipc_reply_wait(proc_t *p)
+{
+	return ep_reply_wait(p, p->ctx.x[0]);
+}
+
+static s64 do_kobj_destroy(proc_t *p)
+{
+	return kobj_destroy(p, p->ctx.x[0]);
+}
+
+static s64 do_mq_create(proc_t *p)
+{
+	return mq_create(p, p->ctx.x[0]);
+}
+
+static s64 do_mq_send(proc_t *p)
+{
+	return mq_send(p, p->ctx.x[0], p->ctx.x[5]);
+}
+
+static s64 do_mq_recv(proc_t *p)
+{
+	return mq_recv(p, p->ctx.x[0], p->ctx.x[5]);
+}
+
+static s64 do_sem_create(proc_t *p)
+{
+	return sem_create(p, p->ctx.x[0]);
+}
+
+static s64 do_sem_wait(proc_t *p)
+{
+	return sem_wait(p, p->ctx.x[0], p->ctx.x[1]);
+}
+
+static s64 do_sem_post(proc_t *p)
+{
+	return sem_post(p, p->ctx.x[0]);
+}
+
+static s64 do_flags_create(proc_t *p)
+{
+	return flags_create(p);
+}
+
+static s64 do_flags_wait(proc_t *p)
+{
+	return flags_wait(p, p->ctx.x[0], p->ctx.x[1], p->ctx.x[2], p->ctx.x[3]);
+}
+
+static s64 do_flags_set(proc_t *p)
+{
+	return flags_set(p, p->ctx.x[0], p->ctx.x[1]);
+}
+
+static s64 do_flags_clear(proc_t *p)
+{
+	return flags_clear(p, p->ctx.x[0], p->ctx.x[1]);
+}
+
+static s64 do_xevt_wait(proc_t *p)
+{
+	return xevt_wait(p, p->ctx.x[0], p->ctx.x[1]);
+}
+
+static s64 do_xevt_signal(proc_t *p)
+{
+	return xevt_signal(p->ctx.x[0]);
+}
+
+/* where in its buffer the job left its output, for the completion record */
+static s64 do_job_output(proc_t *p)
+{
+	aspace_t *as;
+	u64 out, len;
+
+	as = p->as;
+	out = p->ctx.x[0];
+	len = p->ctx.x[1];
+	if (!as->buf || out < (uintptr_t)as->buf ||
+		out - (uintptr_t)as->buf > as->buf_size ||
+		len > as->buf_size - (out - (uintptr_t)as->buf))
+		return -SYS_EINVAL;
+
+	as->out_off = out - (uintptr_t)as->buf;
+	as->out_len = len;
+	return 0;
+}
+
+/* JRT_MISS_* for the caller's deadline, flags and bits for JRT_MISS_NOTIFY */
+static s64 do_dl_policy(proc_t *p)
+{
+	return dl_policy(p, p->ctx.x[0], p->ctx.x[1], p->ctx.x[2]);
+}
+
+static s64 do_timer_create(proc_t *p)
+{
+	return utimer_create(p, p->ctx.x[0], p->ctx.x[1], p->ctx.x[2],
+		p->ctx.x[3]);
+}
+
+static s64 do_timer_set(proc_t *p)
+{
+	return utimer_set(p, p->ctx.x[0], p->ctx.x[1], p->ctx.x[2]);
+}
+
+static s64 do_timer_cancel(proc_t *p)
+{
+	return utimer_cancel(p, p->ctx.x[0]);
+}
+
+static s64 do_timer_destroy(proc_t *p)
+{
+	return utimer_destroy(p, p->ctx.x[0]);
+}
+
+static s64 do_wake_comp(proc_t *p)
+{
+	return ktimer_comp(p->ctx.x[0]);
+}
+
+static s64 do_warm_range(proc_t *p)
+{
+	return warm_set_range(p, p->ctx.x[0], p->ctx.x[1], p->ctx.x[2]);
+}
+
+static s64 do_warm_lead(proc_t *p)
+{
+	return warm_set_lead(p, p->ctx.x[0]);
+}
+
+#define SYSCALL_CHECK(NAME, name, kind, ...)				\
+	_Static_assert(!SYSCALL_IS_##kind || (int)SYSCALL_##NAME < SYSCALL_FAST_END, \
+		"FAST syscalls must come first in SYSCALL_TABLE");
+SYSCALL_TABLE(SYSCALL_CHECK)
+#undef SYSCALL_CHECK
+
+#define SYSCALL_HANDLER(NAME, name, ...)	[SYSCALL_##NAME] = do_##name,
+static s64 (*const G_SYSCALLS[SYSCALL_MAX])(proc_t *p) = {
+	SYSCALL_TABLE(SYSCALL_HANDLER)
+};
+#undef SYSCALL_HANDLER
+
+/*
+ * The result goes to the caller's saved x0, which is where it is picked
+ * up whether or not the handler switched away from it. Only calls that
+ * return to their caller are timed, a blocked one is a wakeup later.
+ */
+void take_syscall(u16 imm __attribute__((unused)))
+{
+	proc_t *p;
+	u64 nr, t0;
+	s64 r;
+
+	t0 = time_now_ticks();
+	p = G_SCHED.curr;
+	nr = p->ctx.x[8];
+	if (nr >= SYSCALL_MAX) {
+		p->ctx.x[0] = -SYS_ENOSYS;
+		return;
+	}
+
+	r = G_SYSCALLS[nr](p);
+	p->ctx.x[0] = r;
+	if (G_SCHED.curr == p)
+		stats_hist(JRT_HIST_SYSCALL, time_now_ticks() - t0);
 }
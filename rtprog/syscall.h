@@ -1,17 +1,131 @@
-
 // Author: Gustaf Franzen <gustaffranzen@icloud.com>
 #ifndef _SYSCALL_H_
 #define _SYSCALL_H_
 #include "uart.h"
-#include "stdarg.h"
+#include "syscall_table.h"
 
+#define SYSCALL_ENUM(NAME, ...)	SYSCALL_##NAME,
 typedef enum syscall {
-	SYSCALL_WAIT_UNTIL,
-	SYSCALL_EXIT,
-	SYSCALL_SPAWN
+	SYSCALL_TABLE(SYSCALL_ENUM)
 } syscall_t;
+#undef SYSCALL_ENUM
+
+// SYSCALL_NFAST can not be expanded inside another SYSCALL_TABLE()
+enum { SYSCALL_FAST_END = SYSCALL_NFAST };
+
+/*
+ * Both paths leave every register but x0 as it was, so the stubs only
+ * clobber memory. No call out of line, the svc lands in the caller.
+ */
+static inline u64 __syscall4(u64 nr, u64 a0, u64 a1, u64 a2, u64 a3)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
+	register u64 x1 asm("x1") = a1;
+	register u64 x2 asm("x2") = a2;
+	register u64 x3 asm("x3") = a3;
+
+	asm volatile("svc #0" : "+r"(x0)
+			: "r"(x1), "r"(x2), "r"(x3), "r"(x8)
+			: "memory");
+	return x0;
+}
+
+static inline u64 __syscall3(u64 nr, u64 a0, u64 a1, u64 a2)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
+	register u64 x1 asm("x1") = a1;
+	register u64 x2 asm("x2") = a2;
+
+	asm volatile("svc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x8) : "memory");
+	return x0;
+}
+
+static inline u64 __syscall2(u64 nr, u64 a0, u64 a1)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
+	register u64 x1 asm("x1") = a1;
+
+	asm volatile("svc #0" : "+r"(x0) : "r"(x1), "r"(x8) : "memory");
+	return x0;
+}
+
+static inline u64 __syscall1(u64 nr, u64 a0)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
 
+	asm volatile("svc #0" : "+r"(x0) : "r"(x8) : "memory");
+	return x0;
+}
+
+static inline u64 __syscall0(u64 nr)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0");
+
+	asm volatile("svc #0" : "=r"(x0) : "r"(x8) : "memory");
+	return x0;
+}
+
+/* synchronous IPC payload, travels in x1..x4 */
+#define IPC_MSG_WORDS 4
+typedef struct ipc_msg {
+	u64 w[IPC_MSG_WORDS];
+} ipc_msg_t;
+
+static inline u64 __syscallmsg(u64 nr, u64 a0, ipc_msg_t *m)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
+	register u64 x1 asm("x1") = m->w[0];
+	register u64 x2 asm("x2") = m->w[1];
+	register u64 x3 asm("x3") = m->w[2];
+	register u64 x4 asm("x4") = m->w[3];
+
+	asm volatile("svc #0"
+			: "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3), "+r"(x4)
+			: "r"(x8)
+			: "memory");
+	m->w[0] = x1;
+	m->w[1] = x2;
+	m->w[2] = x3;
+	m->w[3] = x4;
+	return x0;
+}
+
+static inline u64 __syscallmsgt(u64 nr, u64 a0, ipc_msg_t *m, u64 a1)
+{
+	register u64 x8 asm("x8") = nr;
+	register u64 x0 asm("x0") = a0;
+	register u64 x1 asm("x1") = m->w[0];
+	register u64 x2 asm("x2") = m->w[1];
+	register u64 x3 asm("x3") = m->w[2];
+	register u64 x4 asm("x4") = m->w[3];
+	register u64 x5 asm("x5") = a1;
+
+	asm volatile("svc #0"
+			: "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3), "+r"(x4)
+			: "r"(x5), "r"(x8)
+			: "memory");
+	m->w[0] = x1;
+	m->w[1] = x2;
+	m->w[2] = x3;
+	m->w[3] = x4;
+	return x0;
+}
+
+#define SYSCALL_ARGS(...)	, ##__VA_ARGS__
+#define SYSCALL_STUB(NAME, name, kind, ret, nargs, proto, args)	\
+	static inline ret sys_##name proto				\
+	{								\
+		return (ret)__syscall##nargs(SYSCALL_##NAME SYSCALL_ARGS args); \
+	}
+SYSCALL_TABLE(SYSCALL_STUB)
+#undef SYSCALL_STUB
 
 void take_syscall(u16 imm);
-void syscall(syscall_t call, ...);
 #endif
+
@@ -0,0 +1,129 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _SYSCALL_TABLE_H_
+#define _SYSCALL_TABLE_H_
+
+/*
+ * The one list of syscalls. Every other table (the enum, the typed stubs,
+ * the C dispatch table and the assembly fast path jump table) is expanded
+ * from it, so they can not drift apart.
+ *
+ * X(NAME, name, kind, ret, nargs, proto, args)
+ *	kind	FAST: sync_el1 may answer it without saving the context,
+ *		      falling back to the C handler when it can not.
+ *		SLOW: always goes through take_syscall.
+ *	proto	parameter list of the sys_<name>() stub
+ *	args	the parameters as u64, in x0..x(nargs-1) order
+ *	nargs	0..4, or msg: x0 = args, x1..x4 = *msg in and out,
+ *		or msgt: msg plus a timeout in x5
+ *
+ * FAST entries must come first, their numbers index the fast path table.
+ * Macros only, this file is included from assembly.
+ */
+#define SYSCALL_TABLE(X)						\
+	X(GETTIME, gettime, FAST, u64, 0, (void), ())			\
+	X(GETPID, getpid, FAST, u32, 0, (void), ())			\
+	X(YIELD, yield, FAST, s64, 0, (void), ())			\
+	X(FUTEX_WAKE, futex_wake, FAST, s64, 2,				\
+		(u32 *uaddr, u32 n),					\
+		((u64)(uintptr_t)uaddr, n))				\
+	X(FUTEX_WAIT, futex_wait, SLOW, s64, 2,				\
+		(u32 *uaddr, u32 val),					\
+		((u64)(uintptr_t)uaddr, val))				\
+	X(WAIT_UNTIL, wait_until, SLOW, s64, 1,				\
+		(u64 ticks), (ticks))					\
+	X(EXIT, exit, SLOW, s64, 1, (u64 status), (status))		\
+	X(SPAWN, spawn, SLOW, s64, 4,					\
+		(u64 deadline, void *ep, void *ap, u64 mem_req),	\
+		(deadline, (u64)(uintptr_t)ep, (u64)(uintptr_t)ap, mem_req)) \
+	X(THREAD, thread, SLOW, s64, 4,					\
+		(u64 deadline, void *ep, void *ap, u64 stack_size),	\
+		(deadline, (u64)(uintptr_t)ep, (u64)(uintptr_t)ap, stack_size)) \
+	X(EP_CREATE, ep_create, SLOW, s64, 0, (void), ())		\
+	X(EP_DESTROY, ep_destroy, SLOW, s64, 1, (u32 ep), (ep))		\
+	X(IPC_CALL, ipc_call, SLOW, s64, msg,				\
+		(u32 ep, ipc_msg_t *msg), (ep, msg))			\
+	X(IPC_REPLY_WAIT, ipc_reply_wait, SLOW, s64, msg,		\
+		(u32 ep, ipc_msg_t *msg), (ep, msg))			\
+	X(KOBJ_DESTROY, kobj_destroy, SLOW, s64, 1, (u32 id), (id))	\
+	X(MQ_CREATE, mq_create, SLOW, s64, 1, (u32 depth), (depth))	\
+	X(MQ_SEND, mq_send, SLOW, s64, msgt,				\
+		(u32 id, ipc_msg_t *msg, u64 until), (id, msg, until))	\
+	X(MQ_RECV, mq_recv, SLOW, s64, msgt,				\
+		(u32 id, ipc_msg_t *msg, u64 until), (id, msg, until))	\
+	X(SEM_CREATE, sem_create, SLOW, s64, 1, (u64 count), (count))	\
+	X(SEM_WAIT, sem_wait, SLOW, s64, 2,				\
+		(u32 id, u64 until), (id, until))			\
+	X(SEM_POST, sem_post, SLOW, s64, 1, (u32 id), (id))		\
+	X(FLAGS_CREATE, flags_create, SLOW, s64, 0, (void), ())		\
+	X(FLAGS_WAIT, flags_wait, SLOW, s64, 4,				\
+		(u32 id, u64 mask, u32 mode, u64 until),		\
+		(id, mask, mode, until))				\
+	X(FLAGS_SET, flags_set, SLOW, s64, 2,				\
+		(u32 id, u64 bits), (id, bits))				\
+	X(FLAGS_CLEAR, flags_clear, SLOW, s64, 2,			\
+		(u32 id, u64 bits), (id, bits))				\
+	X(XEVT_WAIT, xevt_wait, SLOW, s64, 2,				\
+		(u64 mask, u64 until), (mask, until))			\
+	X(XEVT_SIGNAL, xevt_signal, SLOW, s64, 1, (u64 bits), (bits))	\
+	X(JOB_OUTPUT, job_output, SLOW, s64, 2,				\
+		(const void *out, u64 len), ((u64)(uintptr_t)out, len))	\
+	X(DL_POLICY, dl_policy, SLOW, s64, 3,				\
+		(u32 policy, u32 flags, u64 bits), (policy, flags, bits)) \
+	X(TIMER_CREATE, timer_create, SLOW, s64, 4,			\
+		(u32 how, u64 target, u64 arg, u64 stack_size),		\
+		(how, target, arg, stack_size))				\
+	X(TIMER_SET, timer_set, SLOW, s64, 3,				\
+		(u32 id, u64 expires, u64 period), (id, expires, period)) \
+	X(TIMER_CANCEL, timer_cancel, SLOW, s64, 1, (u32 id), (id))	\
+	X(TIMER_DESTROY, timer_destroy, SLOW, s64, 1, (u32 id), (id))	\
+	X(WAKE_COMP, wake_comp, SLOW, s64, 1, (u32 permille), (permille)) \
+	X(WAIT_SLACK, wait_slack, SLOW, s64, 2,				\
+		(u64 ticks, u64 slack), (ticks, slack))			\
+	X(TIMER_SLACK, timer_slack, SLOW, s64, 1, (u64 slack), (slack))	\
+	X(WARM_RANGE, warm_range, SLOW, s64, 3,				\
+		(const void *addr, u64 len, u32 flags),			\
+		((u64)(uintptr_t)addr, len, flags))			\
+	X(WARM_LEAD, warm_lead, SLOW, s64, 1, (u64 ticks), (ticks))
+
+#define SYSCALL_IS_FAST		1
+#define SYSCALL_IS_SLOW		0
+
+#define SYSCALL_COUNT_FAST(NAME, name, kind, ...)	+SYSCALL_IS_##kind
+#define SYSCALL_COUNT(NAME, ...)			+1
+
+/* plain expressions, usable as assembler immediates */
+#define SYSCALL_NFAST	(0 SYSCALL_TABLE(SYSCALL_COUNT_FAST))
+#define SYSCALL_MAX	(0 SYSCALL_TABLE(SYSCALL_COUNT))
+
+/* futex wait queues, hashed on the user address */
+#define FUTEX_HASH_SHIFT	2
+#define FUTEX_HASH_BITS		6
+#define FUTEX_BUCKETS		(1 << FUTEX_HASH_BITS)
+
+/* timeouts are absolute CNTPCT ticks, or one of these */
+#define KOBJ_NOWAIT	0
+#define KOBJ_FOREVER	(~0ull)
+
+/* flags_wait mode */
+#define FLAGS_ANY	0
+#define FLAGS_ALL	(1 << 0)
+#define FLAGS_CONSUME	(1 << 1)	/* clear the bits that woke us */
+
+/* timer_create delivery, see utimer.h */
+#define TIMER_WAKE	0	/* raise arg in the flags object target */
+#define TIMER_UPCALL	1	/* run target in a new thread */
+
+/* warm_range flags, see warm.h */
+#define WARM_DATA	0
+#define WARM_CODE	(1 << 0)	/* instructions, prefetched for fetch */
+
+/* syscall return values, errors are negated */
+#define SYS_EAGAIN	11
+#define SYS_EBUSY	16
+#define SYS_EINVAL	22
+#define SYS_ENOSPC	28
+#define SYS_EPIPE	32
+#define SYS_ENOSYS	38
+#define SYS_ETIMEDOUT	110
+
+#endif
@@ -1,14 +1,31 @@
 
 // Author Gustaf Franzen <gustaffranzen@icloud.com>
 #include "timer.h"
+#include "ktimer.h"
+#include "clock.h"
 
 
 static u64 g_cntfrq;
 
+/*
+ * mult/shift pairs from shared/clock.h, the same ones the rtcore module
+ * publishes on the clock page, so both sides convert identically and no
+ * conversion on the hot path divides.
+ */
+static u64 g_ns_mult, g_tick_ns_mult, g_us_mult, g_tick_us_mult;
+static u32 g_ns_shift, g_tick_ns_shift, g_us_shift, g_tick_us_shift;
+
 
 void timebase_init(void)
 {
 	g_cntfrq = sys_mrs_cntfrq();
+
+	jrt_clock_factors(g_cntfrq, JRT_NSEC_PER_SEC, &g_ns_mult, &g_ns_shift);
+	jrt_clock_factors(JRT_NSEC_PER_SEC, g_cntfrq, &g_tick_ns_mult,
+		&g_tick_ns_shift);
+	jrt_clock_factors(g_cntfrq, 1000000ULL, &g_us_mult, &g_us_shift);
+	jrt_clock_factors(1000000ULL, g_cntfrq, &g_tick_us_mult,
+		&g_tick_us_shift);
 }
 
 u64 time_now_ticks(void)
@@ -18,63 +35,22 @@ u64 time_now_ticks(void)
 
 u64 ticks_from_ns(u64 ns)
 {
-	u64 sec, rem, t, num;
-
-	sec = ns / 1000000000ULL;
-	rem = ns % 1000000000ULL;
-
-	t = sec * g_cntfrq;
-
-	// rem*g_cntfrq fits in 64-bit (<= ~1e18 for typical frq), then divide by 1e9
-	num = rem * g_cntfrq + 500000000ULL;   // +0.5e9 for rounding
-	t += num / 1000000000ULL;
-
-	return t;
+	return jrt_mul_shift(ns, g_tick_ns_mult, g_tick_ns_shift);
 }
 
 u64 ticks_from_us(u64 us)
 {
-	u64 sec, rem, t, num;
-
-	sec = us / 1000000ULL;
-	rem = us % 1000000ULL;
-
-	t = sec * g_cntfrq;
-
-	num = rem * g_cntfrq + 500000ULL;      // +0.5e6 for rounding
-	t += num / 1000000ULL;
-
-	return t;
+	return jrt_mul_shift(us, g_tick_us_mult, g_tick_us_shift);
 }
 
 u64 ns_from_ticks(u64 t)
 {
-	u64 sec, rem, ns, num;
-
-	sec = t / g_cntfrq;
-	rem = t % g_cntfrq;
-
-	ns = sec * 1000000000ULL;
-
-	// rem*1e9 can be up to ~1e9*1e9 = 1e18 (fits in 64-bit)
-	num = rem * 1000000000ULL;
-	ns += num / g_cntfrq;
-
-	return ns;
+	return jrt_mul_shift(t, g_ns_mult, g_ns_shift);
 }
 
 u64 us_from_ticks(u64 t)
 {
-	u64 sec, rem, us, num;
-
-	sec = t / g_cntfrq;
-	rem = t % g_cntfrq;
-
-	us = sec * 1000000ULL;
-	num = rem * 1000000ULL;
-	us += num / g_cntfrq;
-
-	return us;
+	return jrt_mul_shift(t, g_us_mult, g_us_shift);
 }
 
 u64 time_now_ns(void)
@@ -111,9 +87,11 @@ void timer_cancel(void)
 	asm volatile("isb");
 }
 
-static u64	g_next_cval;      /* absolute next deadline (CNTPCT units) */
-static u64	g_period_ticks;   /* period in ticks */
-
+/*
+ * The periodic tick is one more ktimer, it shares CNTP with the
+ * scheduler and the process timers instead of owning the compare value.
+ */
+static ktimer_t g_periodic;
 static timer_func_t g_timer_func;
 
 void set_timer_func(timer_func_t tf)
@@ -121,24 +99,23 @@ void set_timer_func(timer_func_t tf)
 	g_timer_func = tf;
 }
 
+static bool periodic_fn(ktimer_t *t, ctx_t *c, u64 now)
+{
+	if (g_timer_func)
+		g_timer_func(c);
+	return false;
+}
+
 void start_periodic_task(u64 ticks)
 {
-	u64	now;
 	int	rc;
-	u32	ctl;
-
-	g_period_ticks = ticks;
 
 	/* enable EL1 physical timer PPI = 30, prio mid (0x80), Group1NS */
 	rc = gic_enable_ppi(30u, 0x80u, 1);
 	(void)rc;
 
-	now = sys_mrs_cntpct();
-	g_next_cval = now + ticks;
-	sys_msr_cntp_cval(g_next_cval);
-
-	ctl = 1u;	/* ENABLE=1, IMASK=0 */
-	sys_msr_cntp_ctl(ctl);
+	ktimer_setup(&g_periodic, periodic_fn);
+	ktimer_start(&g_periodic, sys_mrs_cntpct() + ticks, ticks);
 
 	/* unmask IRQs in PSTATE */
 	asm volatile("msr DAIFClr, #2\n\tisb");
@@ -159,32 +136,8 @@ void start_periodic_task_freq(u64 hz)
 
 void stop_periodic_task(void)
 {
-	u32	v;
-
-	v = 0;
-	asm volatile("msr CNTP_CTL_EL0, %0" :: "r"(v));
-	asm volatile("isb");
-}
-
-void timer_irq_handler(ctx_t *c)
-{
-	u64	now;
-	u64	next;
-	u64	period;
-
-
-	now = 0;
-	next = g_next_cval;
-
-	g_timer_func(c);
-
-	period = g_period_ticks;
-
-	/* skip forward until next > now */
-	asm volatile("mrs %0, CNTPCT_EL0" : "=r"(now));
-	while (next <= now)
-		next = next + period;
-
-	g_next_cval = next;
-	asm volatile("msr CNTP_CVAL_EL0, %0" :: "r"(next));
+	// never started, the node is not set up
+	if (!g_periodic.fn)
+		return;
+	ktimer_stop(&g_periodic);
 }
@@ -27,6 +27,4 @@ void set_timer_func(timer_func_t tf);
 void start_periodic_task(u64 ticks);
 void start_periodic_task_freq(u64 hz);
 void stop_periodic_task(void);
-
-void timer_irq_handler(ctx_t *c);
 #endif
@@ -0,0 +1,264 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "twheel.h"
+
+static inline u32 tw_digit(u64 b, u32 l)
+{
+	return (b >> (l * TW_BITS)) & TW_MASK;
+}
+
+// slots strictly after digit d
+static inline u64 tw_after(u64 pending, u32 d)
+{
+	return pending & ~((2ull << d) - 1);
+}
+
+static void tw_link(twheel_t *w, tw_node_t *n, u32 l, u32 s)
+{
+	n->slot = l * TW_SLOTS + s;
+	n->prev = NULL;
+	n->next = w->head[l][s];
+	if (n->next)
+		n->next->prev = n;
+	w->head[l][s] = n;
+	if (!(w->pending[l] & (1ull << s)) || n->expires < w->min[l][s])
+		w->min[l][s] = n->expires;
+	w->pending[l] |= 1ull << s;
+}
+
+static void tw_unlink(twheel_t *w, tw_node_t *n)
+{
+	u32 l, s;
+
+	l = n->slot / TW_SLOTS;
+	s = n->slot % TW_SLOTS;
+	if (n->prev)
+		n->prev->next = n->next;
+	else
+		w->head[l][s] = n->next;
+	if (n->next)
+		n->next->prev = n->prev;
+	if (!w->head[l][s])
+		w->pending[l] &= ~(1ull << s);
+	n->slot = TW_NO_SLOT;
+}
+
+static void tw_slot_min(twheel_t *w, u32 l, u32 s)
+{
+	tw_node_t *n;
+	u64 min;
+
+	min = ~0ull;
+	for (n = w->head[l][s]; n; n = n->next) {
+		if (n->expires < min)
+			min = n->expires;
+	}
+	w->min[l][s] = min;
+}
+
+// the highest digit where the bucket differs from the clock picks the level
+static void tw_place(twheel_t *w, tw_node_t *n)
+{
+	u64 b, x;
+	u32 l;
+
+	b = n->expires >> TW_SHIFT;
+	if (b < w->clk)
+		b = w->clk;
+	x = b ^ w->clk;
+	l = x ? (63 - __builtin_clzll(x)) / TW_BITS : 0;
+	if (l >= TW_LEVELS) {
+		// slot 0 of the top level moves down at the next wrap
+		tw_link(w, n, TW_LEVELS - 1, 0);
+		return;
+	}
+	tw_link(w, n, l, tw_digit(b, l));
+}
+
+void tw_add(twheel_t *w, tw_node_t *n, u64 expires)
+{
+	n->expires = expires;
+	// nothing to keep in place, start the clock at the new node
+	if (!w->count && (expires >> TW_SHIFT) > w->clk)
+		w->clk = expires >> TW_SHIFT;
+	tw_place(w, n);
+	w->count++;
+}
+
+void tw_del(twheel_t *w, tw_node_t *n)
+{
+	u32 l, s;
+
+	if (!tw_queued(n))
+		return;
+	l = n->slot / TW_SLOTS;
+	s = n->slot % TW_SLOTS;
+	tw_unlink(w, n);
+	w->count--;
+	// keep the slot minimum exact, or the timer fires for nothing
+	if (w->head[l][s] && n->expires == w->min[l][s])
+		tw_slot_min(w, l, s);
+}
+
+/*
+ * Level by level the first non-empty slot after the clock holds that
+ * level's earliest nodes: later slots of the current window, then the
+ * wrapped ones.
+ */
+u64 tw_next(twheel_t *w)
+{
+	u64 best, m;
+	u32 l, s;
+
+	best = ~0ull;
+	for (l = 0; l < TW_LEVELS; ++l) {
+		if (!w->pending[l])
+			continue;
+		m = l ? tw_after(w->pending[l], tw_digit(w->clk, l)) :
+			w->pending[0] & ~((1ull << tw_digit(w->clk, 0)) - 1);
+		s = __builtin_ctzll(m ? m : w->pending[l]);
+		if (w->min[l][s] < best)
+			best = w->min[l][s];
+	}
+	return best;
+}
+
+static bool tw_slot_has(twheel_t *w, u32 l, u32 s, u64 expires)
+{
+	tw_node_t *n;
+
+	if (!(w->pending[l] & (1ull << s)) || w->min[l][s] > expires)
+		return false;
+	for (n = w->head[l][s]; n; n = n->next) {
+		if (n->expires == expires)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * A node sits in its bucket's slot on the level tw_place picks now or,
+ * placed before the clock moved on, on one above it. Far nodes are
+ * parked in slot 0 of the top level.
+ */
+bool tw_pending_at(twheel_t *w, u64 expires)
+{
+	u64 b, x;
+	u32 l;
+
+	b = expires >> TW_SHIFT;
+	if (b < w->clk)
+		return false;
+	x = b ^ w->clk;
+	for (l = x ? (63 - __builtin_clzll(x)) / TW_BITS : 0; l < TW_LEVELS; ++l) {
+		if (tw_slot_has(w, l, tw_digit(b, l), expires))
+			return true;
+	}
+	return tw_slot_has(w, TW_LEVELS - 1, 0, expires);
+}
+
+// first bucket after the clock where a slot is due or has to move down
+static u64 tw_next_bucket(twheel_t *w)
+{
+	u64 best, base, b, m;
+	u32 l, span;
+
+	best = ~0ull;
+	for (l = 0; l < TW_LEVELS; ++l) {
+		if (!w->pending[l])
+			continue;
+		span = l * TW_BITS;
+		base = (w->clk >> (span + TW_BITS)) << (span + TW_BITS);
+		m = tw_after(w->pending[l], tw_digit(w->clk, l));
+		if (m)
+			b = base + ((u64)__builtin_ctzll(m) << span);
+		else
+			b = base + (1ull << (span + TW_BITS)) +
+				((u64)__builtin_ctzll(w->pending[l]) << span);
+		if (b < best)
+			best = b;
+	}
+	return best;
+}
+
+// the clock just entered these slots, their nodes go down a level or more
+static void tw_cascade(twheel_t *w)
+{
+	tw_node_t *n, *next;
+	u32 l, s;
+
+	for (l = TW_LEVELS - 1; l > 0; --l) {
+		if (w->clk & ((1ull << (l * TW_BITS)) - 1))
+			continue;
+		s = tw_digit(w->clk, l);
+		n = w->head[l][s];
+		w->head[l][s] = NULL;
+		w->pending[l] &= ~(1ull << s);
+		for (; n; n = next) {
+			next = n->next;
+			tw_place(w, n);
+		}
+	}
+}
+
+// move the nodes of the current bucket due by limit to *out
+static u32 tw_take(twheel_t *w, u64 limit, tw_node_t **out)
+{
+	tw_node_t *n, *next;
+	u64 min;
+	u32 s, taken;
+
+	s = tw_digit(w->clk, 0);
+	min = ~0ull;
+	taken = 0;
+	for (n = w->head[0][s]; n; n = next) {
+		next = n->next;
+		if (n->expires > limit) {
+			if (n->expires < min)
+				min = n->expires;
+			continue;
+		}
+		tw_unlink(w, n);
+		n->next = *out;
+		*out = n;
+		taken++;
+	}
+	w->min[0][s] = min;
+	w->count -= taken;
+	return taken;
+}
+
+u32 tw_expire(twheel_t *w, u64 now, tw_node_t **out)
+{
+	u64 target, next;
+	u32 n;
+
+	*out = NULL;
+	n = 0;
+	target = now >> TW_SHIFT;
+	while (w->count && w->clk < target) {
+		// a bucket behind now is due as a whole
+		n += tw_take(w, ~0ull, out);
+		next = tw_next_bucket(w);
+		w->clk = next < target ? next : target;
+		tw_cascade(w);
+	}
+	if (w->count)
+		n += tw_take(w, now, out);
+	if (!w->count && w->clk < target)
+		w->clk = target;
+	return n;
+}
+
+void tw_iter(twheel_t *w, void *arg, void (*iterf)(bool, tw_node_t*, void*))
+{
+	tw_node_t *n;
+	u32 l, s, left;
+
+	left = w->count;
+	for (l = 0; l < TW_LEVELS; ++l) {
+		for (s = 0; s < TW_SLOTS; ++s) {
+			for (n = w->head[l][s]; n; n = n->next)
+				iterf(--left == 0, n, arg);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _TWHEEL_H_
+#define _TWHEEL_H_
+
+#include "types.h"
+#include "twheel_structs.h"
+
+/*
+ * Hierarchical timing wheel of CNTPCT deadlines.
+ *
+ * Level 0 has a slot per 2^TW_SHIFT tick bucket, every level above is
+ * TW_SLOTS times coarser. A node sits on the lowest level where its
+ * bucket differs from the wheel clock in no higher digit, and moves
+ * down when the clock reaches its slot. Adding is O(1), so is deleting
+ * unless the node was its slot's earliest, and there is no limit on the
+ * number of nodes.
+ *
+ * Buckets only order nodes, the last step compares the exact expiry,
+ * so nothing is released early. tw_expire() hands back everything due
+ * in one list, however many nodes share the instant. Empty stretches
+ * are skipped with the pending bitmaps, not walked bucket by bucket.
+ *
+ * Nodes more than 2^(TW_SHIFT + TW_LEVELS * TW_BITS) ticks away are
+ * parked in the top level and placed again on the next wrap.
+ */
+
+static inline void tw_init(twheel_t *w)
+{
+	u32 l, s;
+
+	w->clk = 0;
+	w->count = 0;
+	for (l = 0; l < TW_LEVELS; ++l) {
+		w->pending[l] = 0;
+		for (s = 0; s < TW_SLOTS; ++s)
+			w->head[l][s] = NULL;
+	}
+}
+
+static inline void tw_node_init(tw_node_t *n)
+{
+	n->next = NULL;
+	n->prev = NULL;
+	n->slot = TW_NO_SLOT;
+}
+
+static inline bool tw_empty(const twheel_t *w) { return w->count == 0; }
+static inline bool tw_queued(const tw_node_t *n) { return n->slot != TW_NO_SLOT; }
+
+void tw_add(twheel_t *w, tw_node_t *n, u64 expires);
+void tw_del(twheel_t *w, tw_node_t *n);
+// earliest expiry on the wheel, ~0 when empty
+u64 tw_next(twheel_t *w);
+// true if a node expires at exactly expires
+bool tw_pending_at(twheel_t *w, u64 expires);
+// unlink every node due at now into *out, linked through next
+u32 tw_expire(twheel_t *w, u64 now, tw_node_t **out);
+// invokes iterf(last, node, arg) for each node, in no particular order
+void tw_iter(twheel_t *w, void *arg, void (*iterf)(bool, tw_node_t*, void*));
+
+#endif
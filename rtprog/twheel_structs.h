@@ -0,0 +1,30 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _TWHEEL_STRUCTS_H_
+#define _TWHEEL_STRUCTS_H_
+
+#include "types.h"
+
+#define TW_SHIFT	8	/* level 0 bucket: 256 CNTPCT ticks */
+#define TW_BITS		6
+#define TW_SLOTS	(1u << TW_BITS)
+#define TW_MASK		(TW_SLOTS - 1)
+#define TW_LEVELS	4	/* 2^32 ticks before parking */
+
+#define TW_NO_SLOT	(~0u)
+
+typedef struct tw_node {
+	struct tw_node *next;
+	struct tw_node *prev;
+	u64 expires;		/* CNTPCT */
+	u32 slot;		/* level * TW_SLOTS + slot, or TW_NO_SLOT */
+} tw_node_t;
+
+typedef struct twheel {
+	u64 clk;				/* current level 0 bucket */
+	u64 pending[TW_LEVELS];			/* slots with nodes */
+	u64 min[TW_LEVELS][TW_SLOTS];		/* earliest expiry in the slot */
+	tw_node_t *head[TW_LEVELS][TW_SLOTS];
+	u32 count;
+} twheel_t;
+
+#endif
@@ -0,0 +1,188 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "utimer.h"
+#include "ktimer.h"
+#include "sched.h"
+#include "kobj.h"
+#include "color.h"
+#include "uart.h"
+#include "warm.h"
+
+extern sched_t G_SCHED;
+extern void jrt_exit(u64 status);
+
+static utimer_t G_UTIMER[UTIMER_MAX];
+
+void utimer_init(void)
+{
+	u32 i;
+
+	for (i = 0; i < UTIMER_MAX; ++i)
+		G_UTIMER[i].owner = NULL;
+}
+
+static utimer_t *utimer_get(proc_t *p, u64 id)
+{
+	if (id >= UTIMER_MAX || !G_UTIMER[id].owner)
+		return NULL;
+	if (G_UTIMER[id].owner->as != p->as)
+		return NULL;
+	return &G_UTIMER[id];
+}
+
+static bool utimer_upcall(utimer_t *t)
+{
+	proc_t *p;
+	void *stack;
+	u64 dl;
+	u32 pid;
+
+	// one at a time, a late upcall is not queued behind the running one
+	if (t->upcall) {
+		uart_puts("[TIMER] upcall still running, expiry dropped\n");
+		return false;
+	}
+	stack = color_alloc(t->stack_size);
+	if (!stack) {
+		uart_puts("[TIMER] no memory for the upcall stack\n");
+		return false;
+	}
+	// a periodic timer is already queued for its next release
+	dl = t->kt.period ? t->kt.node.expires : t->owner->abs_deadline;
+	pid = sched_new_thread(
+		&G_SCHED,
+		t->owner,
+		stack,
+		t->stack_size,
+		dl,
+		jrt_exit);
+	if (!pid) {
+		uart_puts("[TIMER] no proc left for the upcall\n");
+		color_free(stack);
+		return false;
+	}
+	p = sched_get_proc(&G_SCHED, pid);
+	p->ctx.pc = t->target;
+	p->ctx.x[2] = t->arg;
+	p->upcall_of = t;
+	t->upcall = p;
+	sched_ready_proc(&G_SCHED, pid);
+	return true;
+}
+
+static bool utimer_fn(ktimer_t *kt, struct ctx *c, u64 now)
+{
+	utimer_t *t;
+	s64 n;
+
+	t = (utimer_t *)kt;
+	if (t->how == TIMER_UPCALL)
+		return utimer_upcall(t);
+	n = flags_raise(t->owner->as, t->target, t->arg);
+	if (n < 0)
+		uart_puts("[TIMER] wake: no such flags object\n");
+	return n > 0;
+}
+
+static bool utimer_warm_fn(ktimer_t *kt, struct ctx *c, u64 now)
+{
+	utimer_t *t;
+
+	t = (utimer_t *)((u8 *)kt - __builtin_offsetof(utimer_t, warm));
+	warm_touch(t->owner->as, NULL);
+	return false;
+}
+
+s64 utimer_create(proc_t *p, u64 how, u64 target, u64 arg, u64 stack_size)
+{
+	utimer_t *t;
+	u32 i;
+
+	if (how == TIMER_WAKE) {
+		if (!arg)
+			return -SYS_EINVAL;
+	} else if (how == TIMER_UPCALL) {
+		if (!target || !stack_size)
+			return -SYS_EINVAL;
+	} else {
+		return -SYS_EINVAL;
+	}
+
+	for (i = 0; i < UTIMER_MAX; ++i) {
+		t = &G_UTIMER[i];
+		if (t->owner)
+			continue;
+		ktimer_setup(&t->kt, utimer_fn);
+		ktimer_setup(&t->warm, utimer_warm_fn);
+		t->owner = p;
+		t->how = how;
+		t->target = target;
+		t->arg = arg;
+		t->stack_size = stack_size;
+		t->upcall = NULL;
+		p->ntimers++;
+		return i;
+	}
+	return -SYS_ENOSPC;
+}
+
+s64 utimer_set(proc_t *p, u64 id, u64 expires, u64 period)
+{
+	utimer_t *t;
+	u64 lead;
+
+	t = utimer_get(p, id);
+	if (!t)
+		return -SYS_EINVAL;
+	ktimer_stop(&t->warm);
+	if (!expires) {
+		ktimer_stop(&t->kt);
+		return 0;
+	}
+	ktimer_start(&t->kt, expires, period);
+	// the lead is sampled here, a later sys_warm_lead() needs a re-arm
+	lead = warm_lead(p->as);
+	if (lead && expires > lead && p->as->warm->n)
+		ktimer_start(&t->warm, expires - lead, period);
+	return 0;
+}
+
+s64 utimer_cancel(proc_t *p, u64 id)
+{
+	return utimer_set(p, id, 0, 0);
+}
+
+static void utimer_free(utimer_t *t)
+{
+	ktimer_stop(&t->kt);
+	ktimer_stop(&t->warm);
+	// the upcall runs on, it just no longer reports back
+	if (t->upcall)
+		t->upcall->upcall_of = NULL;
+	t->owner->ntimers--;
+	t->owner = NULL;
+}
+
+s64 utimer_destroy(proc_t *p, u64 id)
+{
+	utimer_t *t;
+
+	t = utimer_get(p, id);
+	if (!t)
+		return -SYS_EINVAL;
+	utimer_free(t);
+	return 0;
+}
+
+void utimer_proc_exit(proc_t *p)
+{
+	u32 i;
+
+	if (p->upcall_of) {
+		p->upcall_of->upcall = NULL;
+		p->upcall_of = NULL;
+	}
+	for (i = 0; i < UTIMER_MAX && p->ntimers; ++i) {
+		if (G_UTIMER[i].owner == p)
+			utimer_free(&G_UTIMER[i]);
+	}
+}
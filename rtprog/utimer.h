@@ -0,0 +1,47 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _UTIMER_H_
+#define _UTIMER_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "syscall_table.h"
+
+/*
+ * Process timers: watchdogs, timeouts and periodic callbacks that do not
+ * block the thread arming them. Each is a ktimer on the one CNTP queue
+ * and fires in one of two ways:
+ *
+ *  TIMER_WAKE:   raise the bits arg in the flags object target, threads
+ *                waiting on it wake as for a flags_set.
+ *  TIMER_UPCALL: run target(mem, mem_size, arg) in a new thread of the
+ *                process, as if by sys_thread(). A periodic upcall has
+ *                the next expiry as its deadline, a one shot the owner's.
+ *                An expiry while the last upcall still runs is dropped.
+ *
+ * Expiries are absolute CNTPCT ticks, like every timeout. A timer
+ * belongs to the thread that created it and goes when the thread exits,
+ * its siblings may arm and cancel it.
+ */
+
+#define UTIMER_MAX	(64)
+
+typedef struct utimer {
+	ktimer_t kt;
+	ktimer_t warm;		/* the owner's warm-up, lead ticks ahead */
+	proc_t *owner;		/* NULL: free */
+	u32 how;		/* TIMER_WAKE or TIMER_UPCALL */
+	u64 target;		/* flags object or upcall entry */
+	u64 arg;		/* bits or upcall argument */
+	u64 stack_size;		/* upcall thread stack */
+	proc_t *upcall;		/* upcall thread still running, or NULL */
+} utimer_t;
+
+void utimer_init(void);
+s64 utimer_create(proc_t *p, u64 how, u64 target, u64 arg, u64 stack_size);
+s64 utimer_set(proc_t *p, u64 id, u64 expires, u64 period);
+s64 utimer_cancel(proc_t *p, u64 id);
+s64 utimer_destroy(proc_t *p, u64 id);
+// sched_free_proc: drop p's timers and its upcall
+void utimer_proc_exit(proc_t *p);
+
+#endif
@@ -0,0 +1,186 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "warm.h"
+#include "sched.h"
+#include "image.h"
+#include "ktimer.h"
+#include "timer.h"
+#include "alloc.h"
+
+extern sched_t G_SCHED;
+extern alloc_t G_ALLOC;
+
+static bool warm_fn(ktimer_t *t, struct ctx *c, u64 now)
+{
+	proc_t *p;
+
+	p = ((warm_tmr_t *)((u8 *)t - __builtin_offsetof(warm_tmr_t, kt)))->p;
+	if (p->as)
+		warm_touch(p->as, p);
+	return false;
+}
+
+// a wake closer than the lead finds the proc's lines where it left them
+void warm_arm(proc_t *p, u64 release)
+{
+	u64 lead;
+
+	lead = warm_lead(p->as);
+	if (!lead || release < lead || release - lead <= time_now_ticks())
+		return;
+	if (!p->warm_tmr) {
+		p->warm_tmr = alloc(&G_ALLOC, sizeof(*p->warm_tmr));
+		if (!p->warm_tmr)
+			return;
+		ktimer_setup(&p->warm_tmr->kt, warm_fn);
+		p->warm_tmr->p = p;
+	}
+	ktimer_start(&p->warm_tmr->kt, release - lead, 0);
+}
+
+void warm_disarm(proc_t *p)
+{
+	if (p->warm_tmr)
+		ktimer_stop(&p->warm_tmr->kt);
+}
+
+void warm_proc_free(proc_t *p)
+{
+	if (!p->warm_tmr)
+		return;
+	ktimer_stop(&p->warm_tmr->kt);
+	free(&G_ALLOC, p->warm_tmr);
+	p->warm_tmr = NULL;
+}
+
+void warm_as_free(aspace_t *as)
+{
+	if (!as->warm)
+		return;
+	free(&G_ALLOC, as->warm);
+	as->warm = NULL;
+}
+
+static inline void warm_load(u64 a)
+{
+	(void)*(volatile u8 *)(uintptr_t)a;
+}
+
+static void warm_one(u64 va, u64 len, u32 flags)
+{
+	u64 a, end;
+
+	end = va + len;
+	warm_load(va);
+	for (a = (va & PAGE_MASK) + PAGE_SIZE; a < end; a += PAGE_SIZE)
+		warm_load(a);
+	for (a = va & ~(u64)(JRT_CACHELINE - 1); a < end; a += JRT_CACHELINE) {
+		if (flags & WARM_CODE)
+			asm volatile("prfm plil2keep, [%0]" :: "r"(a));
+		else
+			asm volatile("prfm pldl2keep, [%0]" :: "r"(a));
+	}
+}
+
+// the frames the thread returns into and the ones it pushes next
+static void warm_stack(aspace_t *as, proc_t *p)
+{
+	u64 lo, hi, sp, a;
+
+	sp = p->ctx.sp;
+	lo = p->stack ? (uintptr_t)p->stack : (uintptr_t)as->mem;
+	hi = p->stack_top;
+	if (sp < lo || sp > hi)
+		return;
+	if (sp - lo > WARM_STACK)
+		lo = sp - WARM_STACK;
+	if (hi - sp > WARM_STACK)
+		hi = sp + WARM_STACK;
+	for (a = lo & ~(u64)(JRT_CACHELINE - 1); a < hi; a += JRT_CACHELINE)
+		warm_load(a);
+}
+
+void warm_touch(aspace_t *as, proc_t *p)
+{
+	u32 i;
+
+	if (!(as->warm && as->warm->n) && !p)
+		return;
+	mmu_map_switch(&as->map);
+	for (i = 0; as->warm && i < as->warm->n; ++i)
+		warm_one(as->warm->r[i].va, as->warm->r[i].len,
+			as->warm->r[i].flags);
+	if (p)
+		warm_stack(as, p);
+	mmu_map_switch(&G_SCHED.curr->ctx.mmap);
+}
+
+static bool warm_in(u64 va, u64 len, u64 lo, u64 size)
+{
+	return va >= lo && va - lo <= size && len <= size - (va - lo);
+}
+
+static warm_t *warm_get(aspace_t *as)
+{
+	if (!as->warm) {
+		as->warm = alloc(&G_ALLOC, sizeof(*as->warm));
+		if (!as->warm)
+			return NULL;
+		as->warm->n = 0;
+		as->warm->lead = 0;
+	}
+	return as->warm;
+}
+
+/*
+ * Add [va, va + len) to the process' hot ranges, len 0 drops them all.
+ * Returns the number of ranges now declared.
+ */
+s64 warm_set_range(proc_t *p, u64 va, u64 len, u32 flags)
+{
+	aspace_t *as;
+	warm_t *w;
+	u64 total;
+	u32 i;
+
+	as = p->as;
+	if (!len) {
+		if (as->warm)
+			as->warm->n = 0;
+		return 0;
+	}
+	if (flags & ~WARM_CODE || va + len < va)
+		return -SYS_EINVAL;
+	if (!image_maps(as->img, va, len) &&
+		!warm_in(va, len, (uintptr_t)as->mem, as->mem_size) &&
+		!(as->buf && warm_in(va, len, (uintptr_t)as->buf, as->buf_size)))
+		return -SYS_EINVAL;
+
+	w = warm_get(as);
+	if (!w)
+		return -SYS_ENOSPC;
+	total = len;
+	for (i = 0; i < w->n; ++i)
+		total += w->r[i].len;
+	if (w->n == WARM_RANGES || total > WARM_BYTES_MAX)
+		return -SYS_ENOSPC;
+	w->r[w->n].va = va;
+	w->r[w->n].len = len;
+	w->r[w->n].flags = flags;
+	return ++w->n;
+}
+
+// ticks ahead of each release, 0 turns warm-up off, returns the old lead
+s64 warm_set_lead(proc_t *p, u64 ticks)
+{
+	warm_t *w;
+	u64 old;
+
+	old = warm_lead(p->as);
+	if (!ticks && !p->as->warm)
+		return old;
+	w = warm_get(p->as);
+	if (!w)
+		return -SYS_ENOSPC;
+	w->lead = ticks;
+	return old;
+}
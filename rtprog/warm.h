@@ -0,0 +1,70 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _WARM_H_
+#define _WARM_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "syscall_table.h"
+
+/*
+ * Pre-release warm-up. A process declares up to WARM_RANGES hot ranges
+ * (sys_warm_range) and a lead time (sys_warm_lead). Ahead of each
+ * release JRT knows the time of, it touches them so the release does
+ * not start on caches and TLBs Linux and other tasks emptied meanwhile:
+ *
+ *  - a thread's timed wait: lead ticks before the wake, its ranges and
+ *    the stack around its saved sp
+ *  - the process' timers (utimer.h): lead ticks before each expiry, its
+ *    ranges
+ *
+ * The touch runs in the timer interrupt on the process' own map, so the
+ * page table walks land in the TLB under its ASID: one load per page,
+ * then a prefetch per line (into L2, the ranges may well not fit L1).
+ * Ranges are checked against the image, the process memory and the job
+ * buffer when declared, a warm-up never faults.
+ *
+ * Most processes never declare anything: the state comes from G_ALLOC
+ * on first use, a process' ranges with its first declaration and a
+ * thread's timer with its first warmed wait.
+ */
+
+#define WARM_RANGES	(4)
+#define WARM_BYTES_MAX	(256 * 1024)	/* all ranges of a process */
+#define WARM_STACK	(2 * 1024)	/* each side of the saved sp */
+
+typedef struct warm_range {
+	u64 va;
+	u64 len;
+	u32 flags;		/* WARM_* */
+} warm_range_t;
+
+typedef struct warm {
+	warm_range_t r[WARM_RANGES];
+	u32 n;
+	u64 lead;		/* ticks ahead of a release, 0: off */
+} warm_t;
+
+typedef struct warm_tmr {
+	ktimer_t kt;
+	proc_t *p;
+} warm_tmr_t;
+
+static inline u64 warm_lead(aspace_t *as)
+{
+	return as->warm ? as->warm->lead : 0;
+}
+
+// p goes into a timed wait until release
+void warm_arm(proc_t *p, u64 release);
+void warm_disarm(proc_t *p);
+// p exits, its timer goes back to G_ALLOC
+void warm_proc_free(proc_t *p);
+// the last thread of as exited
+void warm_as_free(aspace_t *as);
+// touch as' ranges now, and p's stack if p is not NULL
+void warm_touch(aspace_t *as, proc_t *p);
+
+s64 warm_set_range(proc_t *p, u64 va, u64 len, u32 flags);
+s64 warm_set_lead(proc_t *p, u64 ticks);
+
+#endif
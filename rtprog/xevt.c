@@ -0,0 +1,57 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#include "xevt.h"
+#include "kobj.h"
+#include "irq.h"
+#include "gic.h"
+#include "kerror.h"
+#include "memory_layout.h"
+
+static struct xevt_page *g_xevt = (void*)XEVT_PAGE_ADDR;
+static u64 g_xevt_flags;
+
+// doorbell from Linux: take everything pending, wake in one pass
+static void xevt_irq(ctx_t *c)
+{
+	u64 bits;
+
+	bits = __atomic_exchange_n(&g_xevt->to_jrt, 0, __ATOMIC_ACQ_REL);
+	if (bits)
+		flags_set(NULL, g_xevt_flags, bits);
+}
+
+void xevt_init(void)
+{
+	s64 id;
+
+	g_xevt->to_jrt = 0;
+	g_xevt->to_linux = 0;
+
+	id = flags_create(NULL);
+	if (id < 0)
+		KERNEL_PANIC(JRT_ENOMEM);
+	kobj_pin(id);
+	g_xevt_flags = id;
+
+	irq_register_spi(XEVT_SPI, xevt_irq);
+	gic_enable_spi(XEVT_SPI);
+}
+
+s64 xevt_wait(proc_t *p, u64 mask, u64 until)
+{
+	return flags_wait(p, g_xevt_flags, mask, FLAGS_ANY | FLAGS_CONSUME, until);
+}
+
+s64 xevt_signal(u64 bits)
+{
+	if (!bits || (bits >> XEVT_MAX))
+		return -SYS_EINVAL;
+	__atomic_fetch_or(&g_xevt->to_linux, bits, __ATOMIC_RELEASE);
+	gic_raise_spi(XEVT_LINUX_SPI);
+	return 0;
+}
+
+void xevt_linux_done(void)
+{
+	__atomic_fetch_or(&g_xevt->to_linux, XEVT_LINUX_DONE, __ATOMIC_RELEASE);
+	gic_raise_spi(XEVT_LINUX_SPI);
+}
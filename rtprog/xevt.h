@@ -0,0 +1,22 @@
+// Author: Gustaf Franzen <gustaffranzen@icloud.com>
+#ifndef _JRT_XEVT_H_
+#define _JRT_XEVT_H_
+
+#include "types.h"
+#include "sched_structs.h"
+#include "../shared/xevt.h"
+
+/*
+ * JRT side of the cross-domain events in shared/xevt.h. Linux->JRT
+ * events feed a kernel owned flag group, so waiting on them is a
+ * flags_wait with FLAGS_CONSUME: deadline ordered wakeups and timeouts
+ * come for free.
+ */
+
+void xevt_init(void);
+s64 xevt_wait(proc_t *p, u64 mask, u64 until);
+s64 xevt_signal(u64 bits);
+// completion records are on the ring
+void xevt_linux_done(void);
+
+#endif
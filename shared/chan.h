@@ -0,0 +1,191 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _CHAN_H_
+#define _CHAN_H_
+
+#include "types.h"
+
+/*
+ * Named shared-state channels in the channel area (CHAN_AREA_ADDR). The
+ * area starts with a directory the rtcore module fills in, channel data
+ * follows. Neither side ever waits on the other:
+ *
+ *  CHAN_SEQLOCK: JRT -> Linux. One RT writer bumps a sequence count
+ *                around each update and never blocks, Linux readers
+ *                retry while it is odd or changed under them.
+ *  CHAN_TRIPLE:  Linux -> JRT. One Linux writer and one RT reader swap
+ *                buffers through a shared index, both sides wait-free,
+ *                the RT read is one load in the common case.
+ *
+ * Channels are created with RTCORE_IOCTL_CHAN_CREATE and live until the
+ * module is unloaded. Each channel has one writer, callers serialize
+ * writers sharing a channel themselves.
+ */
+#define CHAN_MAX	32
+#define CHAN_NAME_MAX	24
+#define CHAN_SIZE_MAX	0x1000		/* payload bytes */
+
+#define CHAN_SEQLOCK	1
+#define CHAN_TRIPLE	2
+
+typedef struct chan_desc {
+	char name[CHAN_NAME_MAX];	/* NUL terminated */
+	u32 type;			/* 0: free, stored last */
+	u32 size;			/* payload bytes */
+	u64 off;			/* header, from the area base */
+} chan_desc_t;
+
+struct chan_dir {
+	chan_desc_t d[CHAN_MAX];
+};
+
+/* channel data starts after the directory */
+#define CHAN_DATA_OFF \
+	((sizeof(struct chan_dir) + JRT_CACHELINE - 1) & ~(JRT_CACHELINE - 1))
+
+/* payload slots are cache line aligned, no false sharing between them */
+#define CHAN_STRIDE(size) \
+	(((size) + JRT_CACHELINE - 1) & ~(u64)(JRT_CACHELINE - 1))
+
+struct JRT_ALIGNED(JRT_CACHELINE) chan_seq {
+	u32 seq;			/* odd while an update is in flight */
+	u8  _pad0[JRT_CACHELINE - 4];
+	u8  data[];
+};
+
+/* mid carries the index of the newest complete buffer and a fresh bit */
+#define CHAN_TB_IDX	3u
+#define CHAN_TB_FRESH	4u
+
+struct JRT_ALIGNED(JRT_CACHELINE) chan_triple {
+	u32 mid;			/* exchanged by both sides */
+	u8  _pad0[JRT_CACHELINE - 4];
+	u32 back;			/* writer's buffer */
+	u8  _pad1[JRT_CACHELINE - 4];
+	u32 front;			/* reader's buffer */
+	u8  _pad2[JRT_CACHELINE - 4];
+	u8  data[];			/* 3 x CHAN_STRIDE(size) */
+};
+
+#define CHAN_BYTES(type, size)					\
+	((type) == CHAN_SEQLOCK ?					\
+		sizeof(struct chan_seq) + CHAN_STRIDE(size) :		\
+		sizeof(struct chan_triple) + 3 * CHAN_STRIDE(size))
+
+#ifndef __KERNEL__
+#include <string.h>
+
+/* an opened channel, valid in the address space that opened it */
+typedef struct chan {
+	void *hdr;			/* struct chan_seq or chan_triple */
+	u32 type;
+	u32 size;
+} chan_t;
+
+/* find name in the directory of an area mapped at base */
+static inline int chan_lookup(void *base, const char *name, chan_t *c)
+{
+	struct chan_dir *dir;
+	chan_desc_t *d;
+	u32 i, j, type;
+
+	dir = base;
+	for (i = 0; i < CHAN_MAX; ++i) {
+		d = &dir->d[i];
+		type = __atomic_load_n(&d->type, __ATOMIC_ACQUIRE);
+		if (!type)
+			continue;
+		for (j = 0; j < CHAN_NAME_MAX; ++j) {
+			if (d->name[j] != name[j] || !name[j])
+				break;
+		}
+		if (j == CHAN_NAME_MAX || d->name[j] != name[j])
+			continue;
+		c->hdr = (u8 *)base + d->off;
+		c->type = type;
+		c->size = d->size;
+		return 0;
+	}
+	return -1;
+}
+
+/* JRT: publish a new state, never waits */
+static inline void chan_seq_write(chan_t *c, const void *src)
+{
+	struct chan_seq *s;
+	u32 seq;
+
+	s = c->hdr;
+	seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+	/* odd count visible before any payload store */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(s->data, src, c->size);
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Linux: copy a consistent state, returns its update count */
+static inline u32 chan_seq_read(const chan_t *c, void *dst)
+{
+	struct chan_seq *s;
+	u32 s0, s1;
+
+	s = c->hdr;
+	do {
+		s0 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		memcpy(dst, s->data, c->size);
+		/* payload loads done before the count is read again */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s1 = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	} while ((s0 & 1) || s0 != s1);
+	return s0 >> 1;
+}
+
+/* Linux: the buffer to fill next, hand it over with chan_tb_publish() */
+static inline void *chan_tb_back(chan_t *c)
+{
+	struct chan_triple *t;
+
+	t = c->hdr;
+	return t->data + t->back * CHAN_STRIDE(c->size);
+}
+
+static inline void chan_tb_publish(chan_t *c)
+{
+	struct chan_triple *t;
+	u32 old;
+
+	t = c->hdr;
+	old = __atomic_exchange_n(&t->mid, t->back | CHAN_TB_FRESH,
+		__ATOMIC_ACQ_REL);
+	t->back = old & CHAN_TB_IDX;
+}
+
+static inline void chan_tb_write(chan_t *c, const void *src)
+{
+	memcpy(chan_tb_back(c), src, c->size);
+	chan_tb_publish(c);
+}
+
+/*
+ * JRT: the newest complete state, stable until the next call. *fresh
+ * tells whether it changed since the last call.
+ */
+static inline const void *chan_tb_read(chan_t *c, int *fresh)
+{
+	struct chan_triple *t;
+	u32 old;
+
+	t = c->hdr;
+	*fresh = 0;
+	if (__atomic_load_n(&t->mid, __ATOMIC_RELAXED) & CHAN_TB_FRESH) {
+		old = __atomic_exchange_n(&t->mid, t->front, __ATOMIC_ACQ_REL);
+		t->front = old & CHAN_TB_IDX;
+		*fresh = 1;
+	}
+	return t->data + t->front * CHAN_STRIDE(c->size);
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include "types.h"
+
+/*
+ * Clock correlation page (CLOCK_PAGE_ADDR). JRT counts CNTVCT ticks, Linux
+ * submitters think in CLOCK_MONOTONIC. The rtcore module publishes the
+ * counter frequency, mult/shift factors for both directions and the
+ * offset between the two clocks, and refreshes the offset every
+ * JRT_CLOCK_UPDATE_MS so NTP slewing of CLOCK_MONOTONIC is tracked.
+ *
+ * The module is the only writer: seq is odd while it updates the page,
+ * readers (user space through RTCORE_CLOCK_MMAP_OFF, JRT in place) copy
+ * what they need and retry if seq moved. CNTVOFF is 0, CNTVCT and CNTPCT
+ * read the same counter.
+ *
+ *   ns    = jrt_mul_shift(ticks, ns_mult, ns_shift)
+ *   ticks = jrt_mul_shift(ns, tick_mult, tick_shift)
+ *   mono  = ns(CNTVCT) + mono_off
+ */
+#define JRT_CLOCK_MAGIC		0x4b4c434aU	/* "JCLK" */
+#define JRT_CLOCK_VERSION	1
+
+#define JRT_CLOCK_UPDATE_MS	1000
+
+#define JRT_NSEC_PER_SEC	1000000000ull
+
+struct JRT_ALIGNED(4096) jrt_clock_page {
+	u32 seq;
+	u32 magic;
+	u32 version;
+	u32 ns_shift;
+	u64 freq;		/* CNTFRQ */
+	u64 ns_mult;		/* ticks -> ns */
+	u64 tick_mult;		/* ns -> ticks */
+	u32 tick_shift;
+	u32 _pad;
+	s64 mono_off;		/* CLOCK_MONOTONIC ns - ns(CNTVCT) */
+	u64 t_update;		/* CNTVCT of the last offset update */
+};
+
+/*
+ * Factors converting counts at rate from into counts at rate to, with the
+ * largest shift that keeps mult below 2^63. The product is taken in 128
+ * bits, so any 64-bit value converts without overflow and the relative
+ * error stays near 2^-62 instead of the 2^-32 of a 32-bit mult.
+ *
+ * Long division one bit at a time: neither the kernel nor JRT links a
+ * 128-bit divide, and this runs once at init.
+ */
+static inline void jrt_clock_factors(u64 from, u64 to, u64 *mult, u32 *shift)
+{
+	u64 q, r;
+	u32 sh;
+
+	q = to / from;
+	r = to % from;
+	for (sh = 0; sh < 63 && q < (1ull << 62); ++sh) {
+		q <<= 1;
+		r <<= 1;
+		if (r >= from) {
+			r -= from;
+			q |= 1;
+		}
+	}
+	/* round to nearest */
+	if (r >= from - r)
+		++q;
+	*mult = q;
+	*shift = sh;
+}
+
+/* v * mult / 2^shift, rounded to nearest */
+static inline u64 jrt_mul_shift(u64 v, u64 mult, u32 shift)
+{
+	unsigned __int128 p;
+
+	p = (unsigned __int128)v * mult;
+	if (shift)
+		p += (unsigned __int128)1 << (shift - 1);
+	return (u64)(p >> shift);
+}
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _COLOR_H_
+#define _COLOR_H_
+
+#include "types.h"
+
+/*
+ * Page colors of the last level cache shared by JRT and the Linux cores.
+ * A physical page maps onto the LLC sets of its color only, pages of
+ * different colors never evict each other. JRT gives RT processes
+ * pages of the JRT_RT_COLORS colors (COLOR_POOL_ADDR, rtprog/color.h),
+ * the module keeps job buffers, the part of the reserved window Linux
+ * works in, on the other ones (kernelmod/bufpool.c).
+ *
+ * The geometry is fixed at build time, JRT has no devicetree. The
+ * module compares it with the LLC node of the devicetree, if there is
+ * one, and warns when they disagree.
+ *
+ *  JRT_LLC_SIZE:  bytes of the LLC
+ *  JRT_LLC_WAYS:  its associativity
+ *  JRT_RT_COLORS: bit c set, color c is for RT processes
+ */
+#ifndef JRT_LLC_SIZE
+#define JRT_LLC_SIZE		(0x200000)
+#endif
+#ifndef JRT_LLC_WAYS
+#define JRT_LLC_WAYS		(16)
+#endif
+
+#define JRT_COLOR_PAGE		(0x1000)
+/* one way, the colors repeat every JRT_COLOR_STRIDE bytes */
+#define JRT_COLOR_STRIDE	(JRT_LLC_SIZE / JRT_LLC_WAYS)
+#define JRT_NCOLORS		(JRT_COLOR_STRIDE / JRT_COLOR_PAGE)
+
+#define JRT_COLOR_ALL		(~0ULL >> (64 - JRT_NCOLORS))
+
+/* the lower half by default: half of every way, in one piece */
+#ifndef JRT_RT_COLORS
+#define JRT_RT_COLORS		((1ULL << (JRT_NCOLORS / 2)) - 1)
+#endif
+
+JRT_STATIC_ASSERT(JRT_NCOLORS >= 2 && JRT_NCOLORS <= 64,
+	"LLC geometry gives no usable colors");
+JRT_STATIC_ASSERT(!(JRT_NCOLORS & (JRT_NCOLORS - 1)),
+	"LLC way size must be a power of two");
+JRT_STATIC_ASSERT(JRT_RT_COLORS && !(JRT_RT_COLORS & ~JRT_COLOR_ALL) &&
+	JRT_RT_COLORS != JRT_COLOR_ALL,
+	"JRT_RT_COLORS must split the colors between JRT and Linux");
+
+static inline u32 jrt_color(u64 pa)
+{
+	return (u32)((pa / JRT_COLOR_PAGE) & (JRT_NCOLORS - 1));
+}
+
+static inline bool jrt_color_rt(u64 pa)
+{
+	return (JRT_RT_COLORS >> jrt_color(pa)) & 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include "types.h"
+
+/*
+ * Log-linear (HDR style) latency histograms of CNTPCT ticks. Values below
+ * JRT_HIST_SUB get a bucket each, above that every power of two is split
+ * into JRT_HIST_SUB linear buckets, so a bucket is never wider than
+ * 1/JRT_HIST_SUB of its value. Finding the bucket is a clz and two shifts.
+ *
+ * Values of 2^JRT_HIST_BITS ticks and more land in the last bucket and
+ * are counted in overflow, max stays exact.
+ */
+#define JRT_HIST_SUB_BITS	5
+#define JRT_HIST_SUB		(1u << JRT_HIST_SUB_BITS)
+#define JRT_HIST_BITS		32
+#define JRT_HIST_BUCKETS \
+	((JRT_HIST_BITS - JRT_HIST_SUB_BITS + 1) * JRT_HIST_SUB)
+
+/* jrt_stats_page.hist[] */
+#define JRT_HIST_WAKEUP		0	/* timed wakeup: deadline to switch in */
+#define JRT_HIST_IRQ		1	/* CNTP compare value to handler entry */
+#define JRT_HIST_DOORBELL	2	/* doorbell to first switch in of the job */
+#define JRT_HIST_SYSCALL	3	/* syscall entry to return, non-blocking */
+#define JRT_HIST_NR		4
+
+struct JRT_ALIGNED(JRT_CACHELINE) jrt_hist {
+	u32 seq;		/* as in jrt_cpu_stats */
+	u32 reset;		/* last jrt_stats_page.hist_reset[] applied */
+	u64 count;
+	u64 sum;
+	u64 min;
+	u64 max;
+	u64 overflow;
+	u8  _pad0[JRT_CACHELINE - 48];
+	u32 bucket[JRT_HIST_BUCKETS];
+};
+
+static inline u32 jrt_hist_index(u64 v)
+{
+	u32 m;
+
+	if (v < JRT_HIST_SUB)
+		return v;
+	m = 63 - __builtin_clzll(v);
+	if (m >= JRT_HIST_BITS)
+		return JRT_HIST_BUCKETS - 1;
+	return ((m - JRT_HIST_SUB_BITS + 1) << JRT_HIST_SUB_BITS) +
+		((v >> (m - JRT_HIST_SUB_BITS)) & (JRT_HIST_SUB - 1));
+}
+
+/* the largest value that lands in bucket i */
+static inline u64 jrt_hist_value(u32 i)
+{
+	u32 g, sub;
+
+	if (i < JRT_HIST_SUB)
+		return i;
+	g = i >> JRT_HIST_SUB_BITS;
+	sub = i & (JRT_HIST_SUB - 1);
+	return (((u64)(JRT_HIST_SUB + sub + 1)) << (g - 1)) - 1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _JRT_IMAGE_H_
+#define _JRT_IMAGE_H_
+
+#include "types.h"
+
+/*
+ * Header the rtcore ELF loader writes in front of a loaded image. The
+ * image follows the header page, segments are laid out as linked (offsets
+ * relative to the lowest PT_LOAD address) and PIE images are relocated to
+ * run at va. JRT maps each segment at va + off with its own permissions.
+ */
+
+#define JRT_IMAGE_MAGIC		0x474d494au	/* "JIMG" */
+#define JRT_IMAGE_HDR_SIZE	0x1000		/* one JRT page */
+#define JRT_IMAGE_SEG_MAX	8
+
+/* same values as ELF p_flags */
+#define JRT_SEG_X	(1u << 0)
+#define JRT_SEG_W	(1u << 1)
+#define JRT_SEG_R	(1u << 2)
+
+typedef struct jrt_image_seg {
+	u64 off;	/* from the image base, page aligned */
+	u64 filesz;	/* bytes present in the image */
+	u64 memsz;	/* filesz + zero fill (.bss) */
+	u32 flags;	/* JRT_SEG_* */
+	u32 _rsvd;
+} jrt_image_seg_t;
+
+typedef struct jrt_image_hdr {
+	u32 magic;
+	u32 nseg;
+	u64 va;		/* where the image base is mapped */
+	u64 entry;	/* offset of the entry point from the base */
+	u64 size;	/* bytes after the header page */
+	jrt_image_seg_t seg[JRT_IMAGE_SEG_MAX];
+} jrt_image_hdr_t;
+
+JRT_STATIC_ASSERT(sizeof(jrt_image_hdr_t) <= JRT_IMAGE_HDR_SIZE, "image header too big");
+
+#endif
@@ -13,23 +13,92 @@
 #define TOJRT_SIZE   (1u << TOJRT_ORDER)
 #define TOJRT_MASK   (TOJRT_SIZE - 1)
 
+/*
+ * Submission stages, for finding where a job's time goes between the
+ * SCHED_PROG ioctl and its first instruction. t_stage[i] is CNTVCT when
+ * stage i ended: the module stamps the linux ones into the request, JRT
+ * adds its own and returns all of them in the completion record.
+ */
+#define JRT_STAGE_IOCTL		0	/* ioctl entered */
+#define JRT_STAGE_COPY		1	/* args copied, image and buffer resolved */
+#define JRT_STAGE_SYNC		2	/* icache synced for uncached images */
+#define JRT_STAGE_LOCK		3	/* sched_lock taken */
+#define JRT_STAGE_SLOT		4	/* ring slot free, mpsc_push done spinning */
+#define JRT_STAGE_LINUX		5	/* stamped by the module */
+#define JRT_STAGE_IRQ		5	/* doorbell handler entered */
+#define JRT_STAGE_POP		6	/* record off the ring */
+#define JRT_STAGE_ALLOC		7	/* job memory allocated */
+#define JRT_STAGE_PROC		8	/* image resolved, process mapped */
+#define JRT_STAGE_READY		9	/* in the ready heap */
+#define JRT_STAGE_RUN		10	/* first eret into it */
+#define JRT_STAGE_NR		11
+
 /* Payload size/alignment (compile-time) */
 #ifndef TOJRT_REC_SIZE
-#define TOJRT_REC_SIZE   32             /* bytes */
+#define TOJRT_REC_SIZE   128            /* bytes */
 #endif
 #ifndef TOJRT_REC_ALIGN
 #define TOJRT_REC_ALIGN  16             /* pick 1/2/4/8/16… */
 #endif
 
 typedef union JRT_PACKED JRT_ALIGNED(TOJRT_REC_ALIGN) tojrt_rec {
-	u8 b[24];
+	u8 b[TOJRT_REC_SIZE];
 	struct {
 		u64 pc;
 		u64 prog_size;
 		u64 mem_req;
+		union {
+			u64 deadline_us;	/* relative, 0: none */
+			u64 deadline_abs;	/* CNTVCT, JRT_REQ_DL_ABS */
+		};
+		u64 job_id;		/* echoed in the completion record */
+		u32 flags;		/* JRT_REQ_* */
+		u32 buf_size;
+		u64 buf;		/* job buffer in the buffer pool, 0: none */
+		u64 t_doorbell;		/* CNTPCT, just before the push */
+		u64 t_stage[JRT_STAGE_LINUX];
+		/*
+		 * JRT_REQ_CACHED: the module's image id and the generation
+		 * it was loaded in. Evicting and loading another image can
+		 * put it at the same pc with the same size, the pair tells
+		 * JRT its cached map is stale.
+		 */
+		u32 img_id;
+		u32 img_gen;
 	};
 } jrt_sched_req_t;
 
+/* image lives in the module's image cache, immutable and shared */
+#define JRT_REQ_CACHED	(1u << 0)
+/* pc points to a jrt_image_hdr_t written by the rtcore ELF loader */
+#define JRT_REQ_ELF	(1u << 1)
+/* deadline_abs is an absolute counter value (shared/clock.h) */
+#define JRT_REQ_DL_ABS	(1u << 2)
+/*
+ * Execution time characterization run: JRT leaves further requests in
+ * the ring until the job is done, so nothing it admits competes with
+ * it. JRT_REQ_COLD also cleans and invalidates this core's caches and
+ * TLB before the job's first instruction, without it the job starts
+ * with whatever the previous runs left (warm, when they were the same
+ * program).
+ */
+#define JRT_REQ_WCET	(1u << 3)
+#define JRT_REQ_COLD	(1u << 4)
+/* what JRT does when the job is still running at its deadline */
+#define JRT_REQ_MISS_SHIFT	8
+#define JRT_REQ_MISS(policy)	((u32)(policy) << JRT_REQ_MISS_SHIFT)
+#define JRT_REQ_MISS_MASK	JRT_REQ_MISS(3)
+
+/*
+ * Deadline miss policies, for jobs (JRT_REQ_MISS) and sys_dl_policy().
+ * JRT notices the miss at the deadline, not when the job gets around to
+ * blocking, and always counts it in the stats page.
+ */
+#define JRT_MISS_CONTINUE	0	/* record it only */
+#define JRT_MISS_NOTIFY		1	/* set bits in an event flags object */
+#define JRT_MISS_DEMOTE		2	/* run in the background from now on */
+#define JRT_MISS_KILL		3	/* end it, reported in jrt_done_rec_t */
+
 JRT_STATIC_ASSERT(TOJRT_SIZE && !(TOJRT_SIZE & TOJRT_MASK), "ring size must be power of two");
 JRT_STATIC_ASSERT(sizeof(jrt_sched_req_t) == TOJRT_REC_SIZE, "rec size mismatch");
 JRT_STATIC_ASSERT((TOJRT_REC_ALIGN & (TOJRT_REC_ALIGN-1)) == 0, "align pow2");
@@ -49,4 +118,51 @@ struct JRT_ALIGNED(JRT_CACHELINE) mpsc_ring {
 	u8               flags[TOJRT_SIZE];          /* 0 empty, 1 full */
 	jrt_sched_req_t  data [TOJRT_SIZE];          /* payloads */
 };
+
+/* ===== Completions (JRT -> linux) ===== */
+#ifndef FROMJRT_ORDER
+#define FROMJRT_ORDER  10               /* 2^10 = 1024 slots */
+#endif
+#define FROMJRT_SIZE   (1u << FROMJRT_ORDER)
+#define FROMJRT_MASK   (FROMJRT_SIZE - 1)
+
+typedef struct JRT_ALIGNED(16) fromjrt_rec {
+	u64 job_id;		/* from jrt_sched_req_t */
+	u64 t_done;		/* CNTPCT at exit */
+	u32 pid;
+	s32 status;		/* return value of the job's entry function */
+	u32 buf;		/* buffer handle, filled in by the module */
+	u32 out_len;		/* output bytes, see sys_job_output() */
+	u64 out_off;		/* output offset in the job buffer */
+	u32 flags;		/* JRT_DONE_* */
+	u32 irqs;		/* interrupts taken while the job ran */
+	u64 t_stage[JRT_STAGE_NR];	/* 0 for stages the job skipped */
+	u64 t_exec;		/* ticks the job ran, preemptions excluded */
+} jrt_done_rec_t;
+
+/* jrt_done_rec_t.flags */
+#define JRT_DONE_LATE	(1u << 0)	/* ran past its deadline */
+#define JRT_DONE_KILLED	(1u << 1)	/* JRT_MISS_KILL, status is -ETIMEDOUT */
+/* never started: no memory or image slot (-ENOSPC), bad image (-EINVAL) */
+#define JRT_DONE_REJECTED	(1u << 2)
+/* some of its memory is outside the RT colors (jrt color.h) */
+#define JRT_DONE_UNCOLORED	(1u << 3)
+
+JRT_STATIC_ASSERT(FROMJRT_SIZE && !(FROMJRT_SIZE & FROMJRT_MASK), "ring size must be power of two");
+JRT_STATIC_ASSERT(sizeof(jrt_done_rec_t) == 144, "done rec size mismatch");
+
+/* ====== Ring structure (shared) ======
+ * head: next slot JRT writes (producer only)
+ * tail: next slot linux reads (consumer only)
+ * dropped: records lost because the ring was full
+ */
+struct JRT_ALIGNED(JRT_CACHELINE) spsc_ring {
+	u32 head;
+	u32 dropped;
+	u8  _pad0[JRT_CACHELINE - 8];
+	u32 tail;
+	u8  _pad1[JRT_CACHELINE - 4];
+
+	jrt_done_rec_t   data[FROMJRT_SIZE];
+};
 #endif
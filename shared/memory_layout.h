@@ -5,9 +5,15 @@
 
 #include "rtcore.h"
 
+/* top of the code window, the module's default image cache */
+#ifndef JRT_IMG_CACHE_SIZE
+#define JRT_IMG_CACHE_SIZE (0x400000)
+#endif
+
 /* PA */
 /*
- * 0x51F m_n
+ * 0x51F m_n	job buffer pool below the kernel stack
+ *       m_c	page-colored pool of RT process memory
  *       m_3
  *       m_2
  *       m_1
@@ -35,11 +41,42 @@
 
 
 #define TOJRT_RING_ADDR (JRT_MEM_PHYS)
+#define FROMJRT_RING_ADDR ((TOJRT_RING_ADDR + sizeof(struct mpsc_ring) + 63) & ~((uintptr_t)63))
 #define JRT_STACK_START (JRT_MEM_PHYS + JRT_MEM_SIZE)
-#define JRT_HEAP_START ((JRT_MEM_PHYS + sizeof(struct mpsc_ring) + 15) & ~((uintptr_t)15))
+#define XEVT_PAGE_ADDR ((FROMJRT_RING_ADDR + sizeof(struct spsc_ring) + 63) & ~((uintptr_t)63))
+/* shared-state channels, page aligned for mmap */
+#ifndef JRT_CHAN_AREA_SIZE
+#define JRT_CHAN_AREA_SIZE (0x10000)
+#endif
+#define CHAN_AREA_ADDR ((XEVT_PAGE_ADDR + sizeof(struct xevt_page) + 0xFFF) & ~((uintptr_t)0xFFF))
+#define CHAN_AREA_SIZE ((uintptr_t)JRT_CHAN_AREA_SIZE)
+#define STATS_PAGE_ADDR (CHAN_AREA_ADDR + CHAN_AREA_SIZE)
+#define STATS_PAGE_SIZE (sizeof(struct jrt_stats_page))
+#define CLOCK_PAGE_ADDR (STATS_PAGE_ADDR + STATS_PAGE_SIZE)
+#define CLOCK_PAGE_SIZE (sizeof(struct jrt_clock_page))
+#define PROF_AREA_ADDR (CLOCK_PAGE_ADDR + CLOCK_PAGE_SIZE)
+#define PROF_AREA_SIZE (sizeof(struct jrt_prof_area))
+#define JRT_HEAP_START (PROF_AREA_ADDR + PROF_AREA_SIZE)
 
-#define TOJRT_RING_SIZE ((JRT_HEAP_START - TOJRT_RING_ADDR) - 1)
-#define JRT_HEAP_SIZE ((JRT_STACK_START - JRT_HEAP_START) - 1)
+/* the kernel stack grows down from JRT_STACK_START, keep the pool clear */
+#define JRT_KSTACK_SIZE (0x10000)
+#ifndef JRT_BUF_POOL_SIZE
+#define JRT_BUF_POOL_SIZE (0x400000)
+#endif
+/* job buffers, handed out by rtcore, page aligned for mmap */
+#define BUF_POOL_ADDR ((JRT_STACK_START - JRT_KSTACK_SIZE - JRT_BUF_POOL_SIZE) & ~((uintptr_t)0xFFF))
+#define BUF_POOL_SIZE ((uintptr_t)JRT_BUF_POOL_SIZE)
+#ifndef JRT_COLOR_POOL_SIZE
+#define JRT_COLOR_POOL_SIZE (0x400000)
+#endif
+/* process memory of the RT colors (color.h), starts at color 0 */
+#define COLOR_POOL_ADDR ((BUF_POOL_ADDR - JRT_COLOR_POOL_SIZE) & ~((uintptr_t)JRT_COLOR_STRIDE - 1))
+#define COLOR_POOL_SIZE ((uintptr_t)JRT_COLOR_POOL_SIZE)
+
+#define TOJRT_RING_SIZE ((FROMJRT_RING_ADDR - TOJRT_RING_ADDR) - 1)
+#define FROMJRT_RING_SIZE ((XEVT_PAGE_ADDR - FROMJRT_RING_ADDR) - 1)
+#define XEVT_PAGE_SIZE ((CHAN_AREA_ADDR - XEVT_PAGE_ADDR) - 1)
+#define JRT_HEAP_SIZE ((COLOR_POOL_ADDR - JRT_HEAP_START) - 1)
 #ifdef AUTOGEN_HEADER
 #include <stdio.h>
 #include <string.h>
@@ -63,9 +100,28 @@ int main(void)
 	printf("#define TOJRT_RING_ADDR (0x%llx)\n", TOJRT_RING_ADDR);
 	printf("#define JRT_STACK_START (0x%llx)\n", JRT_STACK_START);
 	printf("#define TOJRT_RING_SIZE (0x%llx)\n", TOJRT_RING_SIZE);
+	printf("#define FROMJRT_RING_ADDR (0x%llx)\n", FROMJRT_RING_ADDR);
+	printf("#define FROMJRT_RING_SIZE (0x%llx)\n", FROMJRT_RING_SIZE);
+	printf("#define XEVT_PAGE_ADDR (0x%llx)\n", XEVT_PAGE_ADDR);
+	printf("#define XEVT_PAGE_SIZE (0x%llx)\n", XEVT_PAGE_SIZE);
+
+	printf("#define CHAN_AREA_ADDR (0x%llx)\n", CHAN_AREA_ADDR);
+	printf("#define CHAN_AREA_SIZE (0x%llx)\n", CHAN_AREA_SIZE);
+
+	printf("#define STATS_PAGE_ADDR (0x%llx)\n", STATS_PAGE_ADDR);
+	printf("#define STATS_PAGE_SIZE (0x%llx)\n", STATS_PAGE_SIZE);
+
+	printf("#define CLOCK_PAGE_ADDR (0x%llx)\n", CLOCK_PAGE_ADDR);
+	printf("#define CLOCK_PAGE_SIZE (0x%llx)\n", CLOCK_PAGE_SIZE);
+	printf("#define PROF_AREA_ADDR (0x%llx)\n", PROF_AREA_ADDR);
+	printf("#define PROF_AREA_SIZE (0x%llx)\n", PROF_AREA_SIZE);
 
 	printf("#define JRT_HEAP_START (0x%llx)\n", JRT_HEAP_START);
 	printf("#define JRT_HEAP_SIZE (0x%llx)\n", JRT_HEAP_SIZE);
+	printf("#define BUF_POOL_ADDR (0x%llx)\n", BUF_POOL_ADDR);
+	printf("#define BUF_POOL_SIZE (0x%llx)\n", BUF_POOL_SIZE);
+	printf("#define COLOR_POOL_ADDR (0x%llx)\n", COLOR_POOL_ADDR);
+	printf("#define COLOR_POOL_SIZE (0x%llx)\n", COLOR_POOL_SIZE);
 	printf("\n#endif /* %s */\n", guard);
 }
 #endif
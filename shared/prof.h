@@ -0,0 +1,80 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include "types.h"
+
+/*
+ * Sampling profiler of the RT core (PROF_AREA_ADDR). JRT samples the
+ * interrupted pc, the running pid and, where the frame records check
+ * out, a few callers, and pushes them to a ring Linux drains through
+ * RTCORE_PROF_MMAP_OFF.
+ *
+ * Linux asks for a source and rate with RTCORE_IOCTL_PROF: the module
+ * writes them here, bumps ctl_seq and rings PROF_SPI. JRT applies the
+ * request in that handler and acknowledges it in ack_seq. Off, nothing
+ * is armed and the only profiler code JRT ever runs is that handler.
+ *
+ *  JRT_PROF_TIMER: the EL1 virtual timer, free since JRT schedules on
+ *                  the physical one, every ticks counter ticks
+ *  JRT_PROF_PMU:   cycle counter overflow every cycles cycles. JRT
+ *                  falls back to the timer when it has no PMU, active
+ *                  says what actually runs
+ */
+#define JRT_PROF_MAGIC		0x4652504aU	/* "JPRF" */
+#define JRT_PROF_VERSION	1
+
+#define PROF_SPI		(75)	/* control doorbell into JRT */
+
+/* jrt_prof_area.source, .active */
+#define JRT_PROF_OFF		0
+#define JRT_PROF_TIMER		1
+#define JRT_PROF_PMU		2
+
+#define JRT_PROF_SLOTS		1024	/* power of two */
+#define JRT_PROF_DEPTH		4	/* callers kept per sample */
+
+/* jrt_prof_sample.flags */
+#define JRT_PROF_S_KERNEL	(1u << 0)	/* pc is JRT kernel text */
+#define JRT_PROF_S_IDLE		(1u << 1)	/* nothing was running */
+
+struct jrt_prof_sample {
+	u64 t;			/* CNTVCT */
+	u64 pc;
+	u32 pid;		/* 0: the JRT kernel proc */
+	u16 flags;		/* JRT_PROF_S_* */
+	u16 depth;		/* callers[] filled, innermost first */
+	u64 img;		/* image of the process (its pa), 0: kernel */
+	u64 callers[JRT_PROF_DEPTH];	/* return addresses */
+};
+
+struct JRT_ALIGNED(4096) jrt_prof_area {
+	u32 magic;		/* set by JRT once it takes requests */
+	u32 version;
+	/* written by the module */
+	u32 ctl_seq;
+	u32 source;		/* JRT_PROF_* asked for */
+	u64 cycles;		/* JRT_PROF_PMU period */
+	u64 ticks;		/* JRT_PROF_TIMER period, also the PMU fallback */
+	/* written by JRT */
+	u32 ack_seq;		/* last ctl_seq applied */
+	u32 active;		/* JRT_PROF_* running */
+	u64 freq;		/* CNTFRQ */
+	u8  _pad0[JRT_CACHELINE - 48];
+
+	u32 head;		/* JRT, next slot written */
+	u32 dropped;		/* samples lost to a full ring */
+	u8  _pad1[JRT_CACHELINE - 8];
+	u32 tail;		/* Linux, next slot read */
+	u8  _pad2[JRT_CACHELINE - 4];
+
+	struct jrt_prof_sample s[JRT_PROF_SLOTS];
+};
+
+JRT_STATIC_ASSERT(sizeof(struct jrt_prof_sample) == 64, "prof sample size");
+JRT_STATIC_ASSERT(!(JRT_PROF_SLOTS & (JRT_PROF_SLOTS - 1)),
+	"prof slots must be a power of two");
+
+#endif
@@ -7,6 +7,12 @@
 
 #include "types.h"
 #include "mailbox.h"
+#include "xevt.h"
+#include "chan.h"
+#include "stats.h"
+#include "clock.h"
+#include "prof.h"
+#include "color.h"
 
 #define DEVICE_NAME "rtcore"
 
@@ -18,10 +24,115 @@ typedef struct rtcore_start_args {
 typedef struct rtcore_sched_args {
 	uint64_t entry_user;
 	uint64_t mem_req;
+	uint64_t prog_size;	/* bytes from entry_user, 0: rest of mapping */
+	uint64_t deadline_us;	/* relative to release, 0: none */
+	uint64_t flags;		/* RTCORE_SCHED_* */
+	uint64_t handle;	/* RTCORE_IOCTL_IMG_LOAD handle, 0: use entry_user */
+	uint64_t buf;		/* RTCORE_IOCTL_BUF_ALLOC handle, 0: none */
+	uint64_t job_id;	/* out: matches jrt_done_rec_t.job_id from read() */
+	uint64_t deadline_ticks;	/* absolute CNTVCT, overrides deadline_us */
 } sched_prog_args_t;
 
+/* execution time characterization run, JRT_REQ_WCET and JRT_REQ_COLD */
+#define RTCORE_SCHED_WCET	(1u << 1)
+#define RTCORE_SCHED_COLD	(1u << 2)
+/* JRT_MISS_* policy for a job that overruns deadline_us */
+#define RTCORE_SCHED_MISS_SHIFT	8
+#define RTCORE_SCHED_MISS(policy)	((uint64_t)(policy) << RTCORE_SCHED_MISS_SHIFT)
+#define RTCORE_SCHED_MISS_POLICY(flags)	(((flags) >> RTCORE_SCHED_MISS_SHIFT) & 3)
+
+typedef struct rtcore_load_args {
+	int64_t fd;		/* image to load */
+	uint64_t slot_user;	/* destination, inside this fd's mapping */
+	uint64_t size;		/* out: bytes loaded */
+} load_fd_args_t;
+
+/*
+ * Content addressed image cache: loading an image that is already cached
+ * returns the existing handle. Handles are released with
+ * RTCORE_IOCTL_IMG_PUT or when the fd is closed. Only ELF images, flat
+ * ones fail with -ENOEXEC.
+ */
+typedef struct rtcore_img_args {
+	int64_t fd;		/* image to load */
+	uint64_t handle;	/* out: cache handle, never 0 */
+	uint64_t size;		/* out: image size */
+} img_load_args_t;
+
+typedef struct rtcore_code_info {
+	uint64_t code_phys;	/* base of the JRT code window */
+	uint64_t code_size;	/* bytes of the window mmap can hand out */
+	uint64_t code_used;	/* bytes already handed out by mmap */
+} code_info_t;
+
+/*
+ * Zero-copy job buffers in the data window's buffer pool. mmap the fd at
+ * offset to fill a buffer, then submit it with sched_prog_args_t.buf: the
+ * job finds it in x2 (size in x3) and reports its output region with
+ * sys_job_output(), returned in jrt_done_rec_t. A buffer is lent to one
+ * job at a time and belongs to JRT until its completion record is read.
+ */
+typedef struct rtcore_buf_args {
+	uint64_t size;		/* rounded up to pages */
+	uint64_t handle;	/* out: never 0 */
+	uint64_t offset;	/* out: mmap offset of the buffer on this fd */
+} buf_alloc_args_t;
+
+/* mmap offsets from here on select job buffers, not the code window */
+#define RTCORE_BUF_MMAP_OFF	(1ull << 32)
+
+/* open or create a named channel, an existing one must match type and size */
+typedef struct rtcore_chan_args {
+	char name[CHAN_NAME_MAX];
+	uint32_t type;		/* CHAN_SEQLOCK or CHAN_TRIPLE */
+	uint32_t size;		/* payload bytes */
+	uint64_t off;		/* out: channel header in the channel area */
+} chan_create_args_t;
+
+/* mmap CHAN_AREA_SIZE bytes here to reach every channel */
+#define RTCORE_CHAN_MMAP_OFF	(1ull << 33)
+
+/* mmap STATS_PAGE_SIZE bytes here, read-only, for shared/stats.h */
+#define RTCORE_STATS_MMAP_OFF	(1ull << 34)
+
+/* mmap CLOCK_PAGE_SIZE bytes here, read-only, for shared/clock.h */
+#define RTCORE_CLOCK_MMAP_OFF	(1ull << 35)
+
+/* mmap PROF_AREA_SIZE bytes here to drain profiler samples (shared/prof.h) */
+#define RTCORE_PROF_MMAP_OFF	(1ull << 36)
+
+/* start, retune or stop (source JRT_PROF_OFF) the RT core profiler */
+typedef struct rtcore_prof_args {
+	uint32_t source;	/* JRT_PROF_* */
+	uint32_t hz;		/* JRT_PROF_TIMER: samples per second */
+	uint64_t cycles;	/* JRT_PROF_PMU: cycles between samples */
+} prof_args_t;
+
+/* events for the RT core's per-process PMU counters, JRT_PMU_NONE: unused */
+typedef struct rtcore_pmu_sel_args {
+	uint32_t event[JRT_PMU_EVENTS];
+} pmu_sel_args_t;
+
+/* signal JRT->Linux event id through eventfd efd, efd < 0 unbinds */
+typedef struct rtcore_evt_bind_args {
+	uint32_t id;
+	int32_t efd;
+} evt_bind_args_t;
+
 #define RTCORE_IOCTL_START_CPU	_IOW('r', 1, start_cpu_args_t)
-#define RTCORE_IOCTL_SCHED_PROG	_IOW('r', 2, sched_prog_args_t)
+#define RTCORE_IOCTL_SCHED_PROG	_IOWR('r', 2, sched_prog_args_t)
+#define RTCORE_IOCTL_CODE_INFO	_IOR('r', 3, code_info_t)
+#define RTCORE_IOCTL_LOAD_FD	_IOWR('r', 4, load_fd_args_t)
+#define RTCORE_IOCTL_IMG_LOAD	_IOWR('r', 5, img_load_args_t)
+#define RTCORE_IOCTL_IMG_PUT	_IOW('r', 6, uint64_t)
+#define RTCORE_IOCTL_EVT_SIGNAL	_IOW('r', 7, uint64_t)	/* mask of Linux->JRT events */
+#define RTCORE_IOCTL_EVT_BIND	_IOW('r', 8, evt_bind_args_t)
+#define RTCORE_IOCTL_BUF_ALLOC	_IOWR('r', 9, buf_alloc_args_t)
+#define RTCORE_IOCTL_BUF_FREE	_IOW('r', 10, uint64_t)
+#define RTCORE_IOCTL_CHAN_CREATE	_IOWR('r', 11, chan_create_args_t)
+#define RTCORE_IOCTL_HIST_RESET	_IOW('r', 12, uint32_t)	/* mask of JRT_HIST_* */
+#define RTCORE_IOCTL_PROF	_IOW('r', 13, prof_args_t)
+#define RTCORE_IOCTL_PMU_SEL	_IOW('r', 14, pmu_sel_args_t)
 
 #define SCHED_SPI (72)
 
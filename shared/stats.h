@@ -0,0 +1,138 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "types.h"
+#include "hist.h"
+
+/*
+ * Runtime accounting, written by JRT at every context switch and read by
+ * Linux through a read-only mapping (RTCORE_STATS_MMAP_OFF). Every entry
+ * carries its own sequence count: odd while JRT updates it, readers copy
+ * the entry and retry if the count moved, so they never stall the RT core.
+ *
+ * Times are CNTPCT ticks, freq converts them. Readers check magic and
+ * version, and that the entry sizes match theirs.
+ *
+ * The latency histograms (shared/hist.h) are the one thing Linux asks
+ * JRT to change: RTCORE_IOCTL_HIST_RESET bumps hist_reset[i] and JRT
+ * clears histogram i before its next sample. Until then readers treat
+ * it as empty.
+ *
+ * PMU counts are virtualized per process: JRT charges the counters'
+ * progress to the process switched out, pmu[i] holds the totals of the
+ * process in proc[i]. The cycle counter is always counted where there is
+ * a PMU, the event counters count pmu_cfg.event[], which JRT sets from
+ * what RTCORE_IOCTL_PMU_SEL asked for (pmu_cfg.sel[]) and what the core
+ * implements. A change of events restarts the event totals, the cycle
+ * totals keep counting.
+ */
+#define JRT_STATS_MAGIC		0x5354524aU	/* "JRTS" */
+#define JRT_STATS_VERSION	3
+
+#define JRT_STATS_CPUS		4
+#define JRT_STATS_PROCS		128
+
+/* jrt_proc_stats.state */
+#define JRT_STATS_FREE		0
+#define JRT_STATS_LIVE		1
+#define JRT_STATS_EXITED	2	/* kept until the slot is reused */
+
+struct JRT_ALIGNED(JRT_CACHELINE) jrt_cpu_stats {
+	u32 seq;
+	u32 online;
+	u32 curr;		/* pid running now, 0: idle */
+	u32 _pad;
+	u64 t_switch;		/* when curr was switched in */
+	u64 busy;		/* ticks running processes */
+	u64 idle;		/* ticks in the idle loop */
+	u64 switches;
+	u64 preemptions;	/* switched out while still ready */
+	u64 jobs;		/* processes that exited */
+	u64 deadline_misses;
+	u64 overruns;		/* deadline timers that fired */
+	u64 kills;		/* JRT_MISS_KILL applied */
+	u64 timer_irqs;		/* CNTP interrupts taken */
+	u64 timer_saved;	/* wakeups timer slack merged into another's */
+	u64 _rsvd[3];
+};
+
+struct JRT_ALIGNED(JRT_CACHELINE) jrt_proc_stats {
+	u32 seq;
+	u32 state;		/* JRT_STATS_* */
+	u32 pid;
+	u32 cpu;
+	u64 job_id;		/* linux job, 0 for spawned procs */
+	u64 deadline;		/* absolute, 0: none */
+	u64 t_start;		/* created */
+	u64 runtime;		/* ticks on the core */
+	u64 switches;		/* times switched in */
+	u64 preemptions;
+	u64 wakeups;		/* activations: ready after blocking */
+	u64 wakeup_sum;		/* ready to running */
+	u64 wakeup_max;
+	u64 response_max;	/* ready to blocking or exit */
+	u64 deadline_misses;	/* activations ending past the deadline */
+	u64 lateness_max;	/* worst end - deadline */
+	u32 overruns;		/* deadline timer fired while it ran */
+	u32 miss_policy;	/* JRT_MISS_* */
+};
+
+/* ARMv8 common event numbers for jrt_pmu_cfg */
+#define JRT_PMU_EVENTS		4
+#define JRT_PMU_NONE		0xffffffffu	/* counter unused */
+#define JRT_PMU_L1D_REFILL	0x03
+#define JRT_PMU_L1D_TLB_REFILL	0x05
+#define JRT_PMU_INST_RETIRED	0x08
+#define JRT_PMU_L2D_REFILL	0x17
+
+/* jrt_pmu_cfg.flags */
+#define JRT_PMU_CYCLES		(1u << 0)	/* cycle counter counted */
+
+struct JRT_ALIGNED(JRT_CACHELINE) jrt_pmu_cfg {
+	u32 seq;
+	u32 flags;		/* JRT_PMU_*, 0: no PMU */
+	u32 ncounters;		/* event counters the core has */
+	u32 gen;		/* sel_gen applied */
+	u32 event[JRT_PMU_EVENTS];	/* counted, JRT_PMU_NONE: nothing */
+	/* written by the rtcore module */
+	u32 sel[JRT_PMU_EVENTS];
+	u32 sel_gen;		/* bumped with every new sel[] */
+	u8  _pad0[JRT_CACHELINE - 52];
+};
+
+struct JRT_ALIGNED(JRT_CACHELINE) jrt_pmu_stats {
+	u32 seq;
+	u32 gen;		/* jrt_pmu_cfg.gen event[] counts under */
+	u64 cycles;
+	u64 event[JRT_PMU_EVENTS];
+	u64 _rsvd[2];
+};
+
+struct JRT_ALIGNED(4096) jrt_stats_page {
+	u32 magic;
+	u32 version;
+	u32 cpu_size;		/* sizeof(struct jrt_cpu_stats) */
+	u32 proc_size;		/* sizeof(struct jrt_proc_stats) */
+	u32 ncpu;
+	u32 nproc;
+	u64 freq;		/* CNTFRQ */
+	u64 t_boot;
+	u32 hist_size;		/* sizeof(struct jrt_hist) */
+	u32 hist_reset[JRT_HIST_NR];	/* written by the rtcore module */
+	u8  _pad0[JRT_CACHELINE - 44 - 4 * JRT_HIST_NR];
+
+	struct jrt_cpu_stats cpu[JRT_STATS_CPUS];
+	struct jrt_proc_stats proc[JRT_STATS_PROCS];
+	struct jrt_hist hist[JRT_HIST_NR];
+	struct jrt_pmu_cfg pmu_cfg;
+	struct jrt_pmu_stats pmu[JRT_STATS_PROCS];
+};
+
+JRT_STATIC_ASSERT(sizeof(struct jrt_cpu_stats) == 128, "cpu stats size");
+JRT_STATIC_ASSERT(sizeof(struct jrt_proc_stats) == 128, "proc stats size");
+JRT_STATIC_ASSERT(sizeof(struct jrt_pmu_stats) == 64, "pmu stats size");
+
+#endif
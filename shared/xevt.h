@@ -0,0 +1,35 @@
+/**
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ */
+#ifndef _XEVT_H_
+#define _XEVT_H_
+
+#include "types.h"
+
+/*
+ * Cross-domain events. Event n is bit n of a pending word, one word per
+ * direction. The signaling side sets bits and rings the other side's
+ * SPI, the receiving handler takes the whole word with one exchange.
+ *
+ *  Linux -> JRT: RTCORE_IOCTL_EVT_SIGNAL, XEVT_SPI, RT tasks block in
+ *                sys_xevt_wait()
+ *  JRT -> Linux: sys_xevt_signal(), XEVT_LINUX_SPI, the rtcore irq handler
+ *                signals the eventfd bound with RTCORE_IOCTL_EVT_BIND
+ *
+ * JRT also sets XEVT_LINUX_DONE in to_linux when it pushes completion
+ * records, the module reaps them then instead of on the next ioctl.
+ */
+#define XEVT_MAX	(63)	/* bit 63 stays clear, waits return the bits */
+#define XEVT_LINUX_DONE	(1ull << XEVT_MAX)	/* not an event, see above */
+
+#define XEVT_SPI	(73)	/* doorbell into JRT */
+#define XEVT_LINUX_SPI	(74)	/* doorbell into Linux */
+
+struct JRT_ALIGNED(JRT_CACHELINE) xevt_page {
+	u64 to_jrt;
+	u8  _pad0[JRT_CACHELINE - 8];
+	u64 to_linux;
+	u8  _pad1[JRT_CACHELINE - 8];
+};
+
+#endif
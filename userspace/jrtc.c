@@ -0,0 +1,154 @@
+/**
+ *
+ * jrtc.c - command line client for jrtd
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "jrtd.h"
+#include "../shared/mailbox.h"
+
+static const char *const g_miss[] = {
+	[JRT_MISS_CONTINUE] = "continue",
+	[JRT_MISS_NOTIFY] = "notify",
+	[JRT_MISS_DEMOTE] = "demote",
+	[JRT_MISS_KILL] = "kill",
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s load <prog.bin>\n"
+		"       %s run <handle> <mem_req> <deadline_us> [count] [miss]\n"
+		"       %s unload <handle>\n"
+		"deadline_us: relative to release, or @ns for an absolute\n"
+		"             CLOCK_MONOTONIC deadline\n"
+		"miss: continue (default), notify, demote or kill\n",
+		prog, prog, prog);
+}
+
+static int jrtd_connect(void)
+{
+	struct sockaddr_un addr;
+	int s;
+
+	s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (s < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", JRTD_SOCK_PATH);
+
+	if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect " JRTD_SOCK_PATH);
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static int jrtd_call(int s, const struct jrtd_req *req, size_t len, struct jrtd_rep *rep)
+{
+	if (send(s, req, len, 0) < 0) {
+		perror("send");
+		return -1;
+	}
+	if (recv(s, rep, sizeof(*rep), 0) != sizeof(*rep)) {
+		perror("recv");
+		return -1;
+	}
+	if (rep->status) {
+		fprintf(stderr, "jrtd: %s\n", strerror(-rep->status));
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct jrtd_req req;
+	struct jrtd_rep rep;
+	size_t len;
+	uint32_t i, count, miss;
+	int s, res;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memset(&req, 0, sizeof(req));
+
+	if (!strcmp(argv[1], "load")) {
+		req.op = JRTD_OP_LOAD;
+		snprintf(req.path, sizeof(req.path), "%s", argv[2]);
+		len = offsetof(struct jrtd_req, path) + strlen(req.path) + 1;
+	} else if (!strcmp(argv[1], "run") && argc >= 5) {
+		count = argc > 5 ? strtoul(argv[5], NULL, 0) : 1;
+		if (!count || count > JRTD_BATCH_MAX) {
+			fprintf(stderr, "count must be in [1, %d]\n", JRTD_BATCH_MAX);
+			return 1;
+		}
+		miss = JRT_MISS_CONTINUE;
+		if (argc > 6) {
+			for (miss = 0; miss <= JRT_MISS_KILL; ++miss) {
+				if (!strcmp(argv[6], g_miss[miss]))
+					break;
+			}
+			if (miss > JRT_MISS_KILL) {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		req.op = JRTD_OP_RUN;
+		req.njobs = count;
+		for (i = 0; i < count; ++i) {
+			req.jobs[i].prog = strtoul(argv[2], NULL, 0);
+			req.jobs[i].miss = miss;
+			req.jobs[i].mem_req = strtoull(argv[3], NULL, 0);
+			if (argv[4][0] == '@')
+				req.jobs[i].deadline_mono =
+					strtoull(argv[4] + 1, NULL, 0);
+			else
+				req.jobs[i].deadline_us =
+					strtoull(argv[4], NULL, 0);
+		}
+		len = offsetof(struct jrtd_req, jobs) + count * sizeof(req.jobs[0]);
+	} else if (!strcmp(argv[1], "unload")) {
+		req.op = JRTD_OP_UNLOAD;
+		req.prog = strtoul(argv[2], NULL, 0);
+		len = offsetof(struct jrtd_req, prog) + sizeof(req.prog);
+	} else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	s = jrtd_connect();
+	if (s < 0)
+		return 1;
+
+	res = jrtd_call(s, &req, len, &rep);
+	close(s);
+	if (res)
+		return 1;
+
+	if (req.op == JRTD_OP_LOAD)
+		printf("%u\n", rep.prog);
+	else if (req.op == JRTD_OP_RUN)
+		printf("submitted %u jobs\n", rep.nrun);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ *
+ * jrtchan.c - create, read and write shared-state channels
+ *
+ * create sets up a channel, read polls an RT->Linux (seqlock) channel
+ * and prints each new state, write pushes a Linux->RT (triple buffer)
+ * state. States are shown and given as 64-bit words.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "rtchan.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s create <name> seq|triple <bytes>\n"
+		"       %s read <name> [period_us]\n"
+		"       %s write <name> <word> [word...]\n",
+		prog, prog, prog);
+}
+
+static int chan_create(int fd, void *area, int argc, char **argv)
+{
+	chan_t c;
+	uint32_t type;
+	int res;
+
+	if (argc != 3)
+		return -EINVAL;
+	if (!strcmp(argv[1], "seq"))
+		type = CHAN_SEQLOCK;
+	else if (!strcmp(argv[1], "triple"))
+		type = CHAN_TRIPLE;
+	else
+		return -EINVAL;
+
+	res = rtchan_open(fd, area, argv[0], type, strtoul(argv[2], NULL, 0), &c);
+	if (!res)
+		printf("%s: %u bytes at +0x%lx\n", argv[0], c.size,
+			(unsigned long)((uint8_t *)c.hdr - (uint8_t *)area));
+	return res;
+}
+
+static int chan_read(void *area, int argc, char **argv)
+{
+	uint64_t w[CHAN_SIZE_MAX / 8];
+	uint32_t seq, last, i, period;
+	chan_t c;
+
+	if (argc < 1)
+		return -EINVAL;
+	if (rtchan_find(area, argv[0], &c) || c.type != CHAN_SEQLOCK)
+		return -ENOENT;
+	period = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+
+	last = ~0u;
+	for (;;) {
+		seq = chan_seq_read(&c, w);
+		if (seq != last) {
+			printf("%u:", seq);
+			for (i = 0; i < c.size / 8; ++i)
+				printf(" %lu", w[i]);
+			printf("\n");
+			fflush(stdout);
+			last = seq;
+		}
+		usleep(period);
+	}
+	return 0;
+}
+
+static int chan_write(void *area, int argc, char **argv)
+{
+	uint64_t w[CHAN_SIZE_MAX / 8];
+	chan_t c;
+	int i;
+
+	if (argc < 2)
+		return -EINVAL;
+	if (rtchan_find(area, argv[0], &c) || c.type != CHAN_TRIPLE)
+		return -ENOENT;
+
+	memset(w, 0, sizeof(w));
+	for (i = 1; i < argc && (i - 1) * 8 < (int)c.size; ++i)
+		w[i - 1] = strtoull(argv[i], NULL, 0);
+	chan_tb_write(&c, w);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	void *area;
+	int fd, res;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open("/dev/rtcore", O_RDWR);
+	if (fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+	area = rtchan_map(fd);
+	if (!area) {
+		perror("mmap channel area");
+		close(fd);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "create"))
+		res = chan_create(fd, area, argc - 2, argv + 2);
+	else if (!strcmp(argv[1], "read"))
+		res = chan_read(area, argc - 2, argv + 2);
+	else if (!strcmp(argv[1], "write"))
+		res = chan_write(area, argc - 2, argv + 2);
+	else
+		res = -EINVAL;
+
+	if (res == -EINVAL)
+		usage(argv[0]);
+	else if (res)
+		fprintf(stderr, "%s: %s\n", argv[2], strerror(-res));
+
+	rtchan_unmap(area);
+	close(fd);
+	return res ? 1 : 0;
+}
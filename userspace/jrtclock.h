@@ -0,0 +1,119 @@
+/**
+ *
+ * jrtclock.h - Linux side of the clock correlation page (shared/clock.h)
+ *
+ * Map the page of an open /dev/rtcore once, then turn CLOCK_MONOTONIC
+ * instants into JRT counter ticks and back without asking JRT or the
+ * module anything: a job can be submitted as "done by T" by putting
+ * jrtclock_from_timespec(c, &T) in sched_prog_args_t.deadline_ticks.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+#ifndef _JRTCLOCK_H_
+#define _JRTCLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+/* a consistent copy of what the conversions need */
+typedef struct jrtclock {
+	u64 ns_mult;
+	u64 tick_mult;
+	u32 ns_shift;
+	u32 tick_shift;
+	s64 mono_off;
+	u64 freq;
+} jrtclock_t;
+
+static inline const struct jrt_clock_page *jrtclock_map(int fd)
+{
+	const struct jrt_clock_page *page;
+	void *p;
+
+	p = mmap(NULL, CLOCK_PAGE_SIZE, PROT_READ, MAP_SHARED, fd,
+		RTCORE_CLOCK_MMAP_OFF);
+	if (p == MAP_FAILED)
+		return NULL;
+	page = p;
+	if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != JRT_CLOCK_MAGIC ||
+		page->version != JRT_CLOCK_VERSION) {
+		munmap(p, CLOCK_PAGE_SIZE);
+		errno = ENODEV;
+		return NULL;
+	}
+	return page;
+}
+
+static inline void jrtclock_unmap(const struct jrt_clock_page *page)
+{
+	munmap((void *)page, CLOCK_PAGE_SIZE);
+}
+
+/* the module only holds the count odd for a few stores, never give up */
+static inline void jrtclock_read(const struct jrt_clock_page *page,
+	jrtclock_t *c)
+{
+	u32 s0, s1;
+
+	do {
+		s0 = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		c->ns_mult = page->ns_mult;
+		c->ns_shift = page->ns_shift;
+		c->tick_mult = page->tick_mult;
+		c->tick_shift = page->tick_shift;
+		c->mono_off = page->mono_off;
+		c->freq = page->freq;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s1 = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	} while ((s0 & 1) || s0 != s1);
+}
+
+/* the counter JRT runs on, CNTVOFF is 0 on the host */
+static inline u64 jrtclock_ticks(void)
+{
+#ifdef __aarch64__
+	u64 v;
+
+	asm volatile("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+	return v;
+#else
+	return 0;
+#endif
+}
+
+/* CLOCK_MONOTONIC ns -> ticks, instants before the counter started give 0 */
+static inline u64 jrtclock_from_mono(const jrtclock_t *c, u64 mono_ns)
+{
+	s64 ns;
+
+	ns = (s64)mono_ns - c->mono_off;
+	if (ns <= 0)
+		return 0;
+	return jrt_mul_shift((u64)ns, c->tick_mult, c->tick_shift);
+}
+
+static inline u64 jrtclock_to_mono(const jrtclock_t *c, u64 ticks)
+{
+	return jrt_mul_shift(ticks, c->ns_mult, c->ns_shift) + c->mono_off;
+}
+
+static inline u64 jrtclock_from_timespec(const jrtclock_t *c,
+	const struct timespec *ts)
+{
+	return jrtclock_from_mono(c,
+		(u64)ts->tv_sec * JRT_NSEC_PER_SEC + ts->tv_nsec);
+}
+
+/* a relative duration, no offset involved */
+static inline u64 jrtclock_ticks_from_ns(const jrtclock_t *c, u64 ns)
+{
+	return jrt_mul_shift(ns, c->tick_mult, c->tick_shift);
+}
+
+#endif
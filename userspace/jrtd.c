@@ -0,0 +1,369 @@
+/**
+ *
+ * jrtd.c - resident JRT program daemon
+ *
+ * Owns /dev/rtcore and keeps program images resident in the module's image
+ * cache. Clients submit jobs over a UNIX socket (see jrtd.h), so a job
+ * costs one message and a cache handle instead of a process launch, an
+ * mmap of the window and a copy of the image.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../shared/rtcore.h"
+#include "jrtclock.h"
+#include "jrtd.h"
+
+#define CLIENT_MAX	16
+
+struct prog {
+	int used;
+	char path[JRTD_PATH_MAX];
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	uint64_t handle;	/* rtcore image cache handle */
+	uint64_t size;		/* image size */
+};
+
+static int g_fd = -1;
+static const struct jrt_clock_page *g_clock;
+
+static struct prog g_prog[JRTD_PROG_MAX];
+
+static volatile sig_atomic_t g_stop;
+
+/* the module dedups by content and keeps the image resident and in sync */
+static int load_image(int fd, uint64_t *handle, uint64_t *size)
+{
+	img_load_args_t args;
+
+	args.fd = fd;
+	args.handle = 0;
+	args.size = 0;
+
+	if (ioctl(g_fd, RTCORE_IOCTL_IMG_LOAD, &args) < 0)
+		return -errno;
+	*handle = args.handle;
+	*size = args.size;
+	return 0;
+}
+
+static int prog_load(const char *path, uint32_t *handle)
+{
+	struct stat st;
+	struct prog *p;
+	int i, fd, res;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto out;
+	}
+
+	/* already resident and unchanged on disk */
+	for (i = 0; i < JRTD_PROG_MAX; ++i) {
+		p = &g_prog[i];
+		if (p->used &&
+			p->dev == st.st_dev &&
+			p->ino == st.st_ino &&
+			p->size == (uint64_t)st.st_size &&
+			p->mtime.tv_sec == st.st_mtim.tv_sec &&
+			p->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			*handle = i;
+			res = 0;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < JRTD_PROG_MAX && g_prog[i].used; ++i)
+		;
+	if (i == JRTD_PROG_MAX) {
+		res = -ENOSPC;
+		goto out;
+	}
+
+	p = &g_prog[i];
+	res = load_image(fd, &p->handle, &p->size);
+	if (res)
+		goto out;
+
+	p->used = 1;
+	snprintf(p->path, sizeof(p->path), "%s", path);
+	p->dev = st.st_dev;
+	p->ino = st.st_ino;
+	p->mtime = st.st_mtim;
+	*handle = i;
+
+	printf("jrtd: loaded %s (%lu bytes) as %d (image %lu)\n",
+		path, p->size, i, p->handle);
+out:
+	close(fd);
+	return res;
+}
+
+static int prog_unload(uint32_t handle)
+{
+	struct prog *p;
+
+	if (handle >= JRTD_PROG_MAX || !g_prog[handle].used)
+		return -EINVAL;
+
+	/* the module keeps the image until its running jobs complete */
+	p = &g_prog[handle];
+	if (ioctl(g_fd, RTCORE_IOCTL_IMG_PUT, &p->handle) < 0)
+		return -errno;
+	p->used = 0;
+	printf("jrtd: unloaded %s\n", p->path);
+	return 0;
+}
+
+static int prog_run(const struct jrtd_job *job)
+{
+	struct prog *p;
+	sched_prog_args_t args;
+	jrtclock_t c;
+
+	if (job->prog >= JRTD_PROG_MAX || !g_prog[job->prog].used ||
+		job->miss > JRT_MISS_KILL)
+		return -EINVAL;
+
+	p = &g_prog[job->prog];
+	memset(&args, 0, sizeof(args));
+	args.mem_req = job->mem_req;
+	args.deadline_us = job->deadline_us;
+	if (job->deadline_mono) {
+		if (!g_clock)
+			return -ENODEV;
+		jrtclock_read(g_clock, &c);
+		args.deadline_ticks = jrtclock_from_mono(&c, job->deadline_mono);
+	}
+	args.flags = RTCORE_SCHED_MISS(job->miss);
+	args.handle = p->handle;
+
+	if (ioctl(g_fd, RTCORE_IOCTL_SCHED_PROG, &args) < 0)
+		return -errno;
+	return 0;
+}
+
+static void handle_req(const struct jrtd_req *req, size_t len, struct jrtd_rep *rep)
+{
+	uint32_t i;
+
+	memset(rep, 0, sizeof(*rep));
+
+	switch (req->op) {
+	case JRTD_OP_LOAD:
+		if (len < offsetof(struct jrtd_req, path) + 1 ||
+			!memchr(req->path, '\0', len - offsetof(struct jrtd_req, path))) {
+			rep->status = -EINVAL;
+			break;
+		}
+		rep->status = prog_load(req->path, &rep->prog);
+		break;
+	case JRTD_OP_RUN:
+		if (req->njobs > JRTD_BATCH_MAX ||
+			len < offsetof(struct jrtd_req, jobs) +
+				req->njobs * sizeof(struct jrtd_job)) {
+			rep->status = -EINVAL;
+			break;
+		}
+		for (i = 0; i < req->njobs; ++i) {
+			rep->status = prog_run(&req->jobs[i]);
+			if (rep->status)
+				break;
+		}
+		rep->nrun = i;
+		break;
+	case JRTD_OP_UNLOAD:
+		if (len < offsetof(struct jrtd_req, prog) + sizeof(req->prog)) {
+			rep->status = -EINVAL;
+			break;
+		}
+		rep->status = prog_unload(req->prog);
+		break;
+	default:
+		rep->status = -ENOSYS;
+		break;
+	}
+}
+
+static int dev_init(void)
+{
+	g_fd = open("/dev/rtcore", O_RDWR | O_NONBLOCK);
+	if (g_fd < 0) {
+		perror("open /dev/rtcore");
+		return -1;
+	}
+	/* absolute deadlines only, relative ones still work without it */
+	g_clock = jrtclock_map(g_fd);
+	if (!g_clock)
+		perror("jrtd: clock page");
+	return 0;
+}
+
+/* keep the module's queue empty, only trouble is worth a line */
+static void drain_done(void)
+{
+	jrt_done_rec_t rec[16];
+	ssize_t n;
+	size_t i;
+
+	while ((n = read(g_fd, rec, sizeof(rec))) > 0) {
+		for (i = 0; i < n / sizeof(rec[0]); ++i) {
+			if (rec[i].flags & JRT_DONE_REJECTED)
+				printf("jrtd: job %llu rejected by JRT (%d)\n",
+					(unsigned long long)rec[i].job_id,
+					rec[i].status);
+			else if (rec[i].flags & JRT_DONE_KILLED)
+				printf("jrtd: job %llu killed at its deadline\n",
+					(unsigned long long)rec[i].job_id);
+			else if (rec[i].flags & JRT_DONE_LATE)
+				printf("jrtd: job %llu missed its deadline\n",
+					(unsigned long long)rec[i].job_id);
+			if (rec[i].flags & JRT_DONE_UNCOLORED)
+				printf("jrtd: job %llu ran on uncolored memory\n",
+					(unsigned long long)rec[i].job_id);
+		}
+	}
+}
+
+static int sock_init(void)
+{
+	struct sockaddr_un addr;
+	int s;
+
+	s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (s < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	mkdir(JRTD_SOCK_DIR, 0755);
+	unlink(JRTD_SOCK_PATH);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", JRTD_SOCK_PATH);
+
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		close(s);
+		return -1;
+	}
+	if (listen(s, CLIENT_MAX) < 0) {
+		perror("listen");
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+int main(void)
+{
+	struct pollfd pfd[CLIENT_MAX + 2];
+	struct jrtd_req req;
+	struct jrtd_rep rep;
+	ssize_t n;
+	int i, j, s, nfds;
+
+	if (dev_init() < 0)
+		return 1;
+
+	s = sock_init();
+	if (s < 0)
+		return 1;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	pfd[0].fd = s;
+	pfd[0].events = POLLIN;
+	/* completions, so late and killed jobs are reported when they end */
+	pfd[1].fd = g_fd;
+	pfd[1].events = POLLIN;
+	nfds = 2;
+
+	printf("jrtd: listening on %s\n", JRTD_SOCK_PATH);
+
+	while (!g_stop) {
+		if (poll(pfd, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		if (pfd[1].revents & POLLIN)
+			drain_done();
+
+		for (i = 2; i < nfds; ++i) {
+			if (!pfd[i].revents)
+				continue;
+
+			n = recv(pfd[i].fd, &req, sizeof(req), 0);
+			if (n > 0) {
+				handle_req(&req, n, &rep);
+				send(pfd[i].fd, &rep, sizeof(rep), MSG_NOSIGNAL);
+				drain_done();
+				continue;
+			}
+
+			/* hangup or error: drop the client */
+			close(pfd[i].fd);
+			for (j = i; j < nfds - 1; ++j)
+				pfd[j] = pfd[j + 1];
+			--nfds;
+			--i;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			j = accept(s, NULL, NULL);
+			if (j < 0)
+				continue;
+			if (nfds == CLIENT_MAX + 2) {
+				close(j);
+				continue;
+			}
+			pfd[nfds].fd = j;
+			pfd[nfds].events = POLLIN;
+			pfd[nfds].revents = 0;
+			++nfds;
+		}
+	}
+
+	for (i = 2; i < nfds; ++i)
+		close(pfd[i].fd);
+	close(s);
+	unlink(JRTD_SOCK_PATH);
+	if (g_clock)
+		jrtclock_unmap(g_clock);
+	close(g_fd);
+	return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ *
+ * jrtd.h - wire protocol between jrtd and its clients
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+#ifndef _JRTD_H_
+#define _JRTD_H_
+
+#include <stdint.h>
+
+#define JRTD_SOCK_DIR	"/tmp"
+#define JRTD_SOCK_PATH	JRTD_SOCK_DIR "/jrtd.sock"
+
+#define JRTD_PATH_MAX	256
+#define JRTD_BATCH_MAX	64	/* jobs per JRTD_OP_RUN message */
+#define JRTD_PROG_MAX	64	/* resident programs */
+
+/*
+ * One request per SOCK_SEQPACKET message, answered by exactly one
+ * struct jrtd_rep.
+ */
+enum jrtd_op {
+	JRTD_OP_LOAD,		/* path -> prog handle (loaded once, then cached) */
+	JRTD_OP_RUN,		/* njobs x (prog, mem, deadline, miss policy) */
+	JRTD_OP_UNLOAD		/* prog -> drops the image reference */
+};
+
+struct jrtd_job {
+	uint32_t prog;
+	uint32_t miss;		/* JRT_MISS_* */
+	uint64_t mem_req;
+	uint64_t deadline_us;
+	uint64_t deadline_mono;	/* CLOCK_MONOTONIC ns, overrides deadline_us */
+};
+
+struct jrtd_req {
+	uint32_t op;
+	uint32_t njobs;
+	union {
+		char path[JRTD_PATH_MAX];
+		uint32_t prog;
+		struct jrtd_job jobs[JRTD_BATCH_MAX];
+	};
+};
+
+struct jrtd_rep {
+	int32_t status;		/* 0 or -errno */
+	uint32_t prog;		/* handle for JRTD_OP_LOAD */
+	uint32_t nrun;		/* jobs submitted for JRTD_OP_RUN */
+	uint32_t _pad;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ *
+ * jrtevt.c - signal and wait on cross-domain JRT events
+ *
+ * signal sets Linux->JRT events, waking RT tasks blocked in
+ * sys_xevt_wait(). wait binds an eventfd to each JRT->Linux event and
+ * sleeps in epoll until RT tasks signal them.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "../shared/rtcore.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s signal <id> [id...]\n"
+		"       %s wait <id> [id...]\n",
+		prog, prog);
+}
+
+static int parse_id(const char *s, uint32_t *id)
+{
+	char *end;
+	unsigned long v;
+
+	v = strtoul(s, &end, 0);
+	if (*end || v >= XEVT_MAX) {
+		fprintf(stderr, "bad event id %s (0..%d)\n", s, XEVT_MAX - 1);
+		return -1;
+	}
+	*id = v;
+	return 0;
+}
+
+static int evt_signal(int fd, int n, char **ids)
+{
+	uint64_t bits;
+	uint32_t id;
+	int i;
+
+	bits = 0;
+	for (i = 0; i < n; ++i) {
+		if (parse_id(ids[i], &id))
+			return 1;
+		bits |= 1ull << id;
+	}
+	if (ioctl(fd, RTCORE_IOCTL_EVT_SIGNAL, &bits) < 0) {
+		perror("RTCORE_IOCTL_EVT_SIGNAL");
+		return 1;
+	}
+	return 0;
+}
+
+static int evt_wait(int fd, int n, char **ids)
+{
+	struct epoll_event ev, evs[XEVT_MAX];
+	evt_bind_args_t args;
+	uint64_t count;
+	uint32_t id;
+	int i, ep, efd, nev;
+
+	ep = epoll_create1(0);
+	if (ep < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (parse_id(ids[i], &id))
+			return 1;
+		efd = eventfd(0, EFD_NONBLOCK);
+		if (efd < 0) {
+			perror("eventfd");
+			return 1;
+		}
+		args.id = id;
+		args.efd = efd;
+		if (ioctl(fd, RTCORE_IOCTL_EVT_BIND, &args) < 0) {
+			perror("RTCORE_IOCTL_EVT_BIND");
+			return 1;
+		}
+		ev.events = EPOLLIN;
+		ev.data.u64 = ((uint64_t)id << 32) | (uint32_t)efd;
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, efd, &ev) < 0) {
+			perror("epoll_ctl");
+			return 1;
+		}
+	}
+
+	for (;;) {
+		nev = epoll_wait(ep, evs, XEVT_MAX, -1);
+		if (nev < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			return 1;
+		}
+		for (i = 0; i < nev; ++i) {
+			efd = (uint32_t)evs[i].data.u64;
+			if (read(efd, &count, sizeof(count)) != sizeof(count))
+				continue;
+			printf("event %u x%lu\n",
+				(uint32_t)(evs[i].data.u64 >> 32), count);
+			fflush(stdout);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int fd, res;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open("/dev/rtcore", O_RDWR);
+	if (fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "signal")) {
+		res = evt_signal(fd, argc - 2, argv + 2);
+	} else if (!strcmp(argv[1], "wait")) {
+		res = evt_wait(fd, argc - 2, argv + 2);
+	} else {
+		usage(argv[0]);
+		res = 1;
+	}
+	close(fd);
+	return res;
+}
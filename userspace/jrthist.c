@@ -0,0 +1,212 @@
+/**
+ *
+ * jrthist.c - JRT latency histograms
+ *
+ * Prints the tail of each latency histogram on the stats page, -r asks
+ * JRT to start them over. With -w the histograms are reset, left to fill
+ * for the given time and then printed.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+#define SNAP_RETRIES	1000
+
+static const char *const g_names[JRT_HIST_NR] = {
+	[JRT_HIST_WAKEUP] = "wakeup",
+	[JRT_HIST_IRQ] = "irq",
+	[JRT_HIST_DOORBELL] = "doorbell",
+	[JRT_HIST_SYSCALL] = "syscall",
+};
+
+static const struct jrt_stats_page *g_page;
+static double g_us_per_tick;
+static struct jrt_hist g_hist;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-r] [-w ms] [-b]\n"
+		"  -r     reset all histograms and exit\n"
+		"  -w ms  reset, wait ms, then print\n"
+		"  -b     also print the non-empty buckets\n",
+		prog);
+}
+
+static int map_stats(int fd)
+{
+	void *p;
+
+	p = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd,
+		RTCORE_STATS_MMAP_OFF);
+	if (p == MAP_FAILED) {
+		perror("mmap stats page");
+		return -1;
+	}
+	g_page = p;
+
+	if (__atomic_load_n(&g_page->magic, __ATOMIC_ACQUIRE) != JRT_STATS_MAGIC) {
+		fprintf(stderr, "JRT is not running (no stats page)\n");
+		return -1;
+	}
+	if (g_page->version != JRT_STATS_VERSION ||
+		g_page->hist_size != sizeof(struct jrt_hist)) {
+		fprintf(stderr, "stats page version %u, expected %u\n",
+			g_page->version, JRT_STATS_VERSION);
+		return -1;
+	}
+	g_us_per_tick = 1e6 / g_page->freq;
+	return 0;
+}
+
+/*
+ * A torn copy is still close: every bucket is a single store. Busy
+ * histograms may not give a clean copy in time, take the last one then.
+ */
+static void snap(u32 id)
+{
+	const struct jrt_hist *h;
+	u32 s0, s1;
+	int i;
+
+	h = &g_page->hist[id];
+	for (i = 0; i < SNAP_RETRIES; ++i) {
+		s0 = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+		memcpy(&g_hist, h, sizeof(g_hist));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s1 = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+		if (!(s0 & 1) && s0 == s1)
+			break;
+	}
+	/* reset asked for but not applied yet: JRT has not seen a sample since */
+	if (g_hist.reset != __atomic_load_n(&g_page->hist_reset[id],
+			__ATOMIC_RELAXED))
+		g_hist.count = 0;
+}
+
+/* upper bound of the bucket holding the q-th fraction of the samples */
+static double pct(double q)
+{
+	u64 want, seen, v;
+	u32 i;
+
+	want = (u64)(q * g_hist.count + 0.999999);
+	if (!want)
+		want = 1;
+	seen = 0;
+	for (i = 0; i < JRT_HIST_BUCKETS; ++i) {
+		seen += g_hist.bucket[i];
+		if (seen >= want)
+			break;
+	}
+	v = i < JRT_HIST_BUCKETS ? jrt_hist_value(i) : g_hist.max;
+	return (v < g_hist.max ? v : g_hist.max) * g_us_per_tick;
+}
+
+static void print_hists(int buckets)
+{
+	u32 id, i;
+
+	printf("%-9s %10s %9s %9s %9s %9s %9s %9s %8s\n",
+		"(us)", "count", "min", "avg", "p50", "p99", "p99.9",
+		"max", "over");
+	for (id = 0; id < JRT_HIST_NR; ++id) {
+		snap(id);
+		if (!g_hist.count) {
+			printf("%-9s %10d\n", g_names[id], 0);
+			continue;
+		}
+		printf("%-9s %10lu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %8lu\n",
+			g_names[id], g_hist.count,
+			g_hist.min * g_us_per_tick,
+			g_hist.sum * g_us_per_tick / g_hist.count,
+			pct(0.5), pct(0.99), pct(0.999),
+			g_hist.max * g_us_per_tick, g_hist.overflow);
+		if (!buckets)
+			continue;
+		for (i = 0; i < JRT_HIST_BUCKETS; ++i) {
+			if (g_hist.bucket[i])
+				printf("  <= %10.2f %10u\n",
+					jrt_hist_value(i) * g_us_per_tick,
+					g_hist.bucket[i]);
+		}
+	}
+}
+
+static int reset(int fd)
+{
+	uint32_t mask;
+
+	mask = (1u << JRT_HIST_NR) - 1;
+	if (ioctl(fd, RTCORE_IOCTL_HIST_RESET, &mask) < 0) {
+		perror("ioctl HIST_RESET");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int fd, opt, do_reset, buckets, res;
+	long wait_ms;
+
+	do_reset = 0;
+	buckets = 0;
+	wait_ms = 0;
+	while ((opt = getopt(argc, argv, "rw:b")) != -1) {
+		switch (opt) {
+		case 'r':
+			do_reset = 1;
+			break;
+		case 'w':
+			wait_ms = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			buckets = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	fd = open("/dev/rtcore", O_RDONLY);
+	if (fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+	if (map_stats(fd)) {
+		close(fd);
+		return 1;
+	}
+
+	res = 0;
+	if (do_reset) {
+		res = reset(fd);
+	} else if (wait_ms > 0) {
+		res = reset(fd);
+		if (!res) {
+			usleep(wait_ms * 1000);
+			print_hists(buckets);
+		}
+	} else {
+		print_hists(buckets);
+	}
+
+	munmap((void *)g_page, STATS_PAGE_SIZE);
+	close(fd);
+	return res ? 1 : 0;
+}
@@ -0,0 +1,426 @@
+/**
+ *
+ * jrtprof.c - sampling profiler for the RT core
+ *
+ * Starts the JRT profiler (shared/prof.h), drains its sample ring for the
+ * given time, stops it and prints folded stacks, one "frame;frame count"
+ * line per distinct stack, ready for flamegraph.pl. Frames are symbolized
+ * against rtprog.elf for JRT kernel addresses and against app ELFs for
+ * process addresses: -a binds an ELF to one image (by its physical
+ * address, as sampled) or, without one, to every image not bound
+ * otherwise. Addresses without a symbol print as hex.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+#define APP_MAX		16
+#define FOLD_MAX	1024
+#define POLL_MS		10
+
+struct sym {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+};
+
+struct symtab {
+	const char *path;
+	uint64_t img;		/* image pa, 0: any image */
+	char *data;		/* the whole file, names point into it */
+	struct sym *syms;
+	size_t nsyms;
+};
+
+static struct jrt_prof_area *g_area;
+static struct symtab g_kernel;
+static struct symtab g_app[APP_MAX];
+static int g_napp;
+
+static struct jrt_prof_sample *g_samples;
+static size_t g_nsamples, g_cap;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-d sec] [-f hz] [-c cycles] [-k rtprog.elf]\n"
+		"          [-a [pa=]app.elf]... [-r]\n"
+		"  -d sec     how long to sample (default 5)\n"
+		"  -f hz      timer samples per second (default 1000)\n"
+		"  -c cycles  sample on PMU cycle overflow instead\n"
+		"  -k elf     JRT kernel symbols\n"
+		"  -a elf     app symbols, for the image at pa or all others\n"
+		"  -r         raw: one line per sample, no symbols\n",
+		prog);
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+	const struct sym *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/* function symbols of an ELF64 file, sorted by address */
+static int symtab_load(struct symtab *t, const char *path)
+{
+	const Elf64_Ehdr *eh;
+	const Elf64_Shdr *sh, *strs;
+	const Elf64_Sym *s;
+	struct stat st;
+	size_t i, j, n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+	t->data = malloc(st.st_size);
+	if (!t->data || read(fd, t->data, st.st_size) != st.st_size) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	eh = (const Elf64_Ehdr *)t->data;
+	if ((size_t)st.st_size < sizeof(*eh) ||
+		memcmp(eh->e_ident, ELFMAG, SELFMAG) ||
+		eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+		eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(*sh) > (uint64_t)st.st_size) {
+		fprintf(stderr, "%s: not an ELF64 file\n", path);
+		return -1;
+	}
+	sh = (const Elf64_Shdr *)(t->data + eh->e_shoff);
+	for (i = 0; i < eh->e_shnum; ++i) {
+		if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum)
+			continue;
+		strs = &sh[sh[i].sh_link];
+		n = sh[i].sh_size / sizeof(*s);
+		s = (const Elf64_Sym *)(t->data + sh[i].sh_offset);
+		t->syms = calloc(n, sizeof(*t->syms));
+		if (!t->syms)
+			return -1;
+		for (j = 0; j < n; ++j) {
+			if (ELF64_ST_TYPE(s[j].st_info) != STT_FUNC || !s[j].st_value ||
+				s[j].st_name >= strs->sh_size)
+				continue;
+			t->syms[t->nsyms].addr = s[j].st_value;
+			t->syms[t->nsyms].size = s[j].st_size;
+			t->syms[t->nsyms].name = t->data + strs->sh_offset + s[j].st_name;
+			t->nsyms++;
+		}
+		break;
+	}
+	if (!t->nsyms) {
+		fprintf(stderr, "%s: no function symbols (stripped?)\n", path);
+		return -1;
+	}
+	qsort(t->syms, t->nsyms, sizeof(*t->syms), sym_cmp);
+	t->path = path;
+	return 0;
+}
+
+/* the function holding addr, NULL if it falls outside all of them */
+static const char *symtab_find(const struct symtab *t, uint64_t addr)
+{
+	size_t lo, hi, mid;
+	const struct sym *s;
+
+	if (!t || !t->nsyms || addr < t->syms[0].addr)
+		return NULL;
+	lo = 0;
+	hi = t->nsyms;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (t->syms[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	s = &t->syms[lo];
+	if (s->size && addr >= s->addr + s->size)
+		return NULL;
+	return s->name;
+}
+
+static const struct symtab *app_symtab(uint64_t img)
+{
+	const struct symtab *any;
+	int i;
+
+	any = NULL;
+	for (i = 0; i < g_napp; ++i) {
+		if (g_app[i].img == img)
+			return &g_app[i];
+		if (!g_app[i].img)
+			any = &g_app[i];
+	}
+	return any;
+}
+
+static int add_app(const char *arg)
+{
+	const char *eq;
+	struct symtab *t;
+
+	if (g_napp == APP_MAX) {
+		fprintf(stderr, "at most %d app ELFs\n", APP_MAX);
+		return -1;
+	}
+	t = &g_app[g_napp];
+	eq = strchr(arg, '=');
+	if (eq) {
+		t->img = strtoull(arg, NULL, 0);
+		arg = eq + 1;
+	}
+	if (symtab_load(t, arg))
+		return -1;
+	g_napp++;
+	return 0;
+}
+
+static int prof_ctl(int fd, uint32_t source, uint32_t hz, uint64_t cycles)
+{
+	prof_args_t args;
+
+	args.source = source;
+	args.hz = hz;
+	args.cycles = cycles;
+	if (ioctl(fd, RTCORE_IOCTL_PROF, &args) < 0) {
+		perror("ioctl PROF");
+		return -1;
+	}
+	return 0;
+}
+
+static void drain(void)
+{
+	struct jrt_prof_sample *n;
+	uint32_t head, tail;
+
+	tail = g_area->tail;
+	head = __atomic_load_n(&g_area->head, __ATOMIC_ACQUIRE);
+	for (; tail != head; ++tail) {
+		if (g_nsamples == g_cap) {
+			g_cap = g_cap ? 2 * g_cap : 4096;
+			n = realloc(g_samples, g_cap * sizeof(*n));
+			if (!n) {
+				perror("realloc");
+				exit(1);
+			}
+			g_samples = n;
+		}
+		g_samples[g_nsamples++] = g_area->s[tail & (JRT_PROF_SLOTS - 1)];
+	}
+	/* slots copied before JRT may reuse them */
+	__atomic_store_n(&g_area->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void frame(char *line, size_t *len, uint64_t addr, int kernel,
+	const struct symtab *app)
+{
+	const char *name;
+
+	name = symtab_find(kernel ? &g_kernel : app, addr);
+	if (name)
+		*len += snprintf(line + *len, FOLD_MAX - *len, ";%s", name);
+	else
+		*len += snprintf(line + *len, FOLD_MAX - *len, ";0x%llx",
+			(unsigned long long)addr);
+	if (*len >= FOLD_MAX)
+		*len = FOLD_MAX - 1;
+}
+
+static int in_kernel(uint64_t addr)
+{
+	return addr >= JRT_CODE_PHYS && addr < JRT_CODE_PHYS + JRT_CODE_SIZE;
+}
+
+/* root first: who ran, then the callers outermost first, then pc */
+static void fold(const struct jrt_prof_sample *s, char *line)
+{
+	const struct symtab *app;
+	size_t len;
+	int i;
+
+	if (s->flags & JRT_PROF_S_IDLE)
+		len = snprintf(line, FOLD_MAX, "jrt");
+	else
+		len = snprintf(line, FOLD_MAX, "pid%u", s->pid);
+	app = app_symtab(s->img);
+	for (i = s->depth; i > 0; --i)
+		/* the call, not the instruction after it */
+		frame(line, &len, s->callers[i - 1] - 4,
+			in_kernel(s->callers[i - 1]), app);
+	frame(line, &len, s->pc, s->flags & JRT_PROF_S_KERNEL, app);
+}
+
+static int str_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int print_folded(void)
+{
+	char **lines;
+	size_t i, n;
+
+	lines = calloc(g_nsamples ? g_nsamples : 1, sizeof(*lines));
+	if (!lines)
+		return -1;
+	for (i = 0; i < g_nsamples; ++i) {
+		lines[i] = malloc(FOLD_MAX);
+		if (!lines[i])
+			return -1;
+		fold(&g_samples[i], lines[i]);
+	}
+	qsort(lines, g_nsamples, sizeof(*lines), str_cmp);
+	for (i = 0; i < g_nsamples; i += n) {
+		for (n = 1; i + n < g_nsamples && !strcmp(lines[i], lines[i + n]); ++n)
+			free(lines[i + n]);
+		printf("%s %zu\n", lines[i], n);
+		free(lines[i]);
+	}
+	free(lines);
+	return 0;
+}
+
+static void print_raw(void)
+{
+	const struct jrt_prof_sample *s;
+	size_t i;
+	int j;
+
+	for (i = 0; i < g_nsamples; ++i) {
+		s = &g_samples[i];
+		printf("%llu %u %#x %#llx %#llx",
+			(unsigned long long)s->t, s->pid, s->flags,
+			(unsigned long long)s->img, (unsigned long long)s->pc);
+		for (j = 0; j < s->depth; ++j)
+			printf(" %#llx", (unsigned long long)s->callers[j]);
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec now, end;
+	uint32_t source, hz;
+	uint64_t cycles;
+	int fd, opt, raw, res, checked;
+	long sec;
+
+	sec = 5;
+	hz = 0;
+	cycles = 0;
+	raw = 0;
+	while ((opt = getopt(argc, argv, "d:f:c:k:a:r")) != -1) {
+		switch (opt) {
+		case 'd':
+			sec = strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			hz = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cycles = strtoull(optarg, NULL, 0);
+			break;
+		case 'k':
+			if (symtab_load(&g_kernel, optarg))
+				return 1;
+			break;
+		case 'a':
+			if (add_app(optarg))
+				return 1;
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (sec <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	source = cycles ? JRT_PROF_PMU : JRT_PROF_TIMER;
+
+	fd = open("/dev/rtcore", O_RDWR);
+	if (fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+	g_area = mmap(NULL, PROF_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, RTCORE_PROF_MMAP_OFF);
+	if (g_area == MAP_FAILED) {
+		perror("mmap profiler ring");
+		close(fd);
+		return 1;
+	}
+	if (__atomic_load_n(&g_area->magic, __ATOMIC_ACQUIRE) != JRT_PROF_MAGIC ||
+		g_area->version != JRT_PROF_VERSION) {
+		fprintf(stderr, "JRT is not running or has no profiler\n");
+		close(fd);
+		return 1;
+	}
+
+	/* leftovers of an earlier run */
+	g_area->tail = __atomic_load_n(&g_area->head, __ATOMIC_ACQUIRE);
+	if (prof_ctl(fd, source, hz, cycles)) {
+		close(fd);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += sec;
+	checked = 0;
+	do {
+		usleep(POLL_MS * 1000);
+		drain();
+		/* JRT has taken the request once it acknowledged it */
+		if (!checked && __atomic_load_n(&g_area->ack_seq, __ATOMIC_ACQUIRE) ==
+				g_area->ctl_seq) {
+			if (g_area->active != source)
+				fprintf(stderr, "jrtprof: no PMU on the RT core, "
+					"sampling on the timer\n");
+			checked = 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (now.tv_sec < end.tv_sec ||
+		(now.tv_sec == end.tv_sec && now.tv_nsec < end.tv_nsec));
+
+	res = prof_ctl(fd, JRT_PROF_OFF, 0, 0);
+	drain();
+	if (g_area->dropped)
+		fprintf(stderr, "jrtprof: %u samples dropped in total\n",
+			g_area->dropped);
+
+	if (raw)
+		print_raw();
+	else if (print_folded())
+		res = -1;
+
+	munmap(g_area, PROF_AREA_SIZE);
+	close(fd);
+	return res ? 1 : 0;
+}
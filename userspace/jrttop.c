@@ -0,0 +1,381 @@
+/**
+ *
+ * jrttop.c - per-core and per-process JRT runtime statistics
+ *
+ * Maps the JRT stats page read-only and samples it, nothing is asked of
+ * the RT core: entries are copied under their sequence counts and the
+ * copy is retried if JRT updated the entry meanwhile.
+ *
+ * -p adds each process' PMU counts over the interval, -e first asks JRT
+ * to count other events (names below or raw ARMv8 event numbers).
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+#define SNAP_RETRIES	1000
+
+static const struct jrt_stats_page *g_page;
+static double g_us_per_tick;
+
+static struct jrt_cpu_stats g_cpu[2][JRT_STATS_CPUS];
+static struct jrt_proc_stats g_proc[2][JRT_STATS_PROCS];
+static struct jrt_pmu_stats g_pmu[2][JRT_STATS_PROCS];
+static struct jrt_pmu_cfg g_pmu_cfg;
+
+static const struct {
+	const char *name;
+	uint32_t ev;
+} g_events[] = {
+	{ "l1d_refill", JRT_PMU_L1D_REFILL },
+	{ "l1d_tlb_refill", JRT_PMU_L1D_TLB_REFILL },
+	{ "inst", JRT_PMU_INST_RETIRED },
+	{ "l2d_refill", JRT_PMU_L2D_REFILL },
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-d delay_ms] [-n samples] [-a] [-p] [-e ev,...]\n"
+		"  -a  also show processes that have exited\n"
+		"  -p  show per-process PMU counts\n"
+		"  -e  count these events (up to %d): l1d_refill, l1d_tlb_refill,\n"
+		"      inst, l2d_refill or a raw event number\n",
+		prog, JRT_PMU_EVENTS);
+}
+
+/* JRT and Linux read the same system counter, CNTVOFF is 0 on the host */
+static uint64_t now_ticks(void)
+{
+#ifdef __aarch64__
+	uint64_t v;
+
+	asm volatile("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+	return v;
+#else
+	return 0;
+#endif
+}
+
+/* copy one entry, its first word is the sequence count */
+static int snap(const void *src, void *dst, size_t len)
+{
+	const uint32_t *seq;
+	uint32_t s0, s1;
+	int i;
+
+	seq = src;
+	for (i = 0; i < SNAP_RETRIES; ++i) {
+		s0 = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		memcpy(dst, src, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s1 = __atomic_load_n(seq, __ATOMIC_RELAXED);
+		if (!(s0 & 1) && s0 == s1)
+			return 0;
+	}
+	return -EAGAIN;
+}
+
+static double us(uint64_t ticks)
+{
+	return ticks * g_us_per_tick;
+}
+
+static int map_stats(int fd)
+{
+	void *p;
+
+	p = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd,
+		RTCORE_STATS_MMAP_OFF);
+	if (p == MAP_FAILED) {
+		perror("mmap stats page");
+		return -1;
+	}
+	g_page = p;
+
+	if (__atomic_load_n(&g_page->magic, __ATOMIC_ACQUIRE) != JRT_STATS_MAGIC) {
+		fprintf(stderr, "JRT is not running (no stats page)\n");
+		return -1;
+	}
+	if (g_page->version != JRT_STATS_VERSION ||
+		g_page->cpu_size != sizeof(struct jrt_cpu_stats) ||
+		g_page->proc_size != sizeof(struct jrt_proc_stats) ||
+		g_page->ncpu > JRT_STATS_CPUS ||
+		g_page->nproc > JRT_STATS_PROCS) {
+		fprintf(stderr, "stats page version %u, expected %u\n",
+			g_page->version, JRT_STATS_VERSION);
+		return -1;
+	}
+	g_us_per_tick = 1e6 / g_page->freq;
+	return 0;
+}
+
+static const char *event_name(uint32_t ev)
+{
+	static char raw[16];
+	size_t i;
+
+	for (i = 0; i < sizeof(g_events) / sizeof(g_events[0]); ++i) {
+		if (g_events[i].ev == ev)
+			return g_events[i].name;
+	}
+	snprintf(raw, sizeof(raw), "0x%x", ev);
+	return raw;
+}
+
+static int parse_events(char *arg, pmu_sel_args_t *sel)
+{
+	char *tok, *end;
+	size_t i;
+	int n;
+
+	for (n = 0; n < JRT_PMU_EVENTS; ++n)
+		sel->event[n] = JRT_PMU_NONE;
+	n = 0;
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		if (n == JRT_PMU_EVENTS)
+			return -1;
+		for (i = 0; i < sizeof(g_events) / sizeof(g_events[0]); ++i) {
+			if (!strcmp(tok, g_events[i].name))
+				break;
+		}
+		if (i < sizeof(g_events) / sizeof(g_events[0])) {
+			sel->event[n++] = g_events[i].ev;
+			continue;
+		}
+		sel->event[n++] = strtoul(tok, &end, 0);
+		if (*end)
+			return -1;
+	}
+	return 0;
+}
+
+static void sample(int cur)
+{
+	uint32_t i;
+
+	for (i = 0; i < g_page->ncpu; ++i) {
+		if (snap(&g_page->cpu[i], &g_cpu[cur][i], sizeof(g_cpu[cur][i])))
+			g_cpu[cur][i].online = 0;
+	}
+	for (i = 0; i < g_page->nproc; ++i) {
+		if (snap(&g_page->proc[i], &g_proc[cur][i], sizeof(g_proc[cur][i])))
+			g_proc[cur][i].state = JRT_STATS_FREE;
+		if (snap(&g_page->pmu[i], &g_pmu[cur][i], sizeof(g_pmu[cur][i])))
+			g_proc[cur][i].state = JRT_STATS_FREE;
+	}
+	if (snap(&g_page->pmu_cfg, &g_pmu_cfg, sizeof(g_pmu_cfg)))
+		g_pmu_cfg.gen = ~0u;
+}
+
+/* runtime including the run in progress, if s is on a core right now */
+static uint64_t runtime(const struct jrt_proc_stats *s, int cur, uint64_t now)
+{
+	const struct jrt_cpu_stats *cs;
+
+	cs = &g_cpu[cur][s->cpu];
+	if (s->state == JRT_STATS_LIVE && cs->curr == s->pid && now > cs->t_switch)
+		return s->runtime + (now - cs->t_switch);
+	return s->runtime;
+}
+
+static void print_cpus(int cur, double dt)
+{
+	const struct jrt_cpu_stats *c, *o;
+	uint64_t busy, idle;
+	uint32_t i;
+
+	for (i = 0; i < g_page->ncpu; ++i) {
+		c = &g_cpu[cur][i];
+		o = &g_cpu[!cur][i];
+		if (!c->online)
+			continue;
+		busy = c->busy - o->busy;
+		idle = c->idle - o->idle;
+		printf("cpu%u: busy %5.1f%%  switches %8.0f/s  preempt %6.0f/s  "
+			"jobs %lu  misses %lu  overruns %lu  kills %lu\n",
+			i,
+			busy + idle ? 100.0 * busy / (busy + idle) : 0.0,
+			(c->switches - o->switches) / dt,
+			(c->preemptions - o->preemptions) / dt,
+			c->jobs, c->deadline_misses, c->overruns, c->kills);
+		printf("      timer irqs %8.0f/s  saved by slack %8.0f/s\n",
+			(c->timer_irqs - o->timer_irqs) / dt,
+			(c->timer_saved - o->timer_saved) / dt);
+	}
+}
+
+static void print_procs(int cur, uint64_t t0, uint64_t t1, int all)
+{
+	const struct jrt_proc_stats *s, *o;
+	uint64_t run, prev;
+	uint32_t i;
+
+	printf("%5s %8s %2s %6s %12s %8s %6s %10s %10s %10s %6s %10s %4s\n",
+		"PID", "JOB", "S", "CPU%", "RUN(us)", "SW", "PREEMPT",
+		"WAKEAVG", "WAKEMAX", "RESPMAX", "MISS", "LATEMAX", "OVR");
+	for (i = 0; i < g_page->nproc; ++i) {
+		s = &g_proc[cur][i];
+		o = &g_proc[!cur][i];
+		if (s->state == JRT_STATS_FREE ||
+			(s->state == JRT_STATS_EXITED && !all))
+			continue;
+
+		run = runtime(s, cur, t1);
+		prev = o->state != JRT_STATS_FREE && o->pid == s->pid &&
+			o->t_start == s->t_start ? runtime(o, !cur, t0) : 0;
+
+		printf("%5u %8lu %2s %6.1f %12.1f %8lu %6lu %10.1f %10.1f %10.1f %6lu %10.1f %4u\n",
+			s->pid, s->job_id,
+			s->state == JRT_STATS_LIVE ? "R" : "X",
+			t1 > t0 ? 100.0 * (run - prev) / (t1 - t0) : 0.0,
+			us(run), s->switches, s->preemptions,
+			s->wakeups ? us(s->wakeup_sum) / s->wakeups : 0.0,
+			us(s->wakeup_max), us(s->response_max),
+			s->deadline_misses, us(s->lateness_max), s->overruns);
+	}
+}
+
+/* counts over the interval, whole totals for procs new since the last sample */
+static void print_pmu(int cur, int all)
+{
+	const struct jrt_proc_stats *s, *o;
+	const struct jrt_pmu_stats *m, *mo;
+	uint64_t cyc, ev;
+	uint32_t i, j;
+	int same;
+
+	if (!(g_pmu_cfg.flags & JRT_PMU_CYCLES)) {
+		printf("no PMU on the RT core\n");
+		return;
+	}
+	printf("%5s %12s", "PID", "CYCLES");
+	for (j = 0; j < JRT_PMU_EVENTS; ++j) {
+		if (g_pmu_cfg.event[j] != JRT_PMU_NONE)
+			printf(" %14s", event_name(g_pmu_cfg.event[j]));
+	}
+	printf("\n");
+	for (i = 0; i < g_page->nproc; ++i) {
+		s = &g_proc[cur][i];
+		o = &g_proc[!cur][i];
+		m = &g_pmu[cur][i];
+		mo = &g_pmu[!cur][i];
+		if (s->state == JRT_STATS_FREE ||
+			(s->state == JRT_STATS_EXITED && !all))
+			continue;
+
+		same = o->state != JRT_STATS_FREE && o->pid == s->pid &&
+			o->t_start == s->t_start;
+		cyc = m->cycles - (same ? mo->cycles : 0);
+		printf("%5u %12lu", s->pid, cyc);
+		for (j = 0; j < JRT_PMU_EVENTS; ++j) {
+			if (g_pmu_cfg.event[j] == JRT_PMU_NONE)
+				continue;
+			// counts from before a change of events are gone
+			if (m->gen != g_pmu_cfg.gen) {
+				printf(" %14s", "-");
+				continue;
+			}
+			ev = m->event[j] - (same && mo->gen == m->gen ?
+				mo->event[j] : 0);
+			printf(" %14lu", ev);
+		}
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t t0, t1;
+	pmu_sel_args_t sel;
+	int fd, opt, all, pmu, events, cur;
+	long delay_ms, n, i;
+
+	delay_ms = 1000;
+	n = 0;
+	all = 0;
+	pmu = 0;
+	events = 0;
+	while ((opt = getopt(argc, argv, "d:n:ape:")) != -1) {
+		switch (opt) {
+		case 'd':
+			delay_ms = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			n = strtol(optarg, NULL, 0);
+			break;
+		case 'a':
+			all = 1;
+			break;
+		case 'p':
+			pmu = 1;
+			break;
+		case 'e':
+			if (parse_events(optarg, &sel)) {
+				usage(argv[0]);
+				return 1;
+			}
+			events = 1;
+			pmu = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (delay_ms <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open("/dev/rtcore", O_RDONLY);
+	if (fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+	if (map_stats(fd)) {
+		close(fd);
+		return 1;
+	}
+	if (events && ioctl(fd, RTCORE_IOCTL_PMU_SEL, &sel) < 0) {
+		perror("ioctl PMU_SEL");
+		munmap((void *)g_page, STATS_PAGE_SIZE);
+		close(fd);
+		return 1;
+	}
+
+	cur = 0;
+	t0 = now_ticks();
+	sample(cur);
+	for (i = 0; !n || i < n; ++i) {
+		usleep(delay_ms * 1000);
+		cur = !cur;
+		t1 = now_ticks();
+		sample(cur);
+
+		printf("\n");
+		print_cpus(cur, delay_ms / 1000.0);
+		print_procs(cur, t0, t1, all);
+		if (pmu)
+			print_pmu(cur, all);
+		fflush(stdout);
+		t0 = t1;
+	}
+
+	munmap((void *)g_page, STATS_PAGE_SIZE);
+	close(fd);
+	return 0;
+}
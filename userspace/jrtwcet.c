@@ -0,0 +1,270 @@
+/**
+ *
+ * jrtwcet.c - execution time characterization of a JRT program
+ *
+ * Runs a program N times as JRT_REQ_WCET jobs, one at a time: JRT holds
+ * back other submissions while each run has the core and, with -c,
+ * starts it from cleaned caches and TLB. Without -c the first -w runs
+ * are thrown away so the measured ones start warm. The execution time
+ * JRT returns per run (preemptions excluded) is summarized as
+ * min/mean/p50/p99/max, and max plus a margin is recommended as the
+ * program's budget.
+ *
+ * Runs that took interrupts are counted, a quiet core shows none. Other
+ * processes already live on JRT are not stopped, the tool warns about
+ * them.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "jrtclock.h"
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+#define MARGIN_PCT	20
+
+static int g_fd = -1;
+static double g_us_per_tick;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n runs] [-w warmup] [-c] [-m mem_req] [-t timeout_ms]\n"
+		"          [-M margin_pct] [-v] <prog.bin>\n"
+		"  -n  measured runs (default 100)\n"
+		"  -w  unmeasured warm-up runs first (default 1, 0 with -c)\n"
+		"  -c  cold: clean caches and TLB before every run\n"
+		"  -m  memory per run (default 4096)\n"
+		"  -t  give up on a run after this long (default 10000)\n"
+		"  -M  budget margin over the worst run (default %d)\n"
+		"  -v  print every run\n",
+		prog, MARGIN_PCT);
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static double us(uint64_t ticks)
+{
+	return ticks * g_us_per_tick;
+}
+
+/* processes already on JRT would compete with the runs */
+static void check_idle(void)
+{
+	const struct jrt_stats_page *page;
+	uint32_t i, live;
+	void *p;
+
+	p = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED, g_fd,
+		RTCORE_STATS_MMAP_OFF);
+	if (p == MAP_FAILED)
+		return;
+	page = p;
+	live = 0;
+	if (page->magic == JRT_STATS_MAGIC && page->version == JRT_STATS_VERSION) {
+		for (i = 0; i < page->nproc && i < JRT_STATS_PROCS; ++i)
+			live += page->proc[i].state == JRT_STATS_LIVE;
+	}
+	if (live)
+		fprintf(stderr, "jrtwcet: %u processes live on JRT, "
+			"their runs may disturb the measurement\n", live);
+	munmap(p, STATS_PAGE_SIZE);
+}
+
+static int load(const char *path, uint64_t *handle)
+{
+	img_load_args_t args;
+	int fd, res;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	memset(&args, 0, sizeof(args));
+	args.fd = fd;
+	res = ioctl(g_fd, RTCORE_IOCTL_IMG_LOAD, &args);
+	close(fd);
+	if (res < 0) {
+		perror("ioctl IMG_LOAD");
+		return -1;
+	}
+	*handle = args.handle;
+	return 0;
+}
+
+/* submit one run and wait for its completion record */
+static int run_once(uint64_t handle, uint64_t mem_req, uint64_t flags,
+	long timeout_ms, jrt_done_rec_t *rec)
+{
+	sched_prog_args_t args;
+	struct pollfd pfd;
+	ssize_t n;
+	int res;
+
+	memset(&args, 0, sizeof(args));
+	args.handle = handle;
+	args.mem_req = mem_req;
+	args.flags = flags;
+	if (ioctl(g_fd, RTCORE_IOCTL_SCHED_PROG, &args) < 0) {
+		perror("ioctl SCHED_PROG");
+		return -1;
+	}
+	pfd.fd = g_fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		n = read(g_fd, rec, sizeof(*rec));
+		if (n == sizeof(*rec)) {
+			// only this tool submits through this fd
+			if (rec->job_id != args.job_id)
+				continue;
+			if (rec->flags & JRT_DONE_REJECTED) {
+				fprintf(stderr, "jrtwcet: JRT rejected the run (%d)\n",
+					rec->status);
+				return -1;
+			}
+			return 0;
+		}
+		if (n < 0 && errno != EAGAIN) {
+			perror("read");
+			return -1;
+		}
+		// the module wakes us when JRT pushes the record
+		res = poll(&pfd, 1, timeout_ms);
+		if (res < 0 && errno != EINTR) {
+			perror("poll");
+			return -1;
+		}
+		if (!res)
+			break;
+	}
+	fprintf(stderr, "jrtwcet: job %llu still running after %ld ms\n",
+		(unsigned long long)args.job_id, timeout_ms);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct jrt_clock_page *clock;
+	jrtclock_t c;
+	jrt_done_rec_t rec;
+	uint64_t *exec, handle, mem_req, flags, sum, budget;
+	long runs, warmup, timeout_ms, margin, i;
+	int opt, cold, verbose, disturbed;
+
+	runs = 100;
+	warmup = -1;
+	cold = 0;
+	mem_req = 4096;
+	timeout_ms = 10000;
+	margin = MARGIN_PCT;
+	verbose = 0;
+	while ((opt = getopt(argc, argv, "n:w:cm:t:M:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			runs = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			warmup = strtol(optarg, NULL, 0);
+			break;
+		case 'c':
+			cold = 1;
+			break;
+		case 'm':
+			mem_req = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			timeout_ms = strtol(optarg, NULL, 0);
+			break;
+		case 'M':
+			margin = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || runs <= 0 || timeout_ms <= 0 || margin < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (warmup < 0)
+		warmup = cold ? 0 : 1;
+
+	exec = calloc(runs, sizeof(*exec));
+	if (!exec) {
+		perror("calloc");
+		return 1;
+	}
+	g_fd = open("/dev/rtcore", O_RDWR);
+	if (g_fd < 0) {
+		perror("open /dev/rtcore");
+		return 1;
+	}
+	clock = jrtclock_map(g_fd);
+	if (!clock) {
+		perror("clock page");
+		return 1;
+	}
+	jrtclock_read(clock, &c);
+	g_us_per_tick = 1e6 / c.freq;
+	check_idle();
+	if (load(argv[optind], &handle))
+		return 1;
+
+	flags = RTCORE_SCHED_WCET | (cold ? RTCORE_SCHED_COLD : 0);
+	for (i = 0; i < warmup; ++i) {
+		if (run_once(handle, mem_req, flags, timeout_ms, &rec))
+			return 1;
+	}
+	sum = 0;
+	disturbed = 0;
+	for (i = 0; i < runs; ++i) {
+		if (run_once(handle, mem_req, flags, timeout_ms, &rec))
+			return 1;
+		exec[i] = rec.t_exec;
+		sum += rec.t_exec;
+		disturbed += rec.irqs != 0;
+		if (verbose)
+			printf("run %5ld: %10.2f us  irqs %u  status %d\n",
+				i, us(rec.t_exec), rec.irqs, rec.status);
+	}
+	qsort(exec, runs, sizeof(*exec), u64_cmp);
+
+	budget = exec[runs - 1] + (exec[runs - 1] * margin + 99) / 100;
+	printf("%s: %ld runs, %s, %ld warm-up\n", argv[optind], runs,
+		cold ? "cold" : "warm", warmup);
+	printf("  exec (us)  min %.2f  mean %.2f  p50 %.2f  p99 %.2f  max %.2f\n",
+		us(exec[0]), us(sum) / runs, us(exec[runs / 2]),
+		us(exec[(runs * 99 + 99) / 100 - 1]), us(exec[runs - 1]));
+	printf("  runs with interrupts: %d\n", disturbed);
+	printf("  recommended budget: %.1f us (max + %ld%%)\n",
+		us(budget), margin);
+	if (runs < 100)
+		printf("  fewer than 100 runs, p99 is the max or close to it\n");
+
+	jrtclock_unmap(clock);
+	close(g_fd);
+	free(exec);
+	return 0;
+}
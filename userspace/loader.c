@@ -41,13 +41,16 @@ int start_kernel(int fd, uintptr_t entry, uint64_t core_id)
 	printf("Started CPU 3 at user address: 0x%lx\n", args.entry_user);
 }
 
-int sched_prog(int fd, uintptr_t entry, uint64_t mem_req)
+int sched_prog(int fd, uintptr_t entry, uint64_t size, uint64_t mem_req)
 {
 
 	printf("Scheduling program at user address: 0x%lx...\n", entry);
 	struct rtcore_sched_args args = {
 		.entry_user = entry,
-		.mem_req = mem_req
+		.mem_req = mem_req,
+		.prog_size = size,
+		.deadline_us = 0,
+		.flags = 0
 	};
 	printf("Scheduling program at user address: 0x%lx...\n", args.entry_user);
 	if (ioctl(fd, RTCORE_IOCTL_SCHED_PROG, &args) < 0) {
@@ -57,11 +60,29 @@ int sched_prog(int fd, uintptr_t entry, uint64_t mem_req)
 
 }
 
+int load_prog(int fd, int fd_in, uintptr_t slot)
+{
+	struct rtcore_load_args args = {
+		.fd = fd_in,
+		.slot_user = slot,
+		.size = 0
+	};
+
+	if (ioctl(fd, RTCORE_IOCTL_LOAD_FD, &args) < 0) {
+		perror("ioctl load_fd");
+		return -1;
+	}
+	printf("Loaded %lu bytes at user address: 0x%lx\n", args.size, slot);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd, fd_in;
-	void *jrt_mem, *prog;
+	void *jrt_mem;
 	struct stat st;
+	code_info_t info;
+	size_t len;
 
 	if (argc < 2) {
 		fprintf(stderr, "Usage: %s <rtprog.elf>\n", argv[0]);
@@ -80,21 +101,28 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (st.st_size > JRT_CODE_SIZE) {
-		fprintf(stderr, "<program>.bin too big\n");
-		close(fd_in);
-		return 1;
-	}
-
 	fd = open("/dev/rtcore", O_RDWR);
 	if (fd < 0) {
 		perror("open /dev/rtcore");
 		return 1;
 	}
 
+	/* only the image, the top of the window is the module's image cache */
+	if (ioctl(fd, RTCORE_IOCTL_CODE_INFO, &info) < 0) {
+		perror("ioctl code_info");
+		return 1;
+	}
+	len = (st.st_size + getpagesize() - 1) & ~((size_t)getpagesize() - 1);
+	if (len > info.code_size - info.code_used) {
+		fprintf(stderr, "<program>.bin too big: %zu bytes, %llu free\n",
+			len, (unsigned long long)(info.code_size - info.code_used));
+		close(fd_in);
+		return 1;
+	}
+
 	jrt_mem = mmap(
 		NULL,
-		st.st_size * 2,
+		len,
 		PROT_READ | PROT_WRITE,
 		MAP_SHARED,
 		fd,
@@ -106,20 +134,16 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	prog = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_in, 0);
-	if (prog == MAP_FAILED) {
-		perror("mmap file");
+	/* the module reads the image from the page cache into the window */
+	if (load_prog(fd, fd_in, (uintptr_t)jrt_mem) < 0) {
 		close(fd_in);
 		return 1;
 	}
-	printf("here\n");
-	memcpy(jrt_mem, prog, st.st_size);
-	munmap(prog, st.st_size);
 	close(fd_in);
 
 	if (argc > 2) {
 		printf("here\n");
-		sched_prog(fd, (uintptr_t)jrt_mem, 0x10000);
+		sched_prog(fd, (uintptr_t)jrt_mem, st.st_size, 0x10000);
 	} else
 		start_kernel(fd, (uintptr_t)jrt_mem, 3);
 	return 0;
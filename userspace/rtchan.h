@@ -0,0 +1,65 @@
+/**
+ *
+ * rtchan.h - Linux side of the shared-state channels (shared/chan.h)
+ *
+ * Map the channel area of an open /dev/rtcore once, then open channels
+ * by name and use chan_seq_read() / chan_tb_write() on them directly.
+ *
+ * Author Gustaf Franzen <gustaffranzen@icloud.com>
+ *
+ */
+#ifndef _RTCHAN_H_
+#define _RTCHAN_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../shared/rtcore.h"
+#include "../shared/memory_layout.h"
+
+static inline void *rtchan_map(int fd)
+{
+	void *area;
+
+	area = mmap(NULL, CHAN_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, RTCORE_CHAN_MMAP_OFF);
+	return area == MAP_FAILED ? NULL : area;
+}
+
+static inline void rtchan_unmap(void *area)
+{
+	munmap(area, CHAN_AREA_SIZE);
+}
+
+/* open name, creating it first if nobody has */
+static inline int rtchan_open(int fd, void *area, const char *name,
+	uint32_t type, uint32_t size, chan_t *c)
+{
+	chan_create_args_t args;
+
+	if (strlen(name) >= CHAN_NAME_MAX)
+		return -ENAMETOOLONG;
+
+	memset(&args, 0, sizeof(args));
+	strcpy(args.name, name);
+	args.type = type;
+	args.size = size;
+	if (ioctl(fd, RTCORE_IOCTL_CHAN_CREATE, &args) < 0)
+		return -errno;
+
+	c->hdr = (uint8_t *)area + args.off;
+	c->type = type;
+	c->size = size;
+	return 0;
+}
+
+/* open a channel that already exists, whatever its size */
+static inline int rtchan_find(void *area, const char *name, chan_t *c)
+{
+	return chan_lookup(area, name, c) ? -ENOENT : 0;
+}
+
+#endif